@@ -0,0 +1,180 @@
+// Copyright 2016-2020 Cadic AB. All Rights Reserved.
+// @Author	Fredrik Lindh [Temaran] (temaran@gmail.com) {https://github.com/Temaran}
+///////////////////////////////////////////////////////////////////////////////////////
+
+#include "CPUShaderExample.h"
+#include "Async/ParallelFor.h"
+#include "Math/VectorRegister.h"
+
+// We split the work into square tiles the size of the largest GPU thread groups, and hand each tile to a worker thread.
+#define NUM_PIXELS_PER_TILE_DIMENSION 32
+
+// The engine vector registers are 4 wide (SSE/NEON), so each loop iteration evaluates 4 horizontally adjacent pixels.
+#define NUM_PIXELS_PER_VECTOR 4
+
+namespace
+{
+	// Everything in the shader that only depends on the simulation state, hoisted out of the per pixel work.
+	struct FCPUShaderFrameConstants
+	{
+		float TimeOffset;
+		float TimeScale;
+		float PZOffset;
+		float Phase1;
+		float Phase2;
+		float RedScale;
+		float BlendFactor;
+		FLinearColor StartColor;
+		FLinearColor EndColor;
+
+		FCPUShaderFrameConstants(const FShaderUsageExampleParameters& DrawParameters)
+		{
+			const float Time = DrawParameters.SimulationState;
+			TimeOffset = Time * 0.1f;
+			TimeScale = (0.25f + 0.05f * FMath::Sin(Time * 0.1f)) * 2.2f;
+			PZOffset = -1.5f - FMath::Sin(Time * 0.13f) * 0.1f;
+			Phase1 = 0.5f - Time * 0.2f;
+			Phase2 = 1.2f - Time * 0.3f;
+			RedScale = 1.5f + FMath::Sin(Time * 0.2f) * 0.4f;
+			BlendFactor = DrawParameters.ComputeShaderBlend;
+			StartColor = FLinearColor(DrawParameters.StartColor.R, DrawParameters.StartColor.G, DrawParameters.StartColor.B, DrawParameters.StartColor.A) / 255.0f;
+			EndColor = FLinearColor(DrawParameters.EndColor.R, DrawParameters.EndColor.G, DrawParameters.EndColor.B, DrawParameters.EndColor.A) / 255.0f;
+		}
+	};
+
+	// This is MainComputeShader from ComputeShader.usf at the high quality tier, evaluated for 4 pixels on the same row at once.
+	// Outputs the falloff adjusted v1, v2, v3 accumulators and the distance to the center for each lane.
+	FORCEINLINE void EvaluateFractal(const FCPUShaderFrameConstants& Constants, const VectorRegister4Float& U, float V, VectorRegister4Float& OutV1, VectorRegister4Float& OutV2, VectorRegister4Float& OutV3, VectorRegister4Float& OutLength)
+	{
+		const VectorRegister4Float VV = VectorSetFloat1(V);
+		const VectorRegister4Float Len = VectorSqrt(VectorMultiplyAdd(U, U, VectorMultiply(VV, VV)));
+
+		const VectorRegister4Float T = VectorAdd(VectorSetFloat1(Constants.TimeOffset), VectorDivide(VectorSetFloat1(Constants.TimeScale), VectorAdd(Len, VectorSetFloat1(0.07f))));
+		const VectorRegister4Float Si = VectorSin(T);
+		const VectorRegister4Float Co = VectorCos(T);
+
+		// mul(p.xy, ma) is linear in s, so we can rotate the uv once and scale it inside the loop.
+		const VectorRegister4Float RotatedU = VectorSubtract(VectorMultiply(U, Co), VectorMultiply(VV, Si));
+		const VectorRegister4Float RotatedV = VectorMultiplyAdd(U, Si, VectorMultiply(VV, Co));
+
+		// The sin() terms of the accumulation only depend on the pixel, not the step.
+		const VectorRegister4Float K1 = VectorMultiply(VectorSetFloat1(0.0015f), VectorAdd(VectorSetFloat1(1.8f), VectorSin(VectorMultiplyAdd(Len, VectorSetFloat1(13.0f), VectorSetFloat1(Constants.Phase1)))));
+		const VectorRegister4Float K2 = VectorMultiply(VectorSetFloat1(0.0013f), VectorAdd(VectorSetFloat1(1.5f), VectorSin(VectorMultiplyAdd(Len, VectorSetFloat1(14.5f), VectorSetFloat1(Constants.Phase2)))));
+
+		const VectorRegister4Float Fold = VectorSetFloat1(0.659f);
+		const VectorRegister4Float OffsetX = VectorSetFloat1(0.22f);
+		const VectorRegister4Float OffsetY = VectorSetFloat1(0.3f);
+
+		VectorRegister4Float V1 = VectorZeroFloat();
+		VectorRegister4Float V2 = VectorZeroFloat();
+		VectorRegister4Float V3 = VectorZeroFloat();
+
+		float s = 0.0f;
+		for (int32 i = 0; i < 90; i++)
+		{
+			const VectorRegister4Float S = VectorSetFloat1(s);
+			VectorRegister4Float PX = VectorMultiplyAdd(S, RotatedU, OffsetX);
+			VectorRegister4Float PY = VectorMultiplyAdd(S, RotatedV, OffsetY);
+			VectorRegister4Float PZ = VectorSetFloat1(s + Constants.PZOffset);
+
+			for (int32 j = 0; j < 8; j++)
+			{
+				const VectorRegister4Float Dot = VectorMultiplyAdd(PX, PX, VectorMultiplyAdd(PY, PY, VectorMultiply(PZ, PZ)));
+				PX = VectorSubtract(VectorDivide(VectorAbs(PX), Dot), Fold);
+				PY = VectorSubtract(VectorDivide(VectorAbs(PY), Dot), Fold);
+				PZ = VectorSubtract(VectorDivide(VectorAbs(PZ), Dot), Fold);
+			}
+
+			const VectorRegister4Float LengthXYSquared = VectorMultiplyAdd(PX, PX, VectorMultiply(PY, PY));
+			const VectorRegister4Float Dot = VectorMultiplyAdd(PZ, PZ, LengthXYSquared);
+			V1 = VectorMultiplyAdd(Dot, K1, V1);
+			V2 = VectorMultiplyAdd(Dot, K2, V2);
+			V3 = VectorMultiplyAdd(VectorSqrt(LengthXYSquared), VectorSetFloat1(0.003f), V3);
+			s += 0.035f;
+		}
+
+		// lerp(x, 0.0, len) == x * (1.0 - len)
+		const VectorRegister4Float Falloff = VectorSubtract(VectorOneFloat(), Len);
+		OutV1 = VectorMultiply(V1, VectorMultiply(Falloff, VectorSetFloat1(0.7f)));
+		OutV2 = VectorMultiply(V2, VectorMultiply(Falloff, VectorSetFloat1(0.5f)));
+		OutV3 = VectorMultiply(V3, VectorMultiply(Falloff, VectorSetFloat1(0.9f)));
+		OutLength = Len;
+	}
+
+	// The rest of MainComputeShader including the 8 bit quantization, followed by the blend in MainPixelShader.
+	FORCEINLINE FColor ResolvePixel(const FCPUShaderFrameConstants& Constants, float V1, float V2, float V3, float Len, FVector2f PixelShaderUV, bool bSRGB)
+	{
+		const float Shared = (0.2f * (1.0f - Len)) * 0.85f + (0.6f * V3) * 0.3f;
+		const float Col[3] = { V3 * Constants.RedScale + Shared, (V1 + V3) * 0.3f + Shared, V2 + Shared };
+
+		float Quantized[3];
+		for (int32 Channel = 0; Channel < 3; Channel++)
+		{
+			const float Minimized = FMath::Min(FMath::Pow(FMath::Abs(Col[Channel]), 1.2f), 1.0f);
+			Quantized[Channel] = (float)(uint32)(Minimized * 255.0f) / 255.0f;
+		}
+
+		const float Alpha = PixelShaderUV.Size() / FVector2f(1.0f, 1.0f).Size();
+		const FLinearColor SolidColorComponent = FMath::Lerp(Constants.StartColor, Constants.EndColor, Alpha) * (1.0f - Constants.BlendFactor);
+		const FLinearColor ComputeShaderComponent = FLinearColor(Quantized[0], Quantized[1], Quantized[2], 1.0f) * Constants.BlendFactor;
+		return (SolidColorComponent + ComputeShaderComponent).ToFColor(bSRGB);
+	}
+}
+
+void FCPUShaderExample::RenderToBuffer_AnyThread(const FShaderUsageExampleParameters& DrawParameters, FIntPoint TextureSize, FIntRect Rect, bool bSRGB, FColor* OutPixels, int32 OutStride)
+{
+	QUICK_SCOPE_CYCLE_COUNTER(STAT_ShaderPlugin_CPUShader); // Used to gather CPU profiling data for the UE4 session frontend
+
+	Rect.Clip(FIntRect(FIntPoint::ZeroValue, TextureSize));
+	if (Rect.IsEmpty() || !OutPixels)
+	{
+		return;
+	}
+
+	const FCPUShaderFrameConstants Constants(DrawParameters);
+	const FVector2f Resolution(TextureSize.X, TextureSize.Y);
+	const int32 NumTilesX = FMath::DivideAndRoundUp(Rect.Width(), NUM_PIXELS_PER_TILE_DIMENSION);
+	const int32 NumTilesY = FMath::DivideAndRoundUp(Rect.Height(), NUM_PIXELS_PER_TILE_DIMENSION);
+
+	// Every pixel costs about the same, so the tiles are evenly sized jobs and the scheduler can balance them across all cores.
+	ParallelFor(NumTilesX * NumTilesY, [&](int32 TileIndex)
+	{
+		const FIntPoint TileMin = Rect.Min + FIntPoint(TileIndex % NumTilesX, TileIndex / NumTilesX) * NUM_PIXELS_PER_TILE_DIMENSION;
+		const FIntPoint TileMax = FIntPoint(FMath::Min(TileMin.X + NUM_PIXELS_PER_TILE_DIMENSION, Rect.Max.X), FMath::Min(TileMin.Y + NUM_PIXELS_PER_TILE_DIMENSION, Rect.Max.Y));
+
+		for (int32 Y = TileMin.Y; Y < TileMax.Y; Y++)
+		{
+			FColor* OutRow = OutPixels + (int64)(Y - Rect.Min.Y) * OutStride - Rect.Min.X;
+			const float V = Y / Resolution.Y - 0.5f;
+
+			for (int32 X = TileMin.X; X < TileMax.X; X += NUM_PIXELS_PER_VECTOR)
+			{
+				// Lanes past the end of the tile are evaluated but never written.
+				const VectorRegister4Float U = MakeVectorRegister(X / Resolution.X - 0.5f, (X + 1) / Resolution.X - 0.5f, (X + 2) / Resolution.X - 0.5f, (X + 3) / Resolution.X - 0.5f);
+
+				// When the fractal is blended away, only the gradient part of the pixel shader contributes to the output.
+				VectorRegister4Float V1 = VectorZeroFloat(), V2 = VectorZeroFloat(), V3 = VectorZeroFloat(), Len = VectorZeroFloat();
+				if (Constants.BlendFactor != 0.0f)
+				{
+					EvaluateFractal(Constants, U, V, V1, V2, V3, Len);
+				}
+
+				alignas(16) float V1Lanes[NUM_PIXELS_PER_VECTOR];
+				alignas(16) float V2Lanes[NUM_PIXELS_PER_VECTOR];
+				alignas(16) float V3Lanes[NUM_PIXELS_PER_VECTOR];
+				alignas(16) float LenLanes[NUM_PIXELS_PER_VECTOR];
+				VectorStoreAligned(V1, V1Lanes);
+				VectorStoreAligned(V2, V2Lanes);
+				VectorStoreAligned(V3, V3Lanes);
+				VectorStoreAligned(Len, LenLanes);
+
+				const int32 NumLanes = FMath::Min(NUM_PIXELS_PER_VECTOR, TileMax.X - X);
+				for (int32 Lane = 0; Lane < NumLanes; Lane++)
+				{
+					const FVector2f PixelShaderUV = FVector2f(X + Lane + 0.5f, Y + 0.5f) / Resolution;
+					OutRow[X + Lane] = ResolvePixel(Constants, V1Lanes[Lane], V2Lanes[Lane], V3Lanes[Lane], LenLanes[Lane], PixelShaderUV, bSRGB);
+				}
+			}
+		}
+	});
+}
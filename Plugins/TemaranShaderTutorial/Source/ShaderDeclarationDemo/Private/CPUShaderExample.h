@@ -0,0 +1,21 @@
+// Copyright 2016-2020 Cadic AB. All Rights Reserved.
+// @Author	Fredrik Lindh [Temaran] (temaran@gmail.com) {https://github.com/Temaran}
+///////////////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "ShaderDeclarationDemoModule.h"
+
+/**************************************************************************************/
+/* This is a CPU port of the compute and pixel shader chain. It is used when we don't  */
+/* have a GPU to run on, like when running with -nullrhi on build machines or servers. */
+/**************************************************************************************/
+class FCPUShaderExample
+{
+public:
+	// Evaluates the effect for every pixel of Rect, where Rect is expressed in the pixel space of a TextureSize sized target.
+	// The output is written as BGRA8 (FColor) rows with a stride of OutStride pixels, starting at the top left corner of Rect.
+	// bSRGB controls whether the output is gamma encoded, which is what the GPU does when writing to an sRGB render target.
+	static void RenderToBuffer_AnyThread(const FShaderUsageExampleParameters& DrawParameters, FIntPoint TextureSize, FIntRect Rect, bool bSRGB, FColor* OutPixels, int32 OutStride);
+};
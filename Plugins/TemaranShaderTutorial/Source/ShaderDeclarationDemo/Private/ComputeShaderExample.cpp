@@ -3,6 +3,7 @@
 ///////////////////////////////////////////////////////////////////////////////////////
 
 #include "ComputeShaderExample.h"
+#include "GPUBudgetController.h"
 #include "ShaderParameterUtils.h"
 #include "RHIStaticStates.h"
 #include "Shader.h"
@@ -12,8 +13,59 @@
 #include "ShaderParameterStruct.h"
 #include "UniformBuffer.h"
 #include "RHICommandList.h"
+#include "HAL/IConsoleManager.h"
 
-#define NUM_THREADS_PER_GROUP_DIMENSION 32
+static TAutoConsoleVariable<int32> CVarShaderPluginQuality(
+	TEXT("r.ShaderPlugin.Quality"),
+	2,
+	TEXT("How many iterations the shader plugin compute shader spends per pixel.\n")
+	TEXT(" 0: Low (30 steps, 6 folds each)\n")
+	TEXT(" 1: Medium (60 steps, 8 folds each)\n")
+	TEXT(" 2: High (90 steps, 8 folds each, the original effect) (default)\n")
+	TEXT(" 3: Ultra (180 steps, 8 folds each)"),
+	ECVF_Scalability | ECVF_RenderThreadSafe);
+
+static TAutoConsoleVariable<int32> CVarShaderPluginThreadGroupSize(
+	TEXT("r.ShaderPlugin.ThreadGroupSize"),
+	8,
+	TEXT("The width and height of the shader plugin compute shader thread groups. Smaller groups usually give better occupancy.\n")
+	TEXT(" 8: 8x8 threads (default)\n")
+	TEXT(" 16: 16x16 threads\n")
+	TEXT(" 32: 32x32 threads"),
+	ECVF_RenderThreadSafe);
+
+static TAutoConsoleVariable<int32> CVarShaderPluginHalfPrecision(
+	TEXT("r.ShaderPlugin.HalfPrecision"),
+	0,
+	TEXT("Whether the shader plugin compute shaders fold the fractal in 16 bit floats, which is faster on hardware with packed half math.\n")
+	TEXT("Run r.ShaderPlugin.HalfPrecision.Report to see how far the result drifts from the 32 bit one on this platform.\n")
+	TEXT("Platforms without real 16 bit types always use 32 bit, and so does r.ShaderPlugin.TileCulling.\n")
+	TEXT(" 0: 32 bit (default)\n")
+	TEXT(" 1: 16 bit"),
+	ECVF_Scalability | ECVF_RenderThreadSafe);
+
+static TAutoConsoleVariable<int32> CVarShaderPluginTileCulling(
+	TEXT("r.ShaderPlugin.TileCulling"),
+	0,
+	TEXT("Whether the shader plugin compute shader first sorts the tiles of the output into flat ones and ones with detail,\n")
+	TEXT("and only evaluates the fractal for every pixel of the latter. Flat tiles are filled with a single color.\n")
+	TEXT("This is lossy, since a tile counts as flat by a handful of samples, see r.ShaderPlugin.TileCulling.Threshold.\n")
+	TEXT(" 0: Evaluate every pixel (default)\n")
+	TEXT(" 1: Fill flat tiles with a single color"),
+	ECVF_Scalability | ECVF_RenderThreadSafe);
+
+static TAutoConsoleVariable<float> CVarShaderPluginTileCullingThreshold(
+	TEXT("r.ShaderPlugin.TileCulling.Threshold"),
+	2.0f,
+	TEXT("How far apart, in 8 bit color steps, the corner and center samples of a tile may be for r.ShaderPlugin.TileCulling to call it flat. (default 2)"),
+	ECVF_Scalability | ECVF_RenderThreadSafe);
+
+// Whether the platform can compile min16float to real 16 bit math. Where it can't, the half precision permutations would be
+// the same shaders as the full precision ones, so we don't compile them and never pick them.
+static bool PlatformSupportsHalfPrecision(const FStaticShaderPlatform Platform)
+{
+	return FDataDrivenShaderPlatformInfo::GetSupportsRealTypes(Platform) != ERHIFeatureSupport::Unsupported;
+}
 
 /**********************************************************************************************/
 /* This class carries our parameter declarations and acts as the bridge between cpp and HLSL. */
@@ -24,25 +76,62 @@ public:
 	DECLARE_GLOBAL_SHADER(FComputeShaderExampleCS);
 	SHADER_USE_PARAMETER_STRUCT(FComputeShaderExampleCS, FGlobalShader);
 
+	// Whether OutputTexture is a typed RGBA texture or the manually packed uint fallback.
+	class FTypedOutputDim : SHADER_PERMUTATION_BOOL("TYPED_OUTPUT");
+
+	// The iteration count tier, see r.ShaderPlugin.Quality.
+	class FQualityDim : SHADER_PERMUTATION_RANGE_INT("QUALITY", 0, 4);
+
+	// The width and height of the thread groups, see r.ShaderPlugin.ThreadGroupSize.
+	class FThreadGroupSizeDim : SHADER_PERMUTATION_SPARSE_INT("THREADGROUP_SIZE", 8, 16, 32);
+
+	// Whether every thread group evaluates a tile from TileList, rather than the one at its position. See r.ShaderPlugin.TileCulling.
+	class FTileListDim : SHADER_PERMUTATION_BOOL("TILE_LIST");
+
+	// Whether the fractal is folded in 16 bit floats, see r.ShaderPlugin.HalfPrecision.
+	class FHalfPrecisionDim : SHADER_PERMUTATION_BOOL("HALF_PRECISION");
+
+	using FPermutationDomain = TShaderPermutationDomain<FTypedOutputDim, FQualityDim, FThreadGroupSizeDim, FTileListDim, FHalfPrecisionDim>;
+
 	BEGIN_SHADER_PARAMETER_STRUCT(FParameters, )
-		SHADER_PARAMETER_UAV(RWTexture2D<uint>, OutputTexture)
+		SHADER_PARAMETER_RDG_TEXTURE_UAV(RWTexture2DArray, OutputTexture) // <float4> or <uint>, depending on FTypedOutputDim
+		SHADER_PARAMETER_RDG_BUFFER_SRV(StructuredBuffer<FSliceParameters>, SliceParameters)
+		SHADER_PARAMETER_RDG_BUFFER_SRV(Buffer<uint2>, TileList)
+		SHADER_PARAMETER_RDG_BUFFER_SRV(Buffer<uint>, TileCounts)
+		SHADER_PARAMETER(uint32, TileCountIndex)
 		SHADER_PARAMETER(FVector2f, TextureSize) // Metal doesn't support GetDimensions(), so we send in this data via our parameters.
-		SHADER_PARAMETER(float, SimulationState)
+		SHADER_PARAMETER(FIntPoint, AmortizeCell)
+		RDG_BUFFER_ACCESS(IndirectArgs, ERHIAccess::IndirectArgs)
 	END_SHADER_PARAMETER_STRUCT()
 
 public:
 	static bool ShouldCompilePermutation(const FGlobalShaderPermutationParameters& Parameters)
 	{
-		return IsFeatureLevelSupported(Parameters.Platform, ERHIFeatureLevel::SM5);
+		if (!IsFeatureLevelSupported(Parameters.Platform, ERHIFeatureLevel::SM5))
+		{
+			return false;
+		}
+
+		// Tile culling always runs in full precision, see RunComputeShader_RenderThread.
+		const FPermutationDomain PermutationVector(Parameters.PermutationId);
+		return !PermutationVector.Get<FHalfPrecisionDim>() || (PlatformSupportsHalfPrecision(Parameters.Platform) && !PermutationVector.Get<FTileListDim>());
 	}
 
 	static inline void ModifyCompilationEnvironment(const FGlobalShaderPermutationParameters& Parameters, FShaderCompilerEnvironment& OutEnvironment)
 	{
 		FGlobalShader::ModifyCompilationEnvironment(Parameters, OutEnvironment);
 
-		OutEnvironment.SetDefine(TEXT("THREADGROUPSIZE_X"), NUM_THREADS_PER_GROUP_DIMENSION);
-		OutEnvironment.SetDefine(TEXT("THREADGROUPSIZE_Y"), NUM_THREADS_PER_GROUP_DIMENSION);
+		const FPermutationDomain PermutationVector(Parameters.PermutationId);
+		const int32 ThreadGroupSize = PermutationVector.Get<FThreadGroupSizeDim>();
+		OutEnvironment.SetDefine(TEXT("THREADGROUPSIZE_X"), ThreadGroupSize);
+		OutEnvironment.SetDefine(TEXT("THREADGROUPSIZE_Y"), ThreadGroupSize);
 		OutEnvironment.SetDefine(TEXT("THREADGROUPSIZE_Z"), 1);
+
+		// Without this, min16float is only a hint that the compiler and driver are free to ignore.
+		if (PermutationVector.Get<FHalfPrecisionDim>())
+		{
+			OutEnvironment.CompilerFlags.Add(CFLAG_AllowRealTypes);
+		}
 	}
 };
 
@@ -50,20 +139,405 @@ public:
 //                            ShaderType                            ShaderPath                     Shader function name    Type
 IMPLEMENT_GLOBAL_SHADER(FComputeShaderExampleCS, "/TutorialShaders/Private/ComputeShader.usf", "MainComputeShader", SF_Compute);
 
-void FComputeShaderExample::RunComputeShader_RenderThread(FRHICommandListImmediate& RHICmdList, const FShaderUsageExampleParameters& DrawParameters, FUnorderedAccessViewRHIRef ComputeShaderOutputUAV)
+/**********************************************************************************************/
+/* These two implement r.ShaderPlugin.TileCulling. The first sorts the tiles of the output    */
+/* into the ones the main shader has to evaluate and the flat ones, and the second fills the  */
+/* flat ones. Both live in ComputeShader.usf, next to the shader they stand in for.           */
+/**********************************************************************************************/
+class FClassifyTilesCS : public FGlobalShader
+{
+public:
+	DECLARE_GLOBAL_SHADER(FClassifyTilesCS);
+	SHADER_USE_PARAMETER_STRUCT(FClassifyTilesCS, FGlobalShader);
+
+	// The samples have to be evaluated at the same tier as the pixels they stand in for.
+	using FQualityDim = FComputeShaderExampleCS::FQualityDim;
+
+	// The tiles are the thread groups of FComputeShaderExampleCS, so this is the tile size.
+	using FThreadGroupSizeDim = FComputeShaderExampleCS::FThreadGroupSizeDim;
+
+	using FPermutationDomain = TShaderPermutationDomain<FQualityDim, FThreadGroupSizeDim>;
+
+	BEGIN_SHADER_PARAMETER_STRUCT(FParameters, )
+		SHADER_PARAMETER_RDG_BUFFER_SRV(StructuredBuffer<FSliceParameters>, SliceParameters)
+		SHADER_PARAMETER_RDG_BUFFER_UAV(RWBuffer<uint>, RWIndirectArgs)
+		SHADER_PARAMETER_RDG_BUFFER_UAV(RWBuffer<uint>, RWTileCounts)
+		SHADER_PARAMETER_RDG_BUFFER_UAV(RWBuffer<uint2>, RWLiveTiles)
+		SHADER_PARAMETER_RDG_BUFFER_UAV(RWBuffer<uint2>, RWFlatTiles)
+		SHADER_PARAMETER_RDG_BUFFER_UAV(RWBuffer<float4>, RWFlatTileColors)
+		SHADER_PARAMETER(FVector2f, TextureSize)
+		SHADER_PARAMETER(FIntPoint, AmortizeCell)
+		SHADER_PARAMETER(FIntPoint, NumTiles)
+		SHADER_PARAMETER(float, FlatThreshold)
+	END_SHADER_PARAMETER_STRUCT()
+
+public:
+	static bool ShouldCompilePermutation(const FGlobalShaderPermutationParameters& Parameters)
+	{
+		return IsFeatureLevelSupported(Parameters.Platform, ERHIFeatureLevel::SM5);
+	}
+
+	static inline void ModifyCompilationEnvironment(const FGlobalShaderPermutationParameters& Parameters, FShaderCompilerEnvironment& OutEnvironment)
+	{
+		FGlobalShader::ModifyCompilationEnvironment(Parameters, OutEnvironment);
+
+		const FPermutationDomain PermutationVector(Parameters.PermutationId);
+		const int32 TileSize = PermutationVector.Get<FThreadGroupSizeDim>();
+		OutEnvironment.SetDefine(TEXT("THREADGROUPSIZE_X"), TileSize);
+		OutEnvironment.SetDefine(TEXT("THREADGROUPSIZE_Y"), TileSize);
+		OutEnvironment.SetDefine(TEXT("THREADGROUPSIZE_Z"), 1);
+	}
+};
+
+IMPLEMENT_GLOBAL_SHADER(FClassifyTilesCS, "/TutorialShaders/Private/ComputeShader.usf", "MainClassifyTilesCS", SF_Compute);
+
+class FFillFlatTilesCS : public FGlobalShader
+{
+public:
+	DECLARE_GLOBAL_SHADER(FFillFlatTilesCS);
+	SHADER_USE_PARAMETER_STRUCT(FFillFlatTilesCS, FGlobalShader);
+
+	using FTypedOutputDim = FComputeShaderExampleCS::FTypedOutputDim;
+	using FThreadGroupSizeDim = FComputeShaderExampleCS::FThreadGroupSizeDim;
+	using FPermutationDomain = TShaderPermutationDomain<FTypedOutputDim, FThreadGroupSizeDim>;
+
+	BEGIN_SHADER_PARAMETER_STRUCT(FParameters, )
+		SHADER_PARAMETER_RDG_TEXTURE_UAV(RWTexture2DArray, OutputTexture)
+		SHADER_PARAMETER_RDG_BUFFER_SRV(StructuredBuffer<FSliceParameters>, SliceParameters)
+		SHADER_PARAMETER_RDG_BUFFER_SRV(Buffer<uint2>, TileList)
+		SHADER_PARAMETER_RDG_BUFFER_SRV(Buffer<float4>, FlatTileColors)
+		SHADER_PARAMETER_RDG_BUFFER_SRV(Buffer<uint>, TileCounts)
+		SHADER_PARAMETER(uint32, TileCountIndex)
+		SHADER_PARAMETER(FIntPoint, AmortizeCell)
+		RDG_BUFFER_ACCESS(IndirectArgs, ERHIAccess::IndirectArgs)
+	END_SHADER_PARAMETER_STRUCT()
+
+public:
+	static bool ShouldCompilePermutation(const FGlobalShaderPermutationParameters& Parameters)
+	{
+		return IsFeatureLevelSupported(Parameters.Platform, ERHIFeatureLevel::SM5);
+	}
+
+	static inline void ModifyCompilationEnvironment(const FGlobalShaderPermutationParameters& Parameters, FShaderCompilerEnvironment& OutEnvironment)
+	{
+		FGlobalShader::ModifyCompilationEnvironment(Parameters, OutEnvironment);
+
+		const FPermutationDomain PermutationVector(Parameters.PermutationId);
+		const int32 ThreadGroupSize = PermutationVector.Get<FThreadGroupSizeDim>();
+		OutEnvironment.SetDefine(TEXT("THREADGROUPSIZE_X"), ThreadGroupSize);
+		OutEnvironment.SetDefine(TEXT("THREADGROUPSIZE_Y"), ThreadGroupSize);
+		OutEnvironment.SetDefine(TEXT("THREADGROUPSIZE_Z"), 1);
+	}
+};
+
+IMPLEMENT_GLOBAL_SHADER(FFillFlatTilesCS, "/TutorialShaders/Private/ComputeShader.usf", "MainFillFlatTilesCS", SF_Compute);
+
+/**********************************************************************************************/
+/* The fused variant evaluates the fractal and the color blend in one pass, so it has the     */
+/* parameters of both the compute and the pixel shader, and writes straight to the target.    */
+/**********************************************************************************************/
+class FFusedComputeShaderExampleCS : public FGlobalShader
+{
+public:
+	DECLARE_GLOBAL_SHADER(FFusedComputeShaderExampleCS);
+	SHADER_USE_PARAMETER_STRUCT(FFusedComputeShaderExampleCS, FGlobalShader);
+
+	using FQualityDim = FComputeShaderExampleCS::FQualityDim;
+	using FThreadGroupSizeDim = FComputeShaderExampleCS::FThreadGroupSizeDim;
+	using FHalfPrecisionDim = FComputeShaderExampleCS::FHalfPrecisionDim;
+	using FPermutationDomain = TShaderPermutationDomain<FQualityDim, FThreadGroupSizeDim, FHalfPrecisionDim>;
+
+	BEGIN_SHADER_PARAMETER_STRUCT(FParameters, )
+		SHADER_PARAMETER_RDG_TEXTURE_UAV(RWTexture2D<float4>, RenderTarget)
+		SHADER_PARAMETER(FVector4f, StartColor)
+		SHADER_PARAMETER(FVector4f, EndColor)
+		SHADER_PARAMETER(FVector2f, TextureSize) // Metal doesn't support GetDimensions(), so we send in this data via our parameters.
+		SHADER_PARAMETER(FIntPoint, TileOffset)
+		SHADER_PARAMETER(FIntPoint, TileSize)
+		SHADER_PARAMETER(float, SimulationState)
+		SHADER_PARAMETER(float, BlendFactor)
+		SHADER_PARAMETER(uint32, OutputSRGB)
+	END_SHADER_PARAMETER_STRUCT()
+
+public:
+	static bool ShouldCompilePermutation(const FGlobalShaderPermutationParameters& Parameters)
+	{
+		const FPermutationDomain PermutationVector(Parameters.PermutationId);
+		return IsFeatureLevelSupported(Parameters.Platform, ERHIFeatureLevel::SM5)
+			&& (!PermutationVector.Get<FHalfPrecisionDim>() || PlatformSupportsHalfPrecision(Parameters.Platform));
+	}
+
+	static inline void ModifyCompilationEnvironment(const FGlobalShaderPermutationParameters& Parameters, FShaderCompilerEnvironment& OutEnvironment)
+	{
+		FGlobalShader::ModifyCompilationEnvironment(Parameters, OutEnvironment);
+
+		const FPermutationDomain PermutationVector(Parameters.PermutationId);
+		const int32 ThreadGroupSize = PermutationVector.Get<FThreadGroupSizeDim>();
+		OutEnvironment.SetDefine(TEXT("THREADGROUPSIZE_X"), ThreadGroupSize);
+		OutEnvironment.SetDefine(TEXT("THREADGROUPSIZE_Y"), ThreadGroupSize);
+		OutEnvironment.SetDefine(TEXT("THREADGROUPSIZE_Z"), 1);
+
+		// Without this, min16float is only a hint that the compiler and driver are free to ignore.
+		if (PermutationVector.Get<FHalfPrecisionDim>())
+		{
+			OutEnvironment.CompilerFlags.Add(CFLAG_AllowRealTypes);
+		}
+	}
+};
+
+IMPLEMENT_GLOBAL_SHADER(FFusedComputeShaderExampleCS, "/TutorialShaders/Private/FusedComputeShader.usf", "MainFusedComputeShader", SF_Compute);
+
+int32 FComputeShaderExample::GetQuality()
+{
+	return FGPUBudgetController::GetQuality(FMath::Clamp(CVarShaderPluginQuality.GetValueOnRenderThread(), 0, 3));
+}
+
+bool FComputeShaderExample::SupportsHalfPrecision()
+{
+	return PlatformSupportsHalfPrecision(GMaxRHIShaderPlatform);
+}
+
+bool FComputeShaderExample::UseHalfPrecision()
+{
+	return CVarShaderPluginHalfPrecision.GetValueOnRenderThread() != 0 && SupportsHalfPrecision();
+}
+
+// Snaps the cvar to the closest group size we have a permutation for.
+static int32 GetThreadGroupSize()
+{
+	const int32 RequestedSize = CVarShaderPluginThreadGroupSize.GetValueOnRenderThread();
+	return RequestedSize <= 8 ? 8 : (RequestedSize <= 16 ? 16 : 32);
+}
+
+// Sorts the tiles of every slice into live and flat ones, evaluates the fractal for the live ones and fills the flat ones.
+// Both of the last two passes are dispatched indirectly, with one thread group per tile, so the GPU only runs the groups it needs.
+// The tile dispatches are laid out in rows, see TILE_DISPATCH_WIDTH in ComputeShader.usf.
+static void AddTileCulledComputePasses(FRDGBuilder& GraphBuilder, FIntPoint TextureSize, FIntPoint AmortizeCell, int32 NumSlices, FRDGBufferSRVRef SliceParameters, FRDGTextureRef ComputeShaderOutput, const FComputeShaderExampleCS::FPermutationDomain& PermutationVector, ERDGPassFlags PassFlags)
+{
+	// The tiles are made of threads, which only cover every pixel without amortization.
+	const int32 TileSize = PermutationVector.Get<FComputeShaderExampleCS::FThreadGroupSizeDim>();
+	const FIntPoint ThreadGridSize(FMath::DivideAndRoundUp(TextureSize.X, AmortizeCell.X), FMath::DivideAndRoundUp(TextureSize.Y, AmortizeCell.Y));
+	const FIntPoint NumTiles(FMath::DivideAndRoundUp(ThreadGridSize.X, TileSize), FMath::DivideAndRoundUp(ThreadGridSize.Y, TileSize));
+	const uint32 MaxTiles = NumTiles.X * NumTiles.Y * NumSlices;
+
+	// Every tile ends up in one of the two lists, but we don't know which, so both must be able to hold all of them.
+	FRDGBufferRef IndirectArgs = GraphBuilder.CreateBuffer(FRDGBufferDesc::CreateIndirectDesc<FRHIDispatchIndirectParameters>(2), TEXT("ShaderPlugin_TileIndirectArgs"));
+	FRDGBufferRef LiveTiles = GraphBuilder.CreateBuffer(FRDGBufferDesc::CreateBufferDesc(sizeof(uint32) * 2, MaxTiles), TEXT("ShaderPlugin_LiveTiles"));
+	FRDGBufferRef FlatTiles = GraphBuilder.CreateBuffer(FRDGBufferDesc::CreateBufferDesc(sizeof(uint32) * 2, MaxTiles), TEXT("ShaderPlugin_FlatTiles"));
+	FRDGBufferRef FlatTileColors = GraphBuilder.CreateBuffer(FRDGBufferDesc::CreateBufferDesc(sizeof(FVector4f), MaxTiles), TEXT("ShaderPlugin_FlatTileColors"));
+
+	FRDGBufferRef TileCounts = GraphBuilder.CreateBuffer(FRDGBufferDesc::CreateBufferDesc(sizeof(uint32), 2), TEXT("ShaderPlugin_TileCounts"));
+
+	FRDGBufferUAVRef IndirectArgsUAV = GraphBuilder.CreateUAV(IndirectArgs, PF_R32_UINT);
+	FRDGBufferUAVRef TileCountsUAV = GraphBuilder.CreateUAV(TileCounts, PF_R32_UINT);
+	AddClearUAVPass(GraphBuilder, PassFlags, IndirectArgsUAV, 0);
+	AddClearUAVPass(GraphBuilder, PassFlags, TileCountsUAV, 0);
+
+	{
+		FClassifyTilesCS::FParameters* PassParameters = GraphBuilder.AllocParameters<FClassifyTilesCS::FParameters>();
+		PassParameters->SliceParameters = SliceParameters;
+		PassParameters->RWIndirectArgs = IndirectArgsUAV;
+		PassParameters->RWTileCounts = TileCountsUAV;
+		PassParameters->RWLiveTiles = GraphBuilder.CreateUAV(LiveTiles, PF_R32G32_UINT);
+		PassParameters->RWFlatTiles = GraphBuilder.CreateUAV(FlatTiles, PF_R32G32_UINT);
+		PassParameters->RWFlatTileColors = GraphBuilder.CreateUAV(FlatTileColors, PF_A32B32G32R32F);
+		PassParameters->TextureSize = FVector2f(TextureSize.X, TextureSize.Y);
+		PassParameters->AmortizeCell = AmortizeCell;
+		PassParameters->NumTiles = NumTiles;
+		PassParameters->FlatThreshold = FMath::Max(CVarShaderPluginTileCullingThreshold.GetValueOnRenderThread(), 0.0f) / 255.0f;
+
+		FClassifyTilesCS::FPermutationDomain ClassifyPermutationVector;
+		ClassifyPermutationVector.Set<FClassifyTilesCS::FQualityDim>(PermutationVector.Get<FComputeShaderExampleCS::FQualityDim>());
+		ClassifyPermutationVector.Set<FClassifyTilesCS::FThreadGroupSizeDim>(TileSize);
+		TShaderMapRef<FClassifyTilesCS> ComputeShader(GetGlobalShaderMap(GMaxRHIFeatureLevel), ClassifyPermutationVector);
+
+		const FIntVector GroupCounts(FMath::DivideAndRoundUp(NumTiles.X, 8), FMath::DivideAndRoundUp(NumTiles.Y, 8), NumSlices);
+		FComputeShaderUtils::AddPass(GraphBuilder, RDG_EVENT_NAME("ShaderPlugin_ClassifyTiles %dx%d", NumTiles.X, NumTiles.Y), PassFlags, ComputeShader, PassParameters, GroupCounts);
+	}
+
+	{
+		FComputeShaderExampleCS::FParameters* PassParameters = GraphBuilder.AllocParameters<FComputeShaderExampleCS::FParameters>();
+		PassParameters->OutputTexture = GraphBuilder.CreateUAV(ComputeShaderOutput);
+		PassParameters->SliceParameters = SliceParameters;
+		PassParameters->TileList = GraphBuilder.CreateSRV(LiveTiles, PF_R32G32_UINT);
+		PassParameters->TileCounts = GraphBuilder.CreateSRV(TileCounts, PF_R32_UINT);
+		PassParameters->TileCountIndex = 0;
+		PassParameters->TextureSize = FVector2f(TextureSize.X, TextureSize.Y);
+		PassParameters->AmortizeCell = AmortizeCell;
+		PassParameters->IndirectArgs = IndirectArgs;
+
+		FComputeShaderExampleCS::FPermutationDomain TileListPermutationVector = PermutationVector;
+		TileListPermutationVector.Set<FComputeShaderExampleCS::FTileListDim>(true);
+		TShaderMapRef<FComputeShaderExampleCS> ComputeShader(GetGlobalShaderMap(GMaxRHIFeatureLevel), TileListPermutationVector);
+
+		FComputeShaderUtils::AddPass(GraphBuilder, RDG_EVENT_NAME("ShaderPlugin_Compute (live tiles)"), PassFlags, ComputeShader, PassParameters, IndirectArgs, 0);
+	}
+
+	{
+		FFillFlatTilesCS::FParameters* PassParameters = GraphBuilder.AllocParameters<FFillFlatTilesCS::FParameters>();
+		PassParameters->OutputTexture = GraphBuilder.CreateUAV(ComputeShaderOutput);
+		PassParameters->SliceParameters = SliceParameters;
+		PassParameters->TileList = GraphBuilder.CreateSRV(FlatTiles, PF_R32G32_UINT);
+		PassParameters->FlatTileColors = GraphBuilder.CreateSRV(FlatTileColors, PF_A32B32G32R32F);
+		PassParameters->TileCounts = GraphBuilder.CreateSRV(TileCounts, PF_R32_UINT);
+		PassParameters->TileCountIndex = 1;
+		PassParameters->AmortizeCell = AmortizeCell;
+		PassParameters->IndirectArgs = IndirectArgs;
+
+		FFillFlatTilesCS::FPermutationDomain FillPermutationVector;
+		FillPermutationVector.Set<FFillFlatTilesCS::FTypedOutputDim>(PermutationVector.Get<FComputeShaderExampleCS::FTypedOutputDim>());
+		FillPermutationVector.Set<FFillFlatTilesCS::FThreadGroupSizeDim>(TileSize);
+		TShaderMapRef<FFillFlatTilesCS> ComputeShader(GetGlobalShaderMap(GMaxRHIFeatureLevel), FillPermutationVector);
+
+		FComputeShaderUtils::AddPass(GraphBuilder, RDG_EVENT_NAME("ShaderPlugin_FillFlatTiles"), PassFlags, ComputeShader, PassParameters, IndirectArgs, sizeof(FRHIDispatchIndirectParameters));
+	}
+}
+
+void FComputeShaderExample::RunComputeShader_RenderThread(FRDGBuilder& GraphBuilder, FIntPoint TextureSize, FIntPoint AmortizeCell, TConstArrayView<FComputeShaderSliceParameters> Slices, FRDGTextureRef ComputeShaderOutput, ERDGPassFlags PassFlags)
 {
 	QUICK_SCOPE_CYCLE_COUNTER(STAT_ShaderPlugin_ComputeShader); // Used to gather CPU profiling data for the UE4 session frontend
-	SCOPED_DRAW_EVENT(RHICmdList, ShaderPlugin_Compute); // Used to profile GPU activity and add metadata to be consumed by for example RenderDoc
 
-//	RHICmdList.TransitionResource(EResourceTransitionAccess::ERWBarrier, EResourceTransitionPipeline::EGfxToCompute, ComputeShaderOutputUAV); // I have no idea to replace this line with.
-	
-	FComputeShaderExampleCS::FParameters PassParameters;
-	PassParameters.OutputTexture = ComputeShaderOutputUAV;
-	PassParameters.TextureSize = FVector2f(DrawParameters.GetRenderTargetSize().X, DrawParameters.GetRenderTargetSize().Y);
-	PassParameters.SimulationState = DrawParameters.SimulationState;
+	FRDGBufferSRVRef SliceParameters = GraphBuilder.CreateSRV(CreateStructuredBuffer(GraphBuilder, TEXT("ShaderPlugin_SliceParameters"), sizeof(FComputeShaderSliceParameters), Slices.Num(), Slices.GetData(), Slices.Num() * sizeof(FComputeShaderSliceParameters)));
+
+	FComputeShaderExampleCS::FPermutationDomain PermutationVector;
+	PermutationVector.Set<FComputeShaderExampleCS::FTypedOutputDim>(ComputeShaderOutput->Desc.Format != PF_R32_UINT);
+	PermutationVector.Set<FComputeShaderExampleCS::FQualityDim>(GetQuality());
+	PermutationVector.Set<FComputeShaderExampleCS::FThreadGroupSizeDim>(GetThreadGroupSize());
+
+	if (CVarShaderPluginTileCulling.GetValueOnRenderThread() != 0)
+	{
+		// The flat tiles are filled from the classification samples, which are always full precision, so folding the live
+		// ones in half precision would only make the seams between the two show. That's one set of permutations less too.
+		AddTileCulledComputePasses(GraphBuilder, TextureSize, AmortizeCell, Slices.Num(), SliceParameters, ComputeShaderOutput, PermutationVector, PassFlags);
+		return;
+	}
+
+	PermutationVector.Set<FComputeShaderExampleCS::FHalfPrecisionDim>(UseHalfPrecision());
 
-	TShaderMapRef<FComputeShaderExampleCS> ComputeShader(GetGlobalShaderMap(GMaxRHIFeatureLevel));
-	FIntVector GroupCounts = FIntVector(FMath::DivideAndRoundUp(DrawParameters.GetRenderTargetSize().X, NUM_THREADS_PER_GROUP_DIMENSION), FMath::DivideAndRoundUp(DrawParameters.GetRenderTargetSize().Y, NUM_THREADS_PER_GROUP_DIMENSION), 1);
+	// The graph owns the parameters until the pass has executed, and uses the RDG resources in them to figure out the barriers for us.
+	FComputeShaderExampleCS::FParameters* PassParameters = GraphBuilder.AllocParameters<FComputeShaderExampleCS::FParameters>();
+	PassParameters->OutputTexture = GraphBuilder.CreateUAV(ComputeShaderOutput);
+	PassParameters->SliceParameters = SliceParameters;
+	PassParameters->TextureSize = FVector2f(TextureSize.X, TextureSize.Y);
+	PassParameters->AmortizeCell = AmortizeCell;
 
-	FComputeShaderUtils::Dispatch(RHICmdList, ComputeShader, PassParameters, GroupCounts);
+	TShaderMapRef<FComputeShaderExampleCS> ComputeShader(GetGlobalShaderMap(GMaxRHIFeatureLevel), PermutationVector);
+
+	// With amortization there is a thread per block of pixels, so every thread is busy rather than most of them idling.
+	const int32 ThreadGroupSize = PermutationVector.Get<FComputeShaderExampleCS::FThreadGroupSizeDim>();
+	const FIntPoint ThreadGridSize(FMath::DivideAndRoundUp(TextureSize.X, AmortizeCell.X), FMath::DivideAndRoundUp(TextureSize.Y, AmortizeCell.Y));
+	FIntVector GroupCounts = FIntVector(FMath::DivideAndRoundUp(ThreadGridSize.X, ThreadGroupSize), FMath::DivideAndRoundUp(ThreadGridSize.Y, ThreadGroupSize), Slices.Num());
+
+	// The event name is used to profile GPU activity and add metadata to be consumed by for example RenderDoc
+	FComputeShaderUtils::AddPass(GraphBuilder, RDG_EVENT_NAME("ShaderPlugin_Compute"), PassFlags, ComputeShader, PassParameters, GroupCounts);
+}
+
+FIntPoint FComputeShaderExample::GetAmortizeCell(int32 AmortizeFactor)
+{
+	if (AmortizeFactor >= 16)
+	{
+		return FIntPoint(4, 4);
+	}
+	if (AmortizeFactor >= 8)
+	{
+		return FIntPoint(4, 2);
+	}
+	if (AmortizeFactor >= 4)
+	{
+		return FIntPoint(2, 2);
+	}
+	return AmortizeFactor >= 2 ? FIntPoint(2, 1) : FIntPoint(1, 1);
+}
+
+uint32 FComputeShaderExample::GetAmortizeOffset(int32 AmortizeFactor, int32 Phase)
+{
+	// A 4x4 Bayer matrix. Taking the pixels of a block in the order of their values here spreads them out as evenly as possible.
+	static const uint8 BayerMatrix[4][4] =
+	{
+		{ 0, 8, 2, 10 },
+		{ 12, 4, 14, 6 },
+		{ 3, 11, 1, 9 },
+		{ 15, 7, 13, 5 },
+	};
+
+	const FIntPoint Cell = GetAmortizeCell(AmortizeFactor);
+	const int32 NumPhases = Cell.X * Cell.Y;
+	Phase = ((Phase % NumPhases) + NumPhases) % NumPhases;
+
+	// The cell is the top left corner of the matrix, so its pixel with the Phase-th lowest value is the one we want.
+	TArray<FIntPoint, TInlineAllocator<16>> Offsets;
+	for (int32 Y = 0; Y < Cell.Y; Y++)
+	{
+		for (int32 X = 0; X < Cell.X; X++)
+		{
+			Offsets.Add(FIntPoint(X, Y));
+		}
+	}
+	Offsets.Sort([](const FIntPoint& A, const FIntPoint& B) { return BayerMatrix[A.Y][A.X] < BayerMatrix[B.Y][B.X]; });
+
+	return (uint32)Offsets[Phase].X | ((uint32)Offsets[Phase].Y << 16);
+}
+
+bool FComputeShaderExample::SupportsFusedComputeShader(FRHITexture* RenderTargetTexture)
+{
+	// The render target must have been created with bCanCreateUAV, and the RHI must be able to store to its format from a compute shader.
+	return RenderTargetTexture
+		&& EnumHasAnyFlags(RenderTargetTexture->GetFlags(), TexCreate_UAV)
+		&& UE::PixelFormat::HasCapabilities(RenderTargetTexture->GetFormat(), EPixelFormatCapabilities::TypedUAVStore);
+}
+
+bool FComputeShaderExample::SupportsOfflineFusedComputeShader(EPixelFormat Format)
+{
+	return !GUsingNullRHI
+		&& GMaxRHIFeatureLevel >= ERHIFeatureLevel::SM5
+		&& UE::PixelFormat::HasCapabilities(Format, EPixelFormatCapabilities::TypedUAVStore);
+}
+
+static void AddFusedComputeShaderPass(FRDGBuilder& GraphBuilder, const FShaderUsageExampleParameters& DrawParameters, FIntPoint ImageSize, FIntPoint TileOffset, int32 Quality, bool bHalfPrecision, bool bOutputSRGB, FRDGTextureRef RenderTargetTexture, ERDGPassFlags PassFlags)
+{
+	QUICK_SCOPE_CYCLE_COUNTER(STAT_ShaderPlugin_FusedComputeShader); // Used to gather CPU profiling data for the UE4 session frontend
+
+	const FIntPoint TileSize = RenderTargetTexture->Desc.Extent;
+
+	FFusedComputeShaderExampleCS::FParameters* PassParameters = GraphBuilder.AllocParameters<FFusedComputeShaderExampleCS::FParameters>();
+	PassParameters->RenderTarget = GraphBuilder.CreateUAV(RenderTargetTexture);
+	PassParameters->StartColor = FVector4f(DrawParameters.StartColor.R, DrawParameters.StartColor.G, DrawParameters.StartColor.B, DrawParameters.StartColor.A) / 255.0f;
+	PassParameters->EndColor = FVector4f(DrawParameters.EndColor.R, DrawParameters.EndColor.G, DrawParameters.EndColor.B, DrawParameters.EndColor.A) / 255.0f;
+	PassParameters->TextureSize = FVector2f(ImageSize.X, ImageSize.Y);
+	PassParameters->TileOffset = TileOffset;
+	PassParameters->TileSize = TileSize;
+	PassParameters->SimulationState = DrawParameters.SimulationState;
+	PassParameters->BlendFactor = DrawParameters.ComputeShaderBlend;
+	PassParameters->OutputSRGB = bOutputSRGB ? 1 : 0;
+
+	FFusedComputeShaderExampleCS::FPermutationDomain PermutationVector;
+	PermutationVector.Set<FFusedComputeShaderExampleCS::FQualityDim>(Quality);
+	PermutationVector.Set<FFusedComputeShaderExampleCS::FThreadGroupSizeDim>(GetThreadGroupSize());
+	PermutationVector.Set<FFusedComputeShaderExampleCS::FHalfPrecisionDim>(bHalfPrecision);
+	TShaderMapRef<FFusedComputeShaderExampleCS> ComputeShader(GetGlobalShaderMap(GMaxRHIFeatureLevel), PermutationVector);
+
+	const int32 ThreadGroupSize = PermutationVector.Get<FFusedComputeShaderExampleCS::FThreadGroupSizeDim>();
+	FIntVector GroupCounts = FIntVector(FMath::DivideAndRoundUp(TileSize.X, ThreadGroupSize), FMath::DivideAndRoundUp(TileSize.Y, ThreadGroupSize), 1);
+
+	// The event name is used to profile GPU activity and add metadata to be consumed by for example RenderDoc
+	FComputeShaderUtils::AddPass(GraphBuilder, RDG_EVENT_NAME("ShaderPlugin_FusedCompute %dx%d", TileSize.X, TileSize.Y), PassFlags, ComputeShader, PassParameters, GroupCounts);
+}
+
+void FComputeShaderExample::RunFusedComputeShader_RenderThread(FRDGBuilder& GraphBuilder, const FShaderUsageExampleParameters& DrawParameters, FRDGTextureRef RenderTargetTexture, ERDGPassFlags PassFlags)
+{
+	const bool bOutputSRGB = EnumHasAnyFlags(RenderTargetTexture->Desc.Flags, TexCreate_SRGB);
+	AddFusedComputeShaderPass(GraphBuilder, DrawParameters, RenderTargetTexture->Desc.Extent, FIntPoint::ZeroValue, GetQuality(), UseHalfPrecision(), bOutputSRGB, RenderTargetTexture, PassFlags);
+}
+
+void FComputeShaderExample::RunFusedComputeShaderTile_RenderThread(FRDGBuilder& GraphBuilder, const FShaderUsageExampleParameters& DrawParameters, FIntPoint ImageSize, FIntPoint TileOffset, bool bOutputSRGB, FRDGTextureRef TileTexture)
+{
+	const int32 Quality = FMath::Clamp(CVarShaderPluginQuality.GetValueOnRenderThread(), 0, 3);
+	// Always full precision, so posters and flipbooks match the CPU fallback and don't change with r.ShaderPlugin.HalfPrecision.
+	AddFusedComputeShaderPass(GraphBuilder, DrawParameters, ImageSize, TileOffset, Quality, false, bOutputSRGB, TileTexture, ERDGPassFlags::Compute);
+}
+
+void FComputeShaderExample::RunFusedComputeShaderWithPrecision_RenderThread(FRDGBuilder& GraphBuilder, const FShaderUsageExampleParameters& DrawParameters, bool bHalfPrecision, FRDGTextureRef OutputTexture)
+{
+	const int32 Quality = FMath::Clamp(CVarShaderPluginQuality.GetValueOnRenderThread(), 0, 3);
+	AddFusedComputeShaderPass(GraphBuilder, DrawParameters, OutputTexture->Desc.Extent, FIntPoint::ZeroValue, Quality, bHalfPrecision, false, OutputTexture, ERDGPassFlags::Compute);
 }
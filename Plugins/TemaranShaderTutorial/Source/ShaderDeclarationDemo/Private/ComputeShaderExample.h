@@ -7,11 +7,60 @@
 #include "CoreMinimal.h"
 #include "ShaderDeclarationDemoModule.h"
 
+// The parameters that differ between the instances of a batch. This must match FSliceParameters in ComputeShader.usf.
+struct FComputeShaderSliceParameters
+{
+	float SimulationState;
+	uint32 SliceIndex; // The slice of the output texture array the instance is written to.
+	uint32 AmortizeOffset = 0; // See FComputeShaderExample::GetAmortizeOffset.
+};
+
 /**************************************************************************************/
 /* This is just an interface we use to keep all the compute shading code in one file. */
 /**************************************************************************************/
 class FComputeShaderExample
 {
 public:
-	static void RunComputeShader_RenderThread(FRHICommandListImmediate& RHICmdList, const FShaderUsageExampleParameters& DrawParameters, FUnorderedAccessViewRHIRef ComputeShaderOutputUAV);
+	// Computes all slices of a batch in one dispatch, writing each to its SliceIndex of the ComputeShaderOutput texture array.
+	// Slices that aren't part of the batch are left untouched. PassFlags should be either ERDGPassFlags::Compute or ERDGPassFlags::AsyncCompute.
+	// Only one pixel of every AmortizeCell sized block is computed, the one at each slice's AmortizeOffset. Pass 1x1 to compute them all.
+	static void RunComputeShader_RenderThread(FRDGBuilder& GraphBuilder, FIntPoint TextureSize, FIntPoint AmortizeCell, TConstArrayView<FComputeShaderSliceParameters> Slices, FRDGTextureRef ComputeShaderOutput, ERDGPassFlags PassFlags);
+
+	// Spreading the evaluation over AmortizeFactor frames means computing one pixel out of blocks of this size every frame.
+	// The factor is rounded down to a power of two, up to 16.
+	static FIntPoint GetAmortizeCell(int32 AmortizeFactor);
+
+	// The pixel of the block to compute for the given phase, packed for FComputeShaderSliceParameters. Consecutive phases are spread
+	// out over the block like an ordered dither, so a partly converged image has its fresh pixels evenly spread.
+	static uint32 GetAmortizeOffset(int32 AmortizeFactor, int32 Phase);
+
+	// The quality tier the compute passes run at this frame. r.ShaderPlugin.Quality is the highest one, but the budget controller may pick a lower one.
+	static int32 GetQuality();
+
+	// Whether this platform has the half precision permutations at all. Without them r.ShaderPlugin.HalfPrecision does nothing.
+	static bool SupportsHalfPrecision();
+
+	// Whether the compute passes fold the fractal in 16 bit floats this frame. See r.ShaderPlugin.HalfPrecision.
+	static bool UseHalfPrecision();
+
+	// Whether RunFusedComputeShader_RenderThread can write to this render target.
+	static bool SupportsFusedComputeShader(FRHITexture* RenderTargetTexture);
+
+	// Whether the offline tools (posters, flipbooks and the half precision report) can run the fused compute shader into
+	// transient textures of Format. Without it they fall back to the CPU, or don't run at all.
+	static bool SupportsOfflineFusedComputeShader(EPixelFormat Format);
+
+	// Evaluates the fractal and the color blend in a single compute pass that writes straight to RenderTargetTexture.
+	// This needs no intermediate and no raster pass, but recomputes the fractal whenever anything about the instance changes.
+	static void RunFusedComputeShader_RenderThread(FRDGBuilder& GraphBuilder, const FShaderUsageExampleParameters& DrawParameters, FRDGTextureRef RenderTargetTexture, ERDGPassFlags PassFlags);
+
+	// Same as above, but TileTexture only holds the part of an ImageSize sized image that starts at TileOffset. Used for images
+	// too large to fit in a single texture. This always runs at the r.ShaderPlugin.Quality tier, whatever the GPU budget says,
+	// and always in full precision, whatever r.ShaderPlugin.HalfPrecision says.
+	static void RunFusedComputeShaderTile_RenderThread(FRDGBuilder& GraphBuilder, const FShaderUsageExampleParameters& DrawParameters, FIntPoint ImageSize, FIntPoint TileOffset, bool bOutputSRGB, FRDGTextureRef TileTexture);
+
+	// Evaluates the effect in linear color with the fractal folded in 16 or 32 bit floats, regardless of r.ShaderPlugin.HalfPrecision.
+	// Used to measure the error of the half precision permutation, so OutputTexture should be a float format. Only ask for
+	// half precision where SupportsHalfPrecision says so.
+	static void RunFusedComputeShaderWithPrecision_RenderThread(FRDGBuilder& GraphBuilder, const FShaderUsageExampleParameters& DrawParameters, bool bHalfPrecision, FRDGTextureRef OutputTexture);
 };
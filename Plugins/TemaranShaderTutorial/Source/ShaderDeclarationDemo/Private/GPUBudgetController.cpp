@@ -0,0 +1,256 @@
+// Copyright 2016-2020 Cadic AB. All Rights Reserved.
+// @Author	Fredrik Lindh [Temaran] (temaran@gmail.com) {https://github.com/Temaran}
+///////////////////////////////////////////////////////////////////////////////////////
+
+#include "GPUBudgetController.h"
+#include "RHI.h"
+#include "RHICommandList.h"
+#include "RenderGraphBuilder.h"
+#include "HAL/IConsoleManager.h"
+
+// How many frames of timestamps can be in flight. The GPU is usually one or two frames behind, so this leaves some slack.
+#define NUM_PENDING_MEASUREMENTS 4
+
+static TAutoConsoleVariable<float> CVarShaderPluginGPUBudget(
+	TEXT("r.ShaderPlugin.GPUBudget"),
+	0.0f,
+	TEXT("How many milliseconds of GPU time the shader plugin may spend per frame, for example 0.5.\n")
+	TEXT("When it goes over, the fractal is computed at a lower resolution and quality tier until it fits.\n")
+	TEXT(" 0: No budget. Always compute at the full resolution and r.ShaderPlugin.Quality (default)"),
+	ECVF_RenderThreadSafe);
+
+static TAutoConsoleVariable<float> CVarShaderPluginGPUBudgetHeadroom(
+	TEXT("r.ShaderPlugin.GPUBudget.Headroom"),
+	0.8f,
+	TEXT("We only step the quality back up when the next step is predicted to fit within this fraction of the budget.\n")
+	TEXT("Lower values flicker less between steps, but settle for lower quality."),
+	ECVF_RenderThreadSafe);
+
+static TAutoConsoleVariable<int32> CVarShaderPluginGPUBudgetSettleFrames(
+	TEXT("r.ShaderPlugin.GPUBudget.SettleFrames"),
+	30,
+	TEXT("How many measured frames to wait after changing the quality before changing it again."),
+	ECVF_RenderThreadSafe);
+
+namespace
+{
+	// Each step gives up a little more quality than the one before, alternating between the resolution and the iteration tier.
+	struct FBudgetStep
+	{
+		int32 QualityDrop;
+		float ResolutionScale;
+	};
+
+	const FBudgetStep BudgetSteps[] =
+	{
+		{ 0, 1.0f },
+		{ 0, 0.75f },
+		{ 1, 0.75f },
+		{ 1, 0.5f },
+		{ 2, 0.5f },
+		{ 2, 0.35f },
+		{ 3, 0.35f },
+		{ 3, 0.25f },
+	};
+
+	// Roughly what each quality tier costs per pixel, from the iteration counts in Fractal.ush.
+	const float QualityCosts[] = { 30.0f * 6.0f, 60.0f * 8.0f, 90.0f * 8.0f, 180.0f * 8.0f };
+
+	struct FPendingMeasurement
+	{
+		FRHIPooledRenderQuery BeginQuery;
+		FRHIPooledRenderQuery EndQuery;
+		bool bHasComputeWork = false;
+	};
+
+	struct FBudgetState
+	{
+		FRenderQueryPoolRHIRef QueryPool;
+		FPendingMeasurement Measurements[NUM_PENDING_MEASUREMENTS];
+		int32 NextMeasurement = 0;
+		FPendingMeasurement* CurrentMeasurement = nullptr;
+
+		int32 StepIndex = 0;
+		int32 MaxQuality = 2;
+		float SmoothedTime = 0.0f;
+		bool bHasSmoothedTime = false;
+		int32 FramesSinceStepChange = 0;
+	};
+
+	FBudgetState GBudgetState;
+
+	float GetStepCost(int32 StepIndex)
+	{
+		const FBudgetStep& Step = BudgetSteps[StepIndex];
+		const int32 Quality = FMath::Clamp(GBudgetState.MaxQuality - Step.QualityDrop, 0, (int32)UE_ARRAY_COUNT(QualityCosts) - 1);
+		return QualityCosts[Quality] * Step.ResolutionScale * Step.ResolutionScale;
+	}
+
+	void SetStep(int32 NewStepIndex)
+	{
+		// Assume the time scales with the cost until we've measured the new step, so the next decision isn't made on stale data.
+		GBudgetState.SmoothedTime *= GetStepCost(NewStepIndex) / GetStepCost(GBudgetState.StepIndex);
+		GBudgetState.StepIndex = NewStepIndex;
+		GBudgetState.FramesSinceStepChange = 0;
+	}
+
+	void AddSample(float GPUTime)
+	{
+		// Single frames can be noisy, so we make our decisions on a running average.
+		GBudgetState.SmoothedTime = GBudgetState.bHasSmoothedTime ? FMath::Lerp(GBudgetState.SmoothedTime, GPUTime, 0.1f) : GPUTime;
+		GBudgetState.bHasSmoothedTime = true;
+		GBudgetState.FramesSinceStepChange++;
+
+		const float Budget = CVarShaderPluginGPUBudget.GetValueOnRenderThread();
+		if (Budget <= 0.0f)
+		{
+			GBudgetState.StepIndex = 0;
+			return;
+		}
+
+		if (GBudgetState.FramesSinceStepChange < CVarShaderPluginGPUBudgetSettleFrames.GetValueOnRenderThread())
+		{
+			return;
+		}
+
+		// Going down happens as soon as we're over, but going up needs the predicted time to fit with some headroom.
+		// The gap between the two is what keeps us from flipping back and forth between two steps.
+		if (GBudgetState.SmoothedTime > Budget)
+		{
+			if (GBudgetState.StepIndex < (int32)UE_ARRAY_COUNT(BudgetSteps) - 1)
+			{
+				SetStep(GBudgetState.StepIndex + 1);
+			}
+		}
+		else if (GBudgetState.StepIndex > 0)
+		{
+			const float PredictedTime = GBudgetState.SmoothedTime * GetStepCost(GBudgetState.StepIndex - 1) / GetStepCost(GBudgetState.StepIndex);
+			if (PredictedTime < Budget * CVarShaderPluginGPUBudgetHeadroom.GetValueOnRenderThread())
+			{
+				SetStep(GBudgetState.StepIndex - 1);
+			}
+		}
+	}
+
+	void AddTimestampPass(FRDGBuilder& GraphBuilder, FRHIRenderQuery* Query)
+	{
+		// Timestamps are taken on the graphics pipe, so with async compute they include the wait for the compute work to finish.
+		GraphBuilder.AddPass(RDG_EVENT_NAME("ShaderPlugin_Timestamp"), ERDGPassFlags::NeverCull, [Query](FRHICommandListImmediate& RHICmdList)
+		{
+			RHICmdList.EndRenderQuery(Query);
+		});
+	}
+}
+
+void FGPUBudgetController::BeginMeasurement_RenderThread(FRDGBuilder& GraphBuilder)
+{
+	check(IsInRenderingThread());
+
+	GBudgetState.CurrentMeasurement = nullptr;
+	if (CVarShaderPluginGPUBudget.GetValueOnRenderThread() <= 0.0f || GUsingNullRHI)
+	{
+		return;
+	}
+
+	if (!GBudgetState.QueryPool.IsValid())
+	{
+		GBudgetState.QueryPool = RHICreateRenderQueryPool(RQT_AbsoluteTime);
+	}
+
+	// If the GPU is so far behind that the slot is still in use, we skip measuring this frame.
+	FPendingMeasurement& Measurement = GBudgetState.Measurements[GBudgetState.NextMeasurement];
+	if (Measurement.BeginQuery.IsValid())
+	{
+		return;
+	}
+
+	Measurement.BeginQuery = GBudgetState.QueryPool->AllocateQuery();
+	Measurement.EndQuery = GBudgetState.QueryPool->AllocateQuery();
+	AddTimestampPass(GraphBuilder, Measurement.BeginQuery.GetQuery());
+
+	GBudgetState.CurrentMeasurement = &Measurement;
+	GBudgetState.NextMeasurement = (GBudgetState.NextMeasurement + 1) % NUM_PENDING_MEASUREMENTS;
+}
+
+void FGPUBudgetController::EndMeasurement_RenderThread(FRDGBuilder& GraphBuilder, bool bHasComputeWork)
+{
+	check(IsInRenderingThread());
+
+	if (FPendingMeasurement* Measurement = GBudgetState.CurrentMeasurement)
+	{
+		AddTimestampPass(GraphBuilder, Measurement->EndQuery.GetQuery());
+		Measurement->bHasComputeWork = bHasComputeWork;
+		GBudgetState.CurrentMeasurement = nullptr;
+	}
+}
+
+void FGPUBudgetController::Update_RenderThread()
+{
+	check(IsInRenderingThread());
+
+	// Oldest first, so the samples reach the running average in the order they were rendered.
+	for (int32 Offset = 0; Offset < NUM_PENDING_MEASUREMENTS; Offset++)
+	{
+		FPendingMeasurement& Measurement = GBudgetState.Measurements[(GBudgetState.NextMeasurement + Offset) % NUM_PENDING_MEASUREMENTS];
+		if (!Measurement.BeginQuery.IsValid())
+		{
+			continue;
+		}
+
+		// We never wait for the GPU here. If the results aren't in yet, we'll look again next frame.
+		uint64 BeginTime = 0;
+		uint64 EndTime = 0;
+		if (!RHIGetRenderQueryResult(Measurement.BeginQuery.GetQuery(), BeginTime, false) || !RHIGetRenderQueryResult(Measurement.EndQuery.GetQuery(), EndTime, false))
+		{
+			continue;
+		}
+
+		// Timestamp queries are resolved to microseconds.
+		if (Measurement.bHasComputeWork && EndTime >= BeginTime)
+		{
+			AddSample((EndTime - BeginTime) / 1000.0f);
+		}
+
+		Measurement.BeginQuery.ReleaseQuery();
+		Measurement.EndQuery.ReleaseQuery();
+	}
+
+	if (CVarShaderPluginGPUBudget.GetValueOnRenderThread() <= 0.0f)
+	{
+		GBudgetState.StepIndex = 0;
+	}
+}
+
+float FGPUBudgetController::GetResolutionScale()
+{
+	return BudgetSteps[GBudgetState.StepIndex].ResolutionScale;
+}
+
+int32 FGPUBudgetController::GetQuality(int32 MaxQuality)
+{
+	GBudgetState.MaxQuality = MaxQuality;
+	return FMath::Max(MaxQuality - BudgetSteps[GBudgetState.StepIndex].QualityDrop, 0);
+}
+
+float FGPUBudgetController::GetMeasuredGPUTime()
+{
+	return GBudgetState.SmoothedTime;
+}
+
+void FGPUBudgetController::Reset_RenderThread()
+{
+	check(IsInRenderingThread());
+
+	for (FPendingMeasurement& Measurement : GBudgetState.Measurements)
+	{
+		Measurement.BeginQuery.ReleaseQuery();
+		Measurement.EndQuery.ReleaseQuery();
+	}
+
+	GBudgetState.QueryPool.SafeRelease();
+	GBudgetState.CurrentMeasurement = nullptr;
+	GBudgetState.StepIndex = 0;
+	GBudgetState.SmoothedTime = 0.0f;
+	GBudgetState.bHasSmoothedTime = false;
+	GBudgetState.FramesSinceStepChange = 0;
+}
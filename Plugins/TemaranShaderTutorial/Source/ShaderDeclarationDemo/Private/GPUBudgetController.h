@@ -0,0 +1,37 @@
+// Copyright 2016-2020 Cadic AB. All Rights Reserved.
+// @Author	Fredrik Lindh [Temaran] (temaran@gmail.com) {https://github.com/Temaran}
+///////////////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "RenderGraphDefinitions.h"
+
+/**************************************************************************************/
+/* Keeps the GPU time of the effect under r.ShaderPlugin.GPUBudget by lowering the    */
+/* compute resolution and quality tier when we go over, and raising them again when   */
+/* there is room. Everything here is render thread only.                              */
+/**************************************************************************************/
+class FGPUBudgetController
+{
+public:
+	// Put these around the passes of the effect to time them with GPU timestamps. bHasComputeWork tells whether the frame
+	// ran any compute passes. Frames that only redraw a gradient are much cheaper and would make us think we have room to spare.
+	static void BeginMeasurement_RenderThread(FRDGBuilder& GraphBuilder);
+	static void EndMeasurement_RenderThread(FRDGBuilder& GraphBuilder, bool bHasComputeWork);
+
+	// Picks up the timings of earlier frames the GPU has finished, and steps the quality up or down if needed.
+	static void Update_RenderThread();
+
+	// The fraction of the render target size the fractal should be computed at.
+	static float GetResolutionScale();
+
+	// The quality tier to use, given the highest one allowed by r.ShaderPlugin.Quality.
+	static int32 GetQuality(int32 MaxQuality);
+
+	// The smoothed GPU time of the effect in milliseconds, as last measured.
+	static float GetMeasuredGPUTime();
+
+	// Goes back to full quality and releases the timestamp queries.
+	static void Reset_RenderThread();
+};
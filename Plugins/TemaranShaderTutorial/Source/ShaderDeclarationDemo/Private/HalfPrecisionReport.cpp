@@ -0,0 +1,181 @@
+// Copyright 2016-2020 Cadic AB. All Rights Reserved.
+// @Author	Fredrik Lindh [Temaran] (temaran@gmail.com) {https://github.com/Temaran}
+///////////////////////////////////////////////////////////////////////////////////////
+
+#include "ComputeShaderExample.h"
+#include "OfflineReadbackPipeline.h"
+#include "ShaderDeclarationDemoModule.h"
+
+#include "Dom/JsonObject.h"
+#include "HAL/IConsoleManager.h"
+#include "Misc/FileHelper.h"
+#include "Misc/Paths.h"
+#include "RenderGraphBuilder.h"
+#include "Serialization/JsonSerializer.h"
+#include "Serialization/JsonWriter.h"
+
+DEFINE_LOG_CATEGORY_STATIC(LogShaderPluginHalfPrecision, Log, All);
+
+// How many images the GPU may work on ahead of the one we're comparing.
+#define NUM_GPU_IMAGES_IN_FLIGHT 3
+
+/**************************************************************************************/
+/* Renders a set of reference frames with the fractal folded in 32 and in 16 bit       */
+/* floats, and reports how far apart they are per channel. Whether that is acceptable  */
+/* depends on the platform, since some GPUs do min16float math in 32 bits anyway, so   */
+/* run this on the hardware you're deciding for before turning on                      */
+/* r.ShaderPlugin.HalfPrecision there.                                                 */
+/**************************************************************************************/
+namespace
+{
+	struct FChannelError
+	{
+		double MaxError = 0.0;
+		double SumError = 0.0;
+
+		// The same, after both have been gamma encoded to 8 bits like they would be on screen.
+		int32 MaxError8Bit = 0;
+		int64 NumPixelsOff8Bit = 0;
+	};
+
+	void AddErrors(const TArray<FLinearColor>& FullPixels, const TArray<FLinearColor>& HalfPixels, FChannelError (&Errors)[3])
+	{
+		for (int32 PixelIndex = 0; PixelIndex < FullPixels.Num(); PixelIndex++)
+		{
+			const FLinearColor& Full = FullPixels[PixelIndex];
+			const FLinearColor& Half = HalfPixels[PixelIndex];
+			const FColor Full8Bit = Full.ToFColor(true);
+			const FColor Half8Bit = Half.ToFColor(true);
+
+			const double Deltas[3] = { FMath::Abs(Full.R - Half.R), FMath::Abs(Full.G - Half.G), FMath::Abs(Full.B - Half.B) };
+			const int32 Deltas8Bit[3] = { FMath::Abs(Full8Bit.R - Half8Bit.R), FMath::Abs(Full8Bit.G - Half8Bit.G), FMath::Abs(Full8Bit.B - Half8Bit.B) };
+			for (int32 Channel = 0; Channel < 3; Channel++)
+			{
+				Errors[Channel].MaxError = FMath::Max(Errors[Channel].MaxError, Deltas[Channel]);
+				Errors[Channel].SumError += Deltas[Channel];
+				Errors[Channel].MaxError8Bit = FMath::Max(Errors[Channel].MaxError8Bit, Deltas8Bit[Channel]);
+				Errors[Channel].NumPixelsOff8Bit += Deltas8Bit[Channel] > 0 ? 1 : 0;
+			}
+		}
+	}
+
+	// Renders every frame at full and then half precision, reads them back as linear colors and adds up how far apart they
+	// are. Blocks until the GPU is done. Returns how many pixels were compared.
+	int64 MeasureErrors(int32 NumFrames, FIntPoint Size, EPixelFormat Format, FChannelError (&OutErrors)[3])
+	{
+		TArray<FLinearColor> FullPixels;
+		int64 NumPixels = 0;
+		FOfflineReadbackPipeline::Run(NumFrames * 2, NUM_GPU_IMAGES_IN_FLIGHT,
+			[Size, Format](FRDGBuilder& GraphBuilder, int32 ImageIndex)
+			{
+				// Only the fractal, at moments spread out over a couple of minutes of the demo.
+				FShaderUsageExampleParameters Parameters(nullptr);
+				Parameters.ComputeShaderBlend = 1.0f;
+				Parameters.SimulationState = (ImageIndex / 2) * 15.0f;
+
+				const FRDGTextureDesc Desc = FRDGTextureDesc::Create2D(Size, Format, FClearValueBinding::None, TexCreate_ShaderResource | TexCreate_UAV);
+				FRDGTextureRef Texture = GraphBuilder.CreateTexture(Desc, TEXT("ShaderPlugin_HalfPrecisionReport"));
+				FComputeShaderExample::RunFusedComputeShaderWithPrecision_RenderThread(GraphBuilder, Parameters, ImageIndex % 2 == 1, Texture);
+				return Texture;
+			},
+			[&FullPixels, &NumPixels, &OutErrors, Size, Format](int32 ImageIndex, const void* Data, int32 RowPitchInPixels)
+			{
+				TArray<FLinearColor> Pixels;
+				Pixels.SetNumZeroed(Size.X * Size.Y);
+				for (int32 Y = 0; Y < Size.Y && Data; Y++)
+				{
+					const uint8* Row = (const uint8*)Data + (int64)Y * RowPitchInPixels * GPixelFormats[Format].BlockBytes;
+					for (int32 X = 0; X < Size.X; X++)
+					{
+						Pixels[Y * Size.X + X] = Format == PF_A32B32G32R32F ? ((const FLinearColor*)Row)[X] : FLinearColor(((const FFloat16Color*)Row)[X]);
+					}
+				}
+
+				// The images come back in order, so the full precision one of a frame is always right before its half.
+				if (ImageIndex % 2 == 0)
+				{
+					FullPixels = MoveTemp(Pixels);
+				}
+				else
+				{
+					AddErrors(FullPixels, Pixels, OutErrors);
+					NumPixels += Pixels.Num();
+				}
+			});
+
+		return NumPixels;
+	}
+}
+
+static FAutoConsoleCommand CmdShaderPluginHalfPrecisionReport(
+	TEXT("r.ShaderPlugin.HalfPrecision.Report"),
+	TEXT("Measures how far the half precision fractal is from the full precision one on this GPU, over a set of reference frames.\n")
+	TEXT("Usage: r.ShaderPlugin.HalfPrecision.Report [Size=512] [Frames=8] [File=Saved/Benchmarks/ShaderPluginHalfPrecision.json]"),
+	FConsoleCommandWithArgsDelegate::CreateLambda([](const TArray<FString>& Args)
+	{
+		if (!FComputeShaderExample::SupportsOfflineFusedComputeShader(PF_FloatRGBA))
+		{
+			UE_LOG(LogShaderPluginHalfPrecision, Warning, TEXT("The half precision report needs a GPU that can run the compute shaders."));
+			return;
+		}
+
+		if (!FComputeShaderExample::SupportsHalfPrecision())
+		{
+			UE_LOG(LogShaderPluginHalfPrecision, Warning, TEXT("This platform has no 16 bit float math, so r.ShaderPlugin.HalfPrecision has nothing to report."));
+			return;
+		}
+
+		const FString Params = FString::Join(Args, TEXT(" "));
+		int32 Size = 512;
+		int32 NumFrames = 8;
+		FString Filename = FPaths::Combine(FPaths::ProjectSavedDir(), TEXT("Benchmarks"), TEXT("ShaderPluginHalfPrecision.json"));
+		FParse::Value(*Params, TEXT("Size="), Size);
+		FParse::Value(*Params, TEXT("Frames="), NumFrames);
+		FParse::Value(*Params, TEXT("File="), Filename);
+		Size = FMath::Max(Size, 16);
+		NumFrames = FMath::Max(NumFrames, 1);
+
+		// 32 bit output, so what we measure is the folding and not the storage. Half floats would add errors of their own.
+		const EPixelFormat Format = UE::PixelFormat::HasCapabilities(PF_A32B32G32R32F, EPixelFormatCapabilities::TypedUAVStore) ? PF_A32B32G32R32F : PF_FloatRGBA;
+
+		FChannelError Errors[3];
+		const int64 NumPixels = MeasureErrors(NumFrames, FIntPoint(Size, Size), Format, Errors);
+
+		const TCHAR* ChannelNames[3] = { TEXT("R"), TEXT("G"), TEXT("B") };
+		TSharedRef<FJsonObject> Report = MakeShared<FJsonObject>();
+		Report->SetStringField(TEXT("RHI"), GDynamicRHI ? GDynamicRHI->GetName() : TEXT("None"));
+		Report->SetStringField(TEXT("Adapter"), GRHIAdapterName);
+		Report->SetStringField(TEXT("Platform"), FPlatformProperties::IniPlatformName());
+		Report->SetNumberField(TEXT("Quality"), IConsoleManager::Get().FindConsoleVariable(TEXT("r.ShaderPlugin.Quality"))->GetInt());
+		Report->SetNumberField(TEXT("Size"), Size);
+		Report->SetNumberField(TEXT("Frames"), NumFrames);
+
+		UE_LOG(LogShaderPluginHalfPrecision, Display, TEXT("Half against full precision, %d frames of %dx%d on %s:"), NumFrames, Size, Size, *GRHIAdapterName);
+		for (int32 Channel = 0; Channel < 3; Channel++)
+		{
+			const FChannelError& Error = Errors[Channel];
+			const double MeanError = NumPixels > 0 ? Error.SumError / NumPixels : 0.0;
+			const double PercentOff8Bit = NumPixels > 0 ? 100.0 * Error.NumPixelsOff8Bit / NumPixels : 0.0;
+			UE_LOG(LogShaderPluginHalfPrecision, Display, TEXT("  %s: max %.5f, mean %.6f, max 8 bit %d, %.2f%% of pixels off in 8 bit"),
+				ChannelNames[Channel], Error.MaxError, MeanError, Error.MaxError8Bit, PercentOff8Bit);
+
+			TSharedRef<FJsonObject> ChannelObject = MakeShared<FJsonObject>();
+			ChannelObject->SetNumberField(TEXT("MaxError"), Error.MaxError);
+			ChannelObject->SetNumberField(TEXT("MeanError"), MeanError);
+			ChannelObject->SetNumberField(TEXT("MaxError8Bit"), Error.MaxError8Bit);
+			ChannelObject->SetNumberField(TEXT("PercentPixelsOff8Bit"), PercentOff8Bit);
+			Report->SetObjectField(ChannelNames[Channel], ChannelObject);
+		}
+
+		FString Json;
+		TSharedRef<TJsonWriter<>> Writer = TJsonWriterFactory<>::Create(&Json);
+		FJsonSerializer::Serialize(Report, Writer);
+		if (FFileHelper::SaveStringToFile(Json, *Filename))
+		{
+			UE_LOG(LogShaderPluginHalfPrecision, Display, TEXT("Wrote the report to %s."), *Filename);
+		}
+		else
+		{
+			UE_LOG(LogShaderPluginHalfPrecision, Error, TEXT("Failed to write the report to %s."), *Filename);
+		}
+	}));
@@ -0,0 +1,101 @@
+// Copyright 2016-2020 Cadic AB. All Rights Reserved.
+// @Author	Fredrik Lindh [Temaran] (temaran@gmail.com) {https://github.com/Temaran}
+///////////////////////////////////////////////////////////////////////////////////////
+
+#include "MipChainGenerator.h"
+#include "GlobalShader.h"
+#include "RenderGraphBuilder.h"
+#include "RenderGraphUtils.h"
+#include "ShaderParameterStruct.h"
+
+// The shader writes at most this many mips below its source mip, which is two groupshared reductions of six mips each.
+// The second reduction only fits in the one group that does it when the first leaves a mip of a single tile.
+static constexpr int32 MaxGeneratedMips = 12;
+static constexpr int32 MipsPerTile = 6;
+static constexpr int32 MipTileSize = 64;
+
+/**********************************************************************************************/
+/* This class carries our parameter declarations and acts as the bridge between cpp and HLSL. */
+/**********************************************************************************************/
+class FGenerateMipsCS : public FGlobalShader
+{
+public:
+	DECLARE_GLOBAL_SHADER(FGenerateMipsCS);
+	SHADER_USE_PARAMETER_STRUCT(FGenerateMipsCS, FGlobalShader);
+
+	// How many mips to write. Only that many UAVs are bound, and the second reduction is compiled out when it isn't needed.
+	class FNumMipsDim : SHADER_PERMUTATION_RANGE_INT("NUM_MIPS", 1, MaxGeneratedMips);
+	using FPermutationDomain = TShaderPermutationDomain<FNumMipsDim>;
+
+	BEGIN_SHADER_PARAMETER_STRUCT(FParameters, )
+		SHADER_PARAMETER_RDG_TEXTURE_SRV(Texture2D<float4>, SourceMip)
+		SHADER_PARAMETER_RDG_TEXTURE_UAV_ARRAY(RWTexture2D<float4>, OutMip, [MaxGeneratedMips])
+		SHADER_PARAMETER_RDG_BUFFER_UAV(RWBuffer<uint>, RWGroupCounter)
+		SHADER_PARAMETER(FUintVector2, SourceSize)
+		SHADER_PARAMETER(uint32, NumGroups)
+	END_SHADER_PARAMETER_STRUCT()
+
+public:
+	static bool ShouldCompilePermutation(const FGlobalShaderPermutationParameters& Parameters)
+	{
+		return IsFeatureLevelSupported(Parameters.Platform, ERHIFeatureLevel::SM5);
+	}
+};
+
+IMPLEMENT_GLOBAL_SHADER(FGenerateMipsCS, "/TutorialShaders/Private/GenerateMips.usf", "MainGenerateMipsCS", SF_Compute);
+
+bool FMipChainGenerator::SupportsMipGeneration(FRHITexture* RenderTargetTexture)
+{
+	return RenderTargetTexture
+		&& RenderTargetTexture->GetNumMips() > 1
+		&& EnumHasAnyFlags(RenderTargetTexture->GetFlags(), TexCreate_UAV)
+		&& UE::PixelFormat::HasCapabilities(RenderTargetTexture->GetFormat(), EPixelFormatCapabilities::TypedUAVStore);
+}
+
+void FMipChainGenerator::GenerateMips_RenderThread(FRDGBuilder& GraphBuilder, FRDGTextureRef Texture)
+{
+	QUICK_SCOPE_CYCLE_COUNTER(STAT_ShaderPlugin_GenerateMips); // Used to gather CPU profiling data for the UE4 session frontend
+
+	// The second reduction reads back the mip the first one wrote through its UAV, which not every format can do.
+	const bool bCanReduceTwice = UE::PixelFormat::HasCapabilities(Texture->Desc.Format, EPixelFormatCapabilities::TypedUAVLoad);
+
+	// Usually this is a single dispatch. Targets larger than 4096, or in a format we can only reduce once per dispatch, take
+	// a few more, each starting from the last mip the one before wrote.
+	int32 SourceMip = 0;
+	while (SourceMip < Texture->Desc.NumMips - 1)
+	{
+		const FIntPoint SourceSize(FMath::Max(Texture->Desc.Extent.X >> SourceMip, 1), FMath::Max(Texture->Desc.Extent.Y >> SourceMip, 1));
+		const bool bSingleTileAfterFirstReduction = SourceSize.GetMax() <= (MipTileSize << MipsPerTile);
+		const int32 NumMips = FMath::Min<int32>(Texture->Desc.NumMips - 1 - SourceMip, bCanReduceTwice && bSingleTileAfterFirstReduction ? MaxGeneratedMips : MipsPerTile);
+
+		AddGenerateMipsPass(GraphBuilder, Texture, SourceMip, SourceSize, NumMips);
+		SourceMip += NumMips;
+	}
+}
+
+void FMipChainGenerator::AddGenerateMipsPass(FRDGBuilder& GraphBuilder, FRDGTextureRef Texture, int32 SourceMip, FIntPoint SourceSize, int32 NumMips)
+{
+	FGenerateMipsCS::FPermutationDomain PermutationVector;
+	PermutationVector.Set<FGenerateMipsCS::FNumMipsDim>(NumMips);
+	TShaderMapRef<FGenerateMipsCS> ComputeShader(GetGlobalShaderMap(GMaxRHIFeatureLevel), PermutationVector);
+
+	// One group for every 64x64 tile of the source mip. The last one of them to finish also does the mips below the sixth.
+	const FIntPoint GroupCount(FMath::DivideAndRoundUp(SourceSize.X, MipTileSize), FMath::DivideAndRoundUp(SourceSize.Y, MipTileSize));
+
+	FRDGBufferRef GroupCounter = GraphBuilder.CreateBuffer(FRDGBufferDesc::CreateBufferDesc(sizeof(uint32), 1), TEXT("ShaderPlugin_GenerateMipsCounter"));
+	FRDGBufferUAVRef GroupCounterUAV = GraphBuilder.CreateUAV(GroupCounter, PF_R32_UINT);
+	AddClearUAVPass(GraphBuilder, GroupCounterUAV, 0);
+
+	// The graph tracks every mip on its own, so reading the source mip while writing the others in the same pass is fine.
+	FGenerateMipsCS::FParameters* PassParameters = GraphBuilder.AllocParameters<FGenerateMipsCS::FParameters>();
+	PassParameters->SourceMip = GraphBuilder.CreateSRV(FRDGTextureSRVDesc::CreateForMipLevel(Texture, SourceMip));
+	for (int32 MipIndex = 0; MipIndex < NumMips; MipIndex++)
+	{
+		PassParameters->OutMip[MipIndex] = GraphBuilder.CreateUAV(FRDGTextureUAVDesc(Texture, SourceMip + MipIndex + 1));
+	}
+	PassParameters->RWGroupCounter = GroupCounterUAV;
+	PassParameters->SourceSize = FUintVector2(SourceSize.X, SourceSize.Y);
+	PassParameters->NumGroups = GroupCount.X * GroupCount.Y;
+
+	FComputeShaderUtils::AddPass(GraphBuilder, RDG_EVENT_NAME("ShaderPlugin_GenerateMips %dx%d (mips %d-%d)", SourceSize.X, SourceSize.Y, SourceMip + 1, SourceMip + NumMips), ComputeShader, PassParameters, FIntVector(GroupCount.X, GroupCount.Y, 1));
+}
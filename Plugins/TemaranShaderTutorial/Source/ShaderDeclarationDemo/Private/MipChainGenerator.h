@@ -0,0 +1,29 @@
+// Copyright 2016-2020 Cadic AB. All Rights Reserved.
+// @Author	Fredrik Lindh [Temaran] (temaran@gmail.com) {https://github.com/Temaran}
+///////////////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "RenderGraphResources.h"
+
+/**************************************************************************************/
+/* Fills in the mip chain of a render target after we have drawn its top mip, so the  */
+/* materials sampling it from a distance get filtered texels instead of aliasing.     */
+/**************************************************************************************/
+class FMipChainGenerator
+{
+public:
+	// Whether GenerateMips_RenderThread can do anything for this render target. It needs mips to fill, which means the asset
+	// must have bAutoGenerateMips, and has to be writable from compute shaders, which means bCanCreateUAV.
+	static bool SupportsMipGeneration(FRHITexture* RenderTargetTexture);
+
+	// Downsamples mip 0 of Texture into all of its other mips. Targets of up to 4096x4096 take a single compute dispatch,
+	// as long as their format supports typed UAV loads. Larger ones, or ones without those loads, take one for every six mips.
+	static void GenerateMips_RenderThread(FRDGBuilder& GraphBuilder, FRDGTextureRef Texture);
+
+private:
+	// Downsamples SourceMip, which is SourceSize large, into the NumMips mips below it. At most six unless the sixth of them
+	// is a single 64x64 tile and the format supports typed UAV loads.
+	static void AddGenerateMipsPass(FRDGBuilder& GraphBuilder, FRDGTextureRef Texture, int32 SourceMip, FIntPoint SourceSize, int32 NumMips);
+};
@@ -0,0 +1,81 @@
+// Copyright 2016-2020 Cadic AB. All Rights Reserved.
+// @Author	Fredrik Lindh [Temaran] (temaran@gmail.com) {https://github.com/Temaran}
+///////////////////////////////////////////////////////////////////////////////////////
+
+#include "OfflineReadbackPipeline.h"
+
+#include "RenderGraphBuilder.h"
+#include "RenderGraphUtils.h"
+#include "RenderingThread.h"
+#include "RHIGPUReadback.h"
+
+void FOfflineReadbackPipeline::Run(
+	int32 NumImages,
+	int32 NumInFlight,
+	TFunctionRef<FRDGTextureRef(FRDGBuilder& GraphBuilder, int32 ImageIndex)> RenderImage,
+	TFunctionRef<void(int32 ImageIndex, const void* Data, int32 RowPitchInPixels)> ReadImage,
+	TFunction<void(int32 NumReadImages)> OnProgress)
+{
+	check(IsInGameThread());
+
+	NumInFlight = FMath::Max(NumInFlight, 1);
+
+	TArray<TUniquePtr<FRHIGPUTextureReadback>> Readbacks;
+	for (int32 ReadbackIndex = 0; ReadbackIndex < NumInFlight; ReadbackIndex++)
+	{
+		Readbacks.Add(MakeUnique<FRHIGPUTextureReadback>(TEXT("ShaderPlugin_OfflineReadback")));
+	}
+
+	const int32 ProgressInterval = FMath::Max(NumImages / 10, 1);
+	for (int32 Step = 0; Step < NumImages + NumInFlight - 1; Step++)
+	{
+		ENQUEUE_RENDER_COMMAND(ShaderPlugin_OfflineReadbackStep)([&Readbacks, RenderImage, ReadImage, Step, NumImages, NumInFlight](FRHICommandListImmediate& RHICmdList)
+		{
+			if (Step < NumImages)
+			{
+				FRDGBuilder GraphBuilder(RHICmdList, RDG_EVENT_NAME("ShaderPlugin_OfflineImage %d", Step));
+				FRDGTextureRef Texture = RenderImage(GraphBuilder, Step);
+				AddEnqueueCopyPass(GraphBuilder, Readbacks[Step % NumInFlight].Get(), Texture);
+				GraphBuilder.Execute();
+
+				// Hand the work to the GPU right away, rather than when the command list happens to fill up.
+				RHICmdList.SubmitCommandsHint();
+			}
+
+			const int32 ReadyStep = Step - (NumInFlight - 1);
+			if (ReadyStep >= 0 && ReadyStep < NumImages)
+			{
+				FRHIGPUTextureReadback& Readback = *Readbacks[ReadyStep % NumInFlight];
+				if (!Readback.IsReady())
+				{
+					// This is an offline tool, so waiting for the GPU here is fine.
+					RHICmdList.ImmediateFlush(EImmediateFlushType::FlushRHIThread);
+					while (!Readback.IsReady())
+					{
+						FPlatformProcess::SleepNoStats(0.001f);
+					}
+				}
+
+				void* Data = nullptr;
+				int32 RowPitchInPixels = 0;
+				Readback.LockTexture(RHICmdList, Data, RowPitchInPixels);
+				ReadImage(ReadyStep, Data, RowPitchInPixels);
+				Readback.Unlock();
+			}
+		});
+
+		// Let the render thread catch up now and then, so the progress is reported as we go and the queue stays short.
+		const int32 NumReadImages = Step - (NumInFlight - 2);
+		if (NumReadImages > 0 && NumReadImages <= NumImages && NumReadImages % ProgressInterval == 0)
+		{
+			FlushRenderingCommands();
+			if (OnProgress)
+			{
+				OnProgress(NumReadImages);
+			}
+		}
+	}
+
+	// The commands above refer to our locals and the caller's callbacks, so they must all be done before we return.
+	FlushRenderingCommands();
+}
@@ -0,0 +1,31 @@
+// Copyright 2016-2020 Cadic AB. All Rights Reserved.
+// @Author	Fredrik Lindh [Temaran] (temaran@gmail.com) {https://github.com/Temaran}
+///////////////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "RenderGraphResources.h"
+
+/**************************************************************************************/
+/* Renders a sequence of images on the GPU for the offline tools and reads them back, */
+/* keeping a few of them in flight so the GPU is never idle while we copy.            */
+/**************************************************************************************/
+class FOfflineReadbackPipeline
+{
+public:
+	// Each step renders an image and reads back the one from NumInFlight - 1 steps earlier, so the GPU always has work queued
+	// up while the render thread waits for a readback or the caller does something with one. Only that many images exist at
+	// once, each in a transient texture the graph hands back to the pool as soon as it has been copied.
+	//
+	// RenderImage adds the passes for an image to the graph and returns the texture to read back. ReadImage gets its pixels
+	// in order, with a row pitch in pixels, and null if the readback failed. Both run on the render thread. OnProgress, if
+	// set, is called on the game thread with how many images have been read, about ten times over the whole run.
+	// Game thread only, and blocks until every image has been read.
+	static void Run(
+		int32 NumImages,
+		int32 NumInFlight,
+		TFunctionRef<FRDGTextureRef(FRDGBuilder& GraphBuilder, int32 ImageIndex)> RenderImage,
+		TFunctionRef<void(int32 ImageIndex, const void* Data, int32 RowPitchInPixels)> ReadImage,
+		TFunction<void(int32 NumReadImages)> OnProgress = nullptr);
+};
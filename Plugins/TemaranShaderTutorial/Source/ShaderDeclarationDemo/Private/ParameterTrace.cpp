@@ -0,0 +1,456 @@
+// Copyright 2016-2020 Cadic AB. All Rights Reserved.
+// @Author	Fredrik Lindh [Temaran] (temaran@gmail.com) {https://github.com/Temaran}
+///////////////////////////////////////////////////////////////////////////////////////
+
+#include "ParameterTrace.h"
+
+#include "Containers/Ticker.h"
+#include "HAL/FileManager.h"
+#include "HAL/IConsoleManager.h"
+#include "Misc/FileHelper.h"
+#include "Misc/Paths.h"
+#include "Serialization/MemoryReader.h"
+
+DEFINE_LOG_CATEGORY_STATIC(LogShaderPluginTrace, Log, All);
+
+// Bump the version whenever the layout of the records changes, so old traces are rejected instead of misread.
+#define PARAMETER_TRACE_MAGIC 0x52545053 // "SPTR"
+#define PARAMETER_TRACE_VERSION 1
+
+namespace
+{
+	// A trace is the header followed by a stream of these records. Render targets are written out once, the first time
+	// they are used, and after that referred to by index. That keeps a parameter update at 23 bytes.
+	enum class ETraceRecord : uint8
+	{
+		RenderTarget,	// uint16 Index, FString PathName, int32 SizeX, int32 SizeY
+		Register,		// uint32 InstanceId, parameters
+		Update,			// uint32 InstanceId, parameters
+		Unregister,		// uint32 InstanceId
+		Publish,		// double Seconds since the recording started
+	};
+
+	const uint16 NoRenderTarget = MAX_uint16;
+
+	struct FRecordingState
+	{
+		TUniquePtr<FArchive> Writer;
+		TMap<UTextureRenderTarget2D*, uint16> RenderTargetIndices;
+		double StartTime = 0.0;
+		int32 NumFrames = 0;
+	};
+
+	// A recorded change, with the render target already resolved for this session.
+	struct FReplayEvent
+	{
+		ETraceRecord Type;
+		uint32 InstanceId;
+		FShaderUsageExampleParameters Parameters;
+	};
+
+	// Everything that changed before one publish in the recorded session.
+	struct FReplayFrame
+	{
+		double Time;
+		int32 FirstEvent;
+		int32 NumEvents;
+	};
+
+	struct FReplayState
+	{
+		TArray<FReplayEvent> Events;
+		TArray<FReplayFrame> Frames;
+		TArray<UTextureRenderTarget2D*> TransientRenderTargets;
+		TMap<uint32, FShaderUsageExampleHandle> Handles;
+		FTSTicker::FDelegateHandle TickerHandle;
+		int32 NextFrame = 0;
+		double Time = 0.0;
+		bool bMaxSpeed = false;
+		bool bBeganRendering = false;
+	};
+
+	FRecordingState GRecordingState;
+	FReplayState GReplayState;
+
+	uint16 GetRenderTargetIndex(FArchive& Ar, UTextureRenderTarget2D* RenderTarget)
+	{
+		if (!RenderTarget)
+		{
+			return NoRenderTarget;
+		}
+
+		if (const uint16* ExistingIndex = GRecordingState.RenderTargetIndices.Find(RenderTarget))
+		{
+			return *ExistingIndex;
+		}
+
+		uint16 RenderTargetIndex = (uint16)GRecordingState.RenderTargetIndices.Num();
+		GRecordingState.RenderTargetIndices.Add(RenderTarget, RenderTargetIndex);
+
+		ETraceRecord Type = ETraceRecord::RenderTarget;
+		FString PathName = RenderTarget->GetPathName();
+		int32 SizeX = RenderTarget->SizeX;
+		int32 SizeY = RenderTarget->SizeY;
+		Ar << Type << RenderTargetIndex << PathName << SizeX << SizeY;
+		return RenderTargetIndex;
+	}
+
+	void WriteInstanceRecord(ETraceRecord Type, FShaderUsageExampleHandle Handle, const FShaderUsageExampleParameters* DrawParameters)
+	{
+		FArchive& Ar = *GRecordingState.Writer;
+
+		// The render target record has to come before the record that uses it.
+		uint16 RenderTargetIndex = DrawParameters ? GetRenderTargetIndex(Ar, DrawParameters->RenderTarget) : NoRenderTarget;
+
+		Ar << Type << Handle.Id;
+		if (DrawParameters)
+		{
+			// The colors and floats are written as they are, which is what makes the replay bit-identical.
+			FColor StartColor = DrawParameters->StartColor;
+			FColor EndColor = DrawParameters->EndColor;
+			float SimulationState = DrawParameters->SimulationState;
+			float ComputeShaderBlend = DrawParameters->ComputeShaderBlend;
+			Ar << RenderTargetIndex << StartColor << EndColor << SimulationState << ComputeShaderBlend;
+		}
+	}
+
+	UTextureRenderTarget2D* ResolveRenderTarget(const FString& PathName, int32 SizeX, int32 SizeY)
+	{
+		// Render targets that are assets load just like in the recorded session. Ones that were created at runtime are
+		// gone by now, so we stand in for them with transient ones of the same size.
+		if (UTextureRenderTarget2D* RenderTarget = LoadObject<UTextureRenderTarget2D>(nullptr, *PathName, nullptr, LOAD_Quiet | LOAD_NoWarn))
+		{
+			return RenderTarget;
+		}
+
+		UE_LOG(LogShaderPluginTrace, Display, TEXT("%s couldn't be loaded, so a transient %dx%d render target is used instead."), *PathName, SizeX, SizeY);
+		UTextureRenderTarget2D* RenderTarget = NewObject<UTextureRenderTarget2D>(GetTransientPackage());
+		RenderTarget->AddToRoot();
+		RenderTarget->InitAutoFormat(FMath::Max(SizeX, 1), FMath::Max(SizeY, 1));
+		RenderTarget->UpdateResourceImmediate(true);
+		GReplayState.TransientRenderTargets.Add(RenderTarget);
+		return RenderTarget;
+	}
+
+	bool ReadTrace(const TArray<uint8>& Bytes)
+	{
+		FMemoryReader Ar(Bytes);
+
+		uint32 Magic = 0;
+		uint32 Version = 0;
+		Ar << Magic << Version;
+		if (Magic != PARAMETER_TRACE_MAGIC || Version != PARAMETER_TRACE_VERSION)
+		{
+			UE_LOG(LogShaderPluginTrace, Error, TEXT("This isn't a version %d parameter trace."), PARAMETER_TRACE_VERSION);
+			return false;
+		}
+
+		TArray<UTextureRenderTarget2D*> RenderTargets;
+		int32 FirstEventOfFrame = 0;
+		while (!Ar.AtEnd() && !Ar.IsError())
+		{
+			ETraceRecord Type;
+			Ar << Type;
+
+			if (Type == ETraceRecord::RenderTarget)
+			{
+				uint16 Index;
+				FString PathName;
+				int32 SizeX;
+				int32 SizeY;
+				Ar << Index << PathName << SizeX << SizeY;
+				RenderTargets.SetNumZeroed(FMath::Max<int32>(RenderTargets.Num(), Index + 1));
+				RenderTargets[Index] = ResolveRenderTarget(PathName, SizeX, SizeY);
+			}
+			else if (Type == ETraceRecord::Publish)
+			{
+				double Time;
+				Ar << Time;
+				GReplayState.Frames.Add({ Time, FirstEventOfFrame, GReplayState.Events.Num() - FirstEventOfFrame });
+				FirstEventOfFrame = GReplayState.Events.Num();
+			}
+			else if (Type == ETraceRecord::Register || Type == ETraceRecord::Update || Type == ETraceRecord::Unregister)
+			{
+				FReplayEvent& Event = GReplayState.Events.AddDefaulted_GetRef();
+				Event.Type = Type;
+				Ar << Event.InstanceId;
+
+				if (Type != ETraceRecord::Unregister)
+				{
+					uint16 RenderTargetIndex;
+					FColor StartColor;
+					FColor EndColor;
+					Ar << RenderTargetIndex << StartColor << EndColor;
+
+					Event.Parameters = FShaderUsageExampleParameters(RenderTargets.IsValidIndex(RenderTargetIndex) ? RenderTargets[RenderTargetIndex] : nullptr);
+					Event.Parameters.StartColor = StartColor;
+					Event.Parameters.EndColor = EndColor;
+					Ar << Event.Parameters.SimulationState << Event.Parameters.ComputeShaderBlend;
+				}
+			}
+			else
+			{
+				UE_LOG(LogShaderPluginTrace, Error, TEXT("The parameter trace has an unknown record type %d."), (int32)Type);
+				return false;
+			}
+		}
+
+		return !Ar.IsError();
+	}
+
+	void ApplyFrame(const FReplayFrame& Frame)
+	{
+		FShaderDeclarationDemoModule& ShaderModule = FShaderDeclarationDemoModule::Get();
+		for (int32 EventIndex = Frame.FirstEvent; EventIndex < Frame.FirstEvent + Frame.NumEvents; EventIndex++)
+		{
+			const FReplayEvent& Event = GReplayState.Events[EventIndex];
+			switch (Event.Type)
+			{
+			case ETraceRecord::Register:
+				GReplayState.Handles.Add(Event.InstanceId, ShaderModule.RegisterInstance(Event.Parameters));
+				break;
+			case ETraceRecord::Update:
+				if (const FShaderUsageExampleHandle* Handle = GReplayState.Handles.Find(Event.InstanceId))
+				{
+					ShaderModule.UpdateInstance(*Handle, Event.Parameters);
+				}
+				break;
+			case ETraceRecord::Unregister:
+				{
+					FShaderUsageExampleHandle Handle;
+					if (GReplayState.Handles.RemoveAndCopyValue(Event.InstanceId, Handle))
+					{
+						ShaderModule.UnregisterInstance(Handle);
+					}
+				}
+				break;
+			default:
+				break;
+			}
+		}
+	}
+
+	bool TickReplay(float DeltaTime)
+	{
+		// At max speed every recorded frame gets an engine frame of its own. Otherwise we catch up with the recorded
+		// timestamps, and frames that fall within the same engine frame are applied together, like they would have been.
+		if (GReplayState.bMaxSpeed)
+		{
+			if (GReplayState.Frames.IsValidIndex(GReplayState.NextFrame))
+			{
+				ApplyFrame(GReplayState.Frames[GReplayState.NextFrame++]);
+			}
+		}
+		else
+		{
+			GReplayState.Time += DeltaTime;
+			while (GReplayState.Frames.IsValidIndex(GReplayState.NextFrame) && GReplayState.Frames[GReplayState.NextFrame].Time <= GReplayState.Time)
+			{
+				ApplyFrame(GReplayState.Frames[GReplayState.NextFrame++]);
+			}
+		}
+
+		if (GReplayState.NextFrame >= GReplayState.Frames.Num())
+		{
+			UE_LOG(LogShaderPluginTrace, Display, TEXT("Finished replaying %d frames."), GReplayState.Frames.Num());
+			FParameterTrace::StopReplay();
+			return false;
+		}
+
+		return true;
+	}
+}
+
+bool FParameterTrace::StartRecording(const FString& Filename, TConstArrayView<FShaderUsageExampleInstance> ExistingInstances)
+{
+	check(IsInGameThread());
+
+	StopRecording();
+
+	GRecordingState.Writer.Reset(IFileManager::Get().CreateFileWriter(*Filename));
+	if (!GRecordingState.Writer)
+	{
+		UE_LOG(LogShaderPluginTrace, Error, TEXT("Couldn't open %s for writing."), *Filename);
+		return false;
+	}
+
+	uint32 Magic = PARAMETER_TRACE_MAGIC;
+	uint32 Version = PARAMETER_TRACE_VERSION;
+	*GRecordingState.Writer << Magic << Version;
+
+	GRecordingState.StartTime = FPlatformTime::Seconds();
+	GRecordingState.NumFrames = 0;
+
+	// The replay starts from nothing, so the instances that already exist are recorded as if they were registered now.
+	for (const FShaderUsageExampleInstance& Instance : ExistingInstances)
+	{
+		RecordRegister(Instance.Handle, Instance.Parameters);
+	}
+
+	UE_LOG(LogShaderPluginTrace, Display, TEXT("Recording shader plugin parameters to %s."), *Filename);
+	return true;
+}
+
+void FParameterTrace::StopRecording()
+{
+	check(IsInGameThread());
+
+	if (GRecordingState.Writer)
+	{
+		const int64 TraceSize = GRecordingState.Writer->TotalSize();
+		GRecordingState.Writer->Close();
+		GRecordingState.Writer.Reset();
+		UE_LOG(LogShaderPluginTrace, Display, TEXT("Recorded %d frames in %lld bytes."), GRecordingState.NumFrames, TraceSize);
+	}
+
+	GRecordingState.RenderTargetIndices.Reset();
+}
+
+bool FParameterTrace::IsRecording()
+{
+	return GRecordingState.Writer.IsValid();
+}
+
+void FParameterTrace::RecordRegister(FShaderUsageExampleHandle Handle, const FShaderUsageExampleParameters& DrawParameters)
+{
+	if (GRecordingState.Writer)
+	{
+		WriteInstanceRecord(ETraceRecord::Register, Handle, &DrawParameters);
+	}
+}
+
+void FParameterTrace::RecordUpdate(FShaderUsageExampleHandle Handle, const FShaderUsageExampleParameters& DrawParameters)
+{
+	if (GRecordingState.Writer)
+	{
+		WriteInstanceRecord(ETraceRecord::Update, Handle, &DrawParameters);
+	}
+}
+
+void FParameterTrace::RecordUnregister(FShaderUsageExampleHandle Handle)
+{
+	if (GRecordingState.Writer)
+	{
+		WriteInstanceRecord(ETraceRecord::Unregister, Handle, nullptr);
+	}
+}
+
+void FParameterTrace::RecordPublish()
+{
+	if (GRecordingState.Writer)
+	{
+		ETraceRecord Type = ETraceRecord::Publish;
+		double Time = FPlatformTime::Seconds() - GRecordingState.StartTime;
+		*GRecordingState.Writer << Type << Time;
+		GRecordingState.NumFrames++;
+	}
+}
+
+bool FParameterTrace::StartReplay(const FString& Filename, bool bMaxSpeed)
+{
+	check(IsInGameThread());
+
+	StopReplay();
+
+	TArray<uint8> Bytes;
+	if (!FFileHelper::LoadFileToArray(Bytes, *Filename))
+	{
+		UE_LOG(LogShaderPluginTrace, Error, TEXT("Couldn't read %s."), *Filename);
+		return false;
+	}
+
+	if (!ReadTrace(Bytes))
+	{
+		UE_LOG(LogShaderPluginTrace, Error, TEXT("%s is not a valid parameter trace."), *Filename);
+		StopReplay();
+		return false;
+	}
+
+	// Keeps the renderer hooks on for as long as we replay, whether or not there is a pawn around that wants them too.
+	FShaderDeclarationDemoModule::Get().BeginRendering();
+	GReplayState.bBeganRendering = true;
+
+	GReplayState.bMaxSpeed = bMaxSpeed;
+	GReplayState.TickerHandle = FTSTicker::GetCoreTicker().AddTicker(FTickerDelegate::CreateStatic(&TickReplay));
+
+	UE_LOG(LogShaderPluginTrace, Display, TEXT("Replaying %d frames from %s%s."), GReplayState.Frames.Num(), *Filename, bMaxSpeed ? TEXT(" at max speed") : TEXT(""));
+	return true;
+}
+
+void FParameterTrace::StopReplay()
+{
+	check(IsInGameThread());
+
+	if (GReplayState.TickerHandle.IsValid())
+	{
+		FTSTicker::GetCoreTicker().RemoveTicker(GReplayState.TickerHandle);
+		GReplayState.TickerHandle.Reset();
+	}
+
+	if (FShaderDeclarationDemoModule::IsAvailable())
+	{
+		for (TPair<uint32, FShaderUsageExampleHandle>& Handle : GReplayState.Handles)
+		{
+			FShaderDeclarationDemoModule::Get().UnregisterInstance(Handle.Value);
+		}
+
+		if (GReplayState.bBeganRendering)
+		{
+			FShaderDeclarationDemoModule::Get().EndRendering();
+		}
+	}
+
+	// The renderer may still be drawing into the transient targets with parameters it picked up earlier, so we only
+	// let the garbage collector have them, rather than destroying them ourselves.
+	for (UTextureRenderTarget2D* RenderTarget : GReplayState.TransientRenderTargets)
+	{
+		RenderTarget->RemoveFromRoot();
+	}
+
+	GReplayState = FReplayState();
+}
+
+bool FParameterTrace::IsReplaying()
+{
+	return GReplayState.TickerHandle.IsValid();
+}
+
+static FString GetTraceFilename(const TArray<FString>& Args)
+{
+	return Args.Num() > 0 ? Args[0] : FPaths::Combine(FPaths::ProjectSavedDir(), TEXT("ShaderPlugin"), TEXT("ParameterTrace.bin"));
+}
+
+static FAutoConsoleCommand CmdShaderPluginRecord(
+	TEXT("r.ShaderPlugin.Trace.Record"),
+	TEXT("Starts recording all shader plugin parameter changes to a file. Usage: r.ShaderPlugin.Trace.Record [Filename]\n")
+	TEXT("The default filename is Saved/ShaderPlugin/ParameterTrace.bin."),
+	FConsoleCommandWithArgsDelegate::CreateLambda([](const TArray<FString>& Args)
+	{
+		FShaderDeclarationDemoModule::Get().StartRecording(GetTraceFilename(Args));
+	}));
+
+static FAutoConsoleCommand CmdShaderPluginStopRecording(
+	TEXT("r.ShaderPlugin.Trace.StopRecording"),
+	TEXT("Stops recording shader plugin parameter changes and closes the file."),
+	FConsoleCommandDelegate::CreateLambda([]()
+	{
+		FShaderDeclarationDemoModule::Get().StopRecording();
+	}));
+
+static FAutoConsoleCommand CmdShaderPluginReplay(
+	TEXT("r.ShaderPlugin.Trace.Replay"),
+	TEXT("Replays a recorded shader plugin parameter trace. Usage: r.ShaderPlugin.Trace.Replay [Filename] [MaxSpeed]\n")
+	TEXT("With MaxSpeed, every recorded frame is drawn in an engine frame of its own, no matter how long it took to record."),
+	FConsoleCommandWithArgsDelegate::CreateLambda([](const TArray<FString>& Args)
+	{
+		const bool bMaxSpeed = Args.Num() > 1 && Args[1].Equals(TEXT("MaxSpeed"), ESearchCase::IgnoreCase);
+		FShaderDeclarationDemoModule::Get().StartReplay(GetTraceFilename(Args), bMaxSpeed);
+	}));
+
+static FAutoConsoleCommand CmdShaderPluginStopReplay(
+	TEXT("r.ShaderPlugin.Trace.StopReplay"),
+	TEXT("Stops replaying a shader plugin parameter trace and unregisters its instances."),
+	FConsoleCommandDelegate::CreateLambda([]()
+	{
+		FShaderDeclarationDemoModule::Get().StopReplay();
+	}));
@@ -0,0 +1,34 @@
+// Copyright 2016-2020 Cadic AB. All Rights Reserved.
+// @Author	Fredrik Lindh [Temaran] (temaran@gmail.com) {https://github.com/Temaran}
+///////////////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "ShaderDeclarationDemoModule.h"
+
+/**************************************************************************************/
+/* Records every instance change made through FShaderDeclarationDemoModule to a      */
+/* binary trace, and plays traces back through the same API. A replayed trace hands   */
+/* the renderer exactly the same parameters, frame by frame, as the recorded session. */
+/* Everything here is game thread only.                                               */
+/**************************************************************************************/
+class FParameterTrace
+{
+public:
+	// Starts writing to Filename, beginning with the instances that are already registered.
+	static bool StartRecording(const FString& Filename, TConstArrayView<FShaderUsageExampleInstance> ExistingInstances);
+	static void StopRecording();
+	static bool IsRecording();
+
+	// The module calls these whenever an instance changes, and once for every frame of parameters it publishes.
+	static void RecordRegister(FShaderUsageExampleHandle Handle, const FShaderUsageExampleParameters& DrawParameters);
+	static void RecordUpdate(FShaderUsageExampleHandle Handle, const FShaderUsageExampleParameters& DrawParameters);
+	static void RecordUnregister(FShaderUsageExampleHandle Handle);
+	static void RecordPublish();
+
+	// Plays Filename back, either paced by the recorded timestamps or one recorded frame per engine frame.
+	static bool StartReplay(const FString& Filename, bool bMaxSpeed);
+	static void StopReplay();
+	static bool IsReplaying();
+};
@@ -74,12 +74,24 @@ public:
 	DECLARE_GLOBAL_SHADER(FPixelShaderExamplePS);
 	SHADER_USE_PARAMETER_STRUCT(FPixelShaderExamplePS, FGlobalShader);
 
+	// Whether ComputeShaderOutput is a typed RGBA texture we can sample, or the manually packed uint fallback.
+	class FTypedOutputDim : SHADER_PERMUTATION_BOOL("TYPED_OUTPUT");
+
+	// Whether to blend from the previous compute to the latest one, for when the fractal is updated less often than it's drawn.
+	class FInterpolateDim : SHADER_PERMUTATION_BOOL("INTERPOLATE");
+	using FPermutationDomain = TShaderPermutationDomain<FTypedOutputDim, FInterpolateDim>;
+
 	BEGIN_SHADER_PARAMETER_STRUCT(FParameters, )
-		SHADER_PARAMETER_TEXTURE(Texture2D<uint>, ComputeShaderOutput)
+		SHADER_PARAMETER_RDG_TEXTURE(Texture2DArray, ComputeShaderOutput) // <float4> or <uint>, depending on FTypedOutputDim
+		SHADER_PARAMETER_RDG_TEXTURE(Texture2DArray, PreviousComputeShaderOutput) // Only used by the interpolating permutation
+		SHADER_PARAMETER_SAMPLER(SamplerState, ComputeShaderOutputSampler) // Only used by the typed permutation
 		SHADER_PARAMETER(FVector4f, StartColor)
 		SHADER_PARAMETER(FVector4f, EndColor)
 		SHADER_PARAMETER(FVector2f, TextureSize) // Metal doesn't support GetDimensions(), so we send in this data via our parameters.
 		SHADER_PARAMETER(float, BlendFactor)
+		SHADER_PARAMETER(float, InterpolationAlpha)
+		SHADER_PARAMETER(uint32, SliceIndex)
+		RENDER_TARGET_BINDING_SLOTS()
 	END_SHADER_PARAMETER_STRUCT()
 
 public:
@@ -94,45 +106,57 @@ public:
 IMPLEMENT_GLOBAL_SHADER(FSimplePassThroughVS, "/TutorialShaders/Private/PixelShader.usf", "MainVertexShader", SF_Vertex);
 IMPLEMENT_GLOBAL_SHADER(FPixelShaderExamplePS, "/TutorialShaders/Private/PixelShader.usf", "MainPixelShader", SF_Pixel);
 
-void FPixelShaderExample::DrawToRenderTarget_RenderThread(FRHICommandListImmediate& RHICmdList, const FShaderUsageExampleParameters& DrawParameters, FTextureRHIRef ComputeShaderOutput)
+void FPixelShaderExample::DrawToRenderTarget_RenderThread(FRDGBuilder& GraphBuilder, const FShaderUsageExampleParameters& DrawParameters, FRDGTextureRef ComputeShaderOutput, FRDGTextureRef PreviousComputeShaderOutput, float InterpolationAlpha, int32 SliceIndex, FRDGTextureRef RenderTargetTexture)
 {
 	QUICK_SCOPE_CYCLE_COUNTER(STAT_ShaderPlugin_PixelShader); // Used to gather CPU profiling data for the UE4 session frontend
-	SCOPED_DRAW_EVENT(RHICmdList, ShaderPlugin_Pixel); // Used to profile GPU activity and add metadata to be consumed by for example RenderDoc
-
-	FRHIRenderPassInfo RenderPassInfo(DrawParameters.RenderTarget->GetRenderTargetResource()->GetRenderTargetTexture(), ERenderTargetActions::Clear_Store);
-	RHICmdList.BeginRenderPass(RenderPassInfo, TEXT("ShaderPlugin_OutputToRenderTarget"));
 
 	auto ShaderMap = GetGlobalShaderMap(GMaxRHIFeatureLevel);
 	TShaderMapRef<FSimplePassThroughVS> VertexShader(ShaderMap);
-	TShaderMapRef<FPixelShaderExamplePS> PixelShader(ShaderMap);
-		
-	// Set the graphic pipeline state.
-	FGraphicsPipelineStateInitializer GraphicsPSOInit;
-	RHICmdList.ApplyCachedRenderTargets(GraphicsPSOInit);
-	GraphicsPSOInit.BlendState = TStaticBlendState<>::GetRHI();
-	GraphicsPSOInit.RasterizerState = TStaticRasterizerState<>::GetRHI();
-	GraphicsPSOInit.DepthStencilState = TStaticDepthStencilState<false, CF_Always>::GetRHI();
-	GraphicsPSOInit.BoundShaderState.VertexDeclarationRHI = GFilterVertexDeclaration.VertexDeclarationRHI;
-	GraphicsPSOInit.BoundShaderState.VertexShaderRHI = VertexShader.GetVertexShader();
-	GraphicsPSOInit.BoundShaderState.PixelShaderRHI = PixelShader.GetPixelShader();
-	GraphicsPSOInit.PrimitiveType = PT_TriangleStrip;
-	SetGraphicsPipelineState(RHICmdList, GraphicsPSOInit, 0);
-	
-	// Setup the pixel shader
-	FPixelShaderExamplePS::FParameters PassParameters; 
-	PassParameters.ComputeShaderOutput = ComputeShaderOutput;
-	PassParameters.StartColor = FVector4f(DrawParameters.StartColor.R, DrawParameters.StartColor.G, DrawParameters.StartColor.B, DrawParameters.StartColor.A) / 255.0f;
-	PassParameters.EndColor = FVector4f(DrawParameters.EndColor.R, DrawParameters.EndColor.G, DrawParameters.EndColor.B, DrawParameters.EndColor.A) / 255.0f;
-	PassParameters.TextureSize = FVector2f(DrawParameters.GetRenderTargetSize().X, DrawParameters.GetRenderTargetSize().Y);
-	PassParameters.BlendFactor = DrawParameters.ComputeShaderBlend;	
-	SetShaderParameters(RHICmdList, PixelShader, PixelShader.GetPixelShader(), PassParameters);
-	
-	// Draw
-	RHICmdList.SetStreamSource(0, GSimpleScreenVertexBuffer.VertexBufferRHI, 0);
-	RHICmdList.DrawPrimitive(0, 2, 1);
-	
-	// Resolve render target
-	RHICmdList.CopyToResolveTarget(DrawParameters.RenderTarget->GetRenderTargetResource()->GetRenderTargetTexture(), DrawParameters.RenderTarget->GetRenderTargetResource()->TextureRHI, FResolveParams());
-
-	RHICmdList.EndRenderPass();
+	FPixelShaderExamplePS::FPermutationDomain PermutationVector;
+	PermutationVector.Set<FPixelShaderExamplePS::FTypedOutputDim>(ComputeShaderOutput->Desc.Format != PF_R32_UINT);
+	PermutationVector.Set<FPixelShaderExamplePS::FInterpolateDim>(PreviousComputeShaderOutput != nullptr);
+	TShaderMapRef<FPixelShaderExamplePS> PixelShader(ShaderMap, PermutationVector);
+
+	// Setup the pixel shader. We cover every pixel, so there is no need to load or clear the render target first.
+	FPixelShaderExamplePS::FParameters* PassParameters = GraphBuilder.AllocParameters<FPixelShaderExamplePS::FParameters>();
+	PassParameters->ComputeShaderOutput = ComputeShaderOutput;
+	PassParameters->PreviousComputeShaderOutput = PreviousComputeShaderOutput;
+	PassParameters->ComputeShaderOutputSampler = TStaticSamplerState<SF_Bilinear, AM_Clamp, AM_Clamp, AM_Clamp>::GetRHI();
+	PassParameters->StartColor = FVector4f(DrawParameters.StartColor.R, DrawParameters.StartColor.G, DrawParameters.StartColor.B, DrawParameters.StartColor.A) / 255.0f;
+	PassParameters->EndColor = FVector4f(DrawParameters.EndColor.R, DrawParameters.EndColor.G, DrawParameters.EndColor.B, DrawParameters.EndColor.A) / 255.0f;
+	PassParameters->TextureSize = FVector2f(ComputeShaderOutput->Desc.Extent.X, ComputeShaderOutput->Desc.Extent.Y); // Smaller than the render target when the fractal is computed at a lower resolution
+	PassParameters->BlendFactor = DrawParameters.ComputeShaderBlend;
+	PassParameters->InterpolationAlpha = InterpolationAlpha;
+	PassParameters->SliceIndex = SliceIndex;
+	PassParameters->RenderTargets[0] = FRenderTargetBinding(RenderTargetTexture, ERenderTargetLoadAction::ENoAction);
+
+	const FIntPoint ViewportSize = RenderTargetTexture->Desc.Extent;
+
+	// The graph begins and ends the render pass for us, based on the render target bindings in the parameters.
+	GraphBuilder.AddPass(
+		RDG_EVENT_NAME("ShaderPlugin_OutputToRenderTarget"), // Used to profile GPU activity and add metadata to be consumed by for example RenderDoc
+		PassParameters,
+		ERDGPassFlags::Raster,
+		[PassParameters, VertexShader, PixelShader, ViewportSize](FRHICommandList& RHICmdList)
+	{
+		RHICmdList.SetViewport(0, 0, 0.0f, ViewportSize.X, ViewportSize.Y, 1.0f);
+
+		// Set the graphic pipeline state.
+		FGraphicsPipelineStateInitializer GraphicsPSOInit;
+		RHICmdList.ApplyCachedRenderTargets(GraphicsPSOInit);
+		GraphicsPSOInit.BlendState = TStaticBlendState<>::GetRHI();
+		GraphicsPSOInit.RasterizerState = TStaticRasterizerState<>::GetRHI();
+		GraphicsPSOInit.DepthStencilState = TStaticDepthStencilState<false, CF_Always>::GetRHI();
+		GraphicsPSOInit.BoundShaderState.VertexDeclarationRHI = GFilterVertexDeclaration.VertexDeclarationRHI;
+		GraphicsPSOInit.BoundShaderState.VertexShaderRHI = VertexShader.GetVertexShader();
+		GraphicsPSOInit.BoundShaderState.PixelShaderRHI = PixelShader.GetPixelShader();
+		GraphicsPSOInit.PrimitiveType = PT_TriangleStrip;
+		SetGraphicsPipelineState(RHICmdList, GraphicsPSOInit, 0);
+
+		SetShaderParameters(RHICmdList, PixelShader, PixelShader.GetPixelShader(), *PassParameters);
+
+		// Draw
+		RHICmdList.SetStreamSource(0, GSimpleScreenVertexBuffer.VertexBufferRHI, 0);
+		RHICmdList.DrawPrimitive(0, 2, 1);
+	});
 }
@@ -13,5 +13,7 @@
 class FPixelShaderExample
 {
 public:
-	static void DrawToRenderTarget_RenderThread(FRHICommandListImmediate& RHICmdList, const FShaderUsageExampleParameters& DrawParameters, FTextureRHIRef ComputeShaderOutput);
+	// Draws one instance, reading its compute shader output from slice SliceIndex of the ComputeShaderOutput texture array.
+	// When PreviousComputeShaderOutput is given, the fractal is blended from its slice to the one in ComputeShaderOutput by InterpolationAlpha.
+	static void DrawToRenderTarget_RenderThread(FRDGBuilder& GraphBuilder, const FShaderUsageExampleParameters& DrawParameters, FRDGTextureRef ComputeShaderOutput, FRDGTextureRef PreviousComputeShaderOutput, float InterpolationAlpha, int32 SliceIndex, FRDGTextureRef RenderTargetTexture);
 };
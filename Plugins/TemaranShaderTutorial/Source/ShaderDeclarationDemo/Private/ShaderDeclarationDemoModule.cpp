@@ -6,28 +6,259 @@
 
 #include "ComputeShaderExample.h"
 #include "PixelShaderExample.h"
+#include "CPUShaderExample.h"
+#include "GPUBudgetController.h"
+#include "MipChainGenerator.h"
+#include "ParameterTrace.h"
 
 #include "Misc/Paths.h"
 #include "Misc/FileHelper.h"
+#include "Misc/CoreDelegates.h"
+#include "Algo/Sort.h"
+#include "Components/PrimitiveComponent.h"
+#include "Engine/World.h"
+#include "HAL/IConsoleManager.h"
 #include "RHI.h"
 #include "GlobalShader.h"
 #include "RHICommandList.h"
 #include "RenderGraphBuilder.h"
-#include "RenderTargetPool.h"
+#include "RenderGraphUtils.h"
+#include "RenderCore.h"
+#include "RenderingThread.h"
 #include "Runtime/Core/Public/Modules/ModuleManager.h"
 #include "Interfaces/IPluginManager.h"
 
 IMPLEMENT_MODULE(FShaderDeclarationDemoModule, ShaderDeclarationDemo)
 
+DEFINE_LOG_CATEGORY_STATIC(LogShaderPlugin, Log, All);
+
 // Declare some GPU stats so we can track them later
 DECLARE_GPU_STAT_NAMED(ShaderPlugin_Render, TEXT("ShaderPlugin: Root Render"));
 DECLARE_GPU_STAT_NAMED(ShaderPlugin_Compute, TEXT("ShaderPlugin: Render Compute Shader"));
 DECLARE_GPU_STAT_NAMED(ShaderPlugin_Pixel, TEXT("ShaderPlugin: Render Pixel Shader"));
+DECLARE_GPU_STAT_NAMED(ShaderPlugin_Fused, TEXT("ShaderPlugin: Render Fused Compute Shader"));
+DECLARE_GPU_STAT_NAMED(ShaderPlugin_GenerateMips, TEXT("ShaderPlugin: Generate Mips"));
+DECLARE_GPU_STAT_NAMED(ShaderPlugin_PostChain, TEXT("ShaderPlugin: Post Chain"));
+
+// These show how much memory the compute shader intermediates hold. Use "stat ShaderPlugin" to see them.
+DECLARE_STATS_GROUP(TEXT("ShaderPlugin"), STATGROUP_ShaderPlugin, STATCAT_Advanced);
+DECLARE_MEMORY_STAT(TEXT("Intermediate Memory"), STAT_ShaderPlugin_IntermediateMemory, STATGROUP_ShaderPlugin);
+DECLARE_DWORD_ACCUMULATOR_STAT(TEXT("Intermediates"), STAT_ShaderPlugin_NumIntermediates, STATGROUP_ShaderPlugin);
+DECLARE_DWORD_COUNTER_STAT(TEXT("Dropped Readbacks"), STAT_ShaderPlugin_DroppedReadbacks, STATGROUP_ShaderPlugin);
+DECLARE_DWORD_COUNTER_STAT(TEXT("Throttled Instances"), STAT_ShaderPlugin_ThrottledInstances, STATGROUP_ShaderPlugin);
+DECLARE_DWORD_COUNTER_STAT(TEXT("Duplicate Invocations"), STAT_ShaderPlugin_DuplicateInvocations, STATGROUP_ShaderPlugin);
+DECLARE_DWORD_COUNTER_STAT(TEXT("Skipped Updates"), STAT_ShaderPlugin_SkippedUpdates, STATGROUP_ShaderPlugin);
+DECLARE_DWORD_COUNTER_STAT(TEXT("Post Chain Intermediates"), STAT_ShaderPlugin_PostChainIntermediates, STATGROUP_ShaderPlugin);
+
+static TAutoConsoleVariable<int32> CVarShaderPluginBackend(
+	TEXT("r.ShaderPlugin.Backend"),
+	0,
+	TEXT("Selects what evaluates the shader plugin effect.\n")
+	TEXT(" 0: Automatic. The GPU, unless we are running without one (-nullrhi) (default)\n")
+	TEXT(" 1: The GPU, using the compute and pixel shaders\n")
+	TEXT(" 2: The CPU, using the vectorized reference kernel spread over the task graph workers"),
+	ECVF_RenderThreadSafe);
+
+static TAutoConsoleVariable<int32> CVarShaderPluginAsyncCompute(
+	TEXT("r.ShaderPlugin.AsyncCompute"),
+	0,
+	TEXT("Whether to dispatch the shader plugin compute shader on the async compute pipe.\n")
+	TEXT("Falls back to the graphics pipe on RHIs that don't support async compute efficiently.\n")
+	TEXT(" 0: Graphics pipe (default)\n")
+	TEXT(" 1: Async compute pipe"),
+	ECVF_RenderThreadSafe);
+
+static bool UseCPUBackend()
+{
+	const int32 Backend = CVarShaderPluginBackend.GetValueOnAnyThread();
+	return Backend == 2 || (Backend == 0 && GUsingNullRHI);
+}
+
+static TAutoConsoleVariable<int32> CVarShaderPluginSkipUnchanged(
+	TEXT("r.ShaderPlugin.SkipUnchanged"),
+	1,
+	TEXT("Whether the shader plugin skips drawing instances whose output would be the same as what is already in their render target.\n")
+	TEXT("Instances with a compute shader blend of 0 also skip the compute pass, since its result would be multiplied away.\n")
+	TEXT(" 0: Always draw everything\n")
+	TEXT(" 1: Skip work that wouldn't change the output (default)"),
+	ECVF_RenderThreadSafe);
+
+static TAutoConsoleVariable<float> CVarShaderPluginUpdateRate(
+	TEXT("r.ShaderPlugin.UpdateRate"),
+	0.0f,
+	TEXT("How many times per second the shader plugin updates its effect. Frames in between reuse the last update, so at a high\n")
+	TEXT("frame rate the fractal doesn't need computing every frame. 0 updates every engine frame (default)."),
+	ECVF_Scalability | ECVF_RenderThreadSafe);
+
+static TAutoConsoleVariable<int32> CVarShaderPluginUpdateRateInterpolate(
+	TEXT("r.ShaderPlugin.UpdateRate.Interpolate"),
+	1,
+	TEXT("Whether the shader plugin fades between its last two updates when r.ShaderPlugin.UpdateRate is set, which hides the\n")
+	TEXT("stepping at the cost of a pixel pass every frame, a copy of the intermediate per update, and an update of lag.\n")
+	TEXT("The fused compute path and the CPU backend have nothing to fade from, so they always step.\n")
+	TEXT(" 0: Show each update as it is\n")
+	TEXT(" 1: Fade between updates (default)"),
+	ECVF_RenderThreadSafe);
+
+static bool UseUpdateRateInterpolation()
+{
+	return CVarShaderPluginUpdateRate.GetValueOnRenderThread() > 0.0f && CVarShaderPluginUpdateRateInterpolate.GetValueOnRenderThread() != 0;
+}
+
+static TAutoConsoleVariable<int32> CVarShaderPluginVisibilityThrottling(
+	TEXT("r.ShaderPlugin.VisibilityThrottling"),
+	1,
+	TEXT("Whether the shader plugin slows down instances whose consumers haven't been rendered recently. Only instances that have\n")
+	TEXT("consumers registered with AddInstanceConsumer are affected.\n")
+	TEXT(" 0: Draw every instance every frame\n")
+	TEXT(" 1: Draw hidden instances at r.ShaderPlugin.VisibilityThrottling.HiddenRate (default)"),
+	ECVF_Scalability | ECVF_RenderThreadSafe);
+
+static TAutoConsoleVariable<float> CVarShaderPluginVisibilityThrottlingHiddenRate(
+	TEXT("r.ShaderPlugin.VisibilityThrottling.HiddenRate"),
+	0.0f,
+	TEXT("How many times per second the shader plugin draws an instance that nobody can see. 0 pauses it until it comes back into view (default)."),
+	ECVF_Scalability | ECVF_RenderThreadSafe);
+
+static TAutoConsoleVariable<float> CVarShaderPluginVisibilityThrottlingTolerance(
+	TEXT("r.ShaderPlugin.VisibilityThrottling.Tolerance"),
+	0.25f,
+	TEXT("How many seconds after a consumer was last rendered the shader plugin still counts its instance as visible."),
+	ECVF_Default);
+
+static TAutoConsoleVariable<int32> CVarShaderPluginAmortize(
+	TEXT("r.ShaderPlugin.Amortize"),
+	1,
+	TEXT("Spreads the shader plugin compute shader over this many frames, by only computing one pixel out of every block of that many each frame.\n")
+	TEXT("The rest keep what was computed for them in earlier frames, so the fractal lags a little while it moves. Once the simulation stops,\n")
+	TEXT("the remaining pixels are filled in over the next frames, and the output ends up the same as without amortization.\n")
+	TEXT(" 1: Compute every pixel every frame (default)\n")
+	TEXT(" 2, 4, 8, 16: Compute one pixel in that many each frame"),
+	ECVF_Scalability | ECVF_RenderThreadSafe);
+
+static TAutoConsoleVariable<float> CVarShaderPluginAmortizeResetThreshold(
+	TEXT("r.ShaderPlugin.Amortize.ResetThreshold"),
+	0.5f,
+	TEXT("When the simulation state of an instance jumps by more than this since its last compute, all of its pixels are computed at once,\n")
+	TEXT("rather than letting the stale ones show a different moment of the simulation for a few frames."),
+	ECVF_RenderThreadSafe);
+
+static int32 GetAmortizeFactor()
+{
+	const FIntPoint Cell = FComputeShaderExample::GetAmortizeCell(CVarShaderPluginAmortize.GetValueOnRenderThread());
+	return Cell.X * Cell.Y;
+}
+
+static TAutoConsoleVariable<float> CVarShaderPluginIntermediateIdleTime(
+	TEXT("r.ShaderPlugin.IntermediateIdleTime"),
+	5.0f,
+	TEXT("How many seconds the shader plugin keeps a compute shader intermediate that no pass has used before giving it back to the render target pool.\n")
+	TEXT("Instances that haven't changed in that long are recomputed the next time they change."),
+	ECVF_RenderThreadSafe);
+
+static TAutoConsoleVariable<int32> CVarShaderPluginTypedUAVOutput(
+	TEXT("r.ShaderPlugin.TypedUAVOutput"),
+	1,
+	TEXT("Whether the shader plugin compute shader writes its output to a typed texture the pixel shader can sample directly.\n")
+	TEXT(" 0: Pack the output into a R32_UINT texture and unpack it in the pixel shader\n")
+	TEXT(" 1: Write to a R8G8B8A8 (or R11G11B10) texture if the RHI supports storing to it from compute shaders, otherwise pack (default)"),
+	ECVF_RenderThreadSafe);
+
+static TAutoConsoleVariable<int32> CVarShaderPluginFusedCompute(
+	TEXT("r.ShaderPlugin.FusedCompute"),
+	0,
+	TEXT("Whether the shader plugin draws to render targets created with bCanCreateUAV using a single compute pass.\n")
+	TEXT("Compare the Fused Compute Shader GPU stat against the Compute Shader and Pixel Shader ones in \"stat GPU\" to see which is faster.\n")
+	TEXT(" 0: Compute to an intermediate, then blend into the render target with a pixel shader (default)\n")
+	TEXT(" 1: Compute and blend straight into the render target when it supports it"),
+	ECVF_RenderThreadSafe);
+
+static TAutoConsoleVariable<int32> CVarShaderPluginGenerateMips(
+	TEXT("r.ShaderPlugin.GenerateMips"),
+	1,
+	TEXT("Whether the shader plugin builds the mip chain of the render targets of instances that asked for it with SetMipGenerationEnabled.\n")
+	TEXT(" 0: Leave the mips alone\n")
+	TEXT(" 1: Rebuild them with a single compute dispatch every time the instance is drawn (default)"),
+	ECVF_Scalability | ECVF_RenderThreadSafe);
+
+static TAutoConsoleVariable<int32> CVarShaderPluginPostChain(
+	TEXT("r.ShaderPlugin.PostChain"),
+	1,
+	TEXT("Whether the shader plugin runs the post chains of instances that were given one with SetPostChain.\n")
+	TEXT(" 0: Only draw the effect\n")
+	TEXT(" 1: Run the chain on the render target after every draw (default)"),
+	ECVF_Scalability | ECVF_RenderThreadSafe);
+
+// The chain an instance should be drawn with right now, which is none when they are turned off.
+static const FShaderPluginPostChainPtr& GetActivePostChain(const FShaderUsageExampleInstance& Instance)
+{
+	static const FShaderPluginPostChainPtr NoPostChain;
+	return CVarShaderPluginPostChain.GetValueOnRenderThread() != 0 ? Instance.PostChain : NoPostChain;
+}
+
+static TAutoConsoleVariable<int32> CVarShaderPluginReadbackNumSlots(
+	TEXT("r.ShaderPlugin.Readback.NumSlots"),
+	3,
+	TEXT("How many copies of the shader plugin output can be on their way back to the CPU at once.\n")
+	TEXT("The GPU usually finishes a frame two or three frames after it was submitted, so fewer slots than that drop frames."),
+	ECVF_RenderThreadSafe);
+
+static EPixelFormat GetComputeShaderOutputFormat()
+{
+	if (CVarShaderPluginTypedUAVOutput.GetValueOnRenderThread() != 0)
+	{
+		for (EPixelFormat TypedFormat : { PF_R8G8B8A8, PF_FloatR11G11B10 })
+		{
+			if (UE::PixelFormat::HasCapabilities(TypedFormat, EPixelFormatCapabilities::TypedUAVStore))
+			{
+				return TypedFormat;
+			}
+		}
+	}
+
+	// Every RHI that runs compute shaders can store to R32_UINT, so this always works.
+	return PF_R32_UINT;
+}
+
+static FRHITexture* GetRenderTargetTexture(const FShaderUsageExampleParameters& DrawParameters)
+{
+	FTextureRenderTargetResource* RenderTargetResource = DrawParameters.RenderTarget ? DrawParameters.RenderTarget->GetRenderTargetResource() : nullptr;
+	return RenderTargetResource ? RenderTargetResource->GetRenderTargetTexture() : nullptr;
+}
+
+static FRDGTextureRef AddOutputPass(FRDGBuilder& GraphBuilder, const FShaderUsageExampleParameters& DrawParameters, FRDGTextureRef ComputeShaderOutput, FRDGTextureRef PreviousComputeShaderOutput, float InterpolationAlpha, int32 SliceIndex)
+{
+	// The UObject render target lives outside of the graph, so we register it to let the graph track its state.
+	FRDGTextureRef RenderTargetTexture = RegisterExternalTexture(GraphBuilder, GetRenderTargetTexture(DrawParameters), TEXT("ShaderPlugin_RenderTarget"));
+	FPixelShaderExample::DrawToRenderTarget_RenderThread(GraphBuilder, DrawParameters, ComputeShaderOutput, PreviousComputeShaderOutput, InterpolationAlpha, SliceIndex, RenderTargetTexture);
+
+	// Materials sample the render target after the graph is done with it, so leave it in a readable state.
+	GraphBuilder.SetTextureAccessFinal(RenderTargetTexture, ERHIAccess::SRVMask);
+	return RenderTargetTexture;
+}
+
+static ERDGPassFlags GetComputePassFlags()
+{
+	return CVarShaderPluginAsyncCompute.GetValueOnRenderThread() != 0 && GSupportsEfficientAsyncCompute ? ERDGPassFlags::AsyncCompute : ERDGPassFlags::Compute;
+}
 
 void FShaderDeclarationDemoModule::StartupModule()
 {
+	bRendering = false;
+	RenderingRefCount = 0;
 	OnPostResolvedSceneColorHandle.Reset();
-	bCachedParametersValid = false;
+	NextInstanceId = 1;
+	bInstancesDirty = false;
+	ConsumedParametersFrameNumber = 0;
+	RenderFrameIndex = 0;
+	IntermediateMemorySize = 0;
+	NextReadbackSlot = 0;
+	DroppedReadbackCount = 0;
+	LastScheduledFrameNumber = 0;
+	LastUpdateTime = 0.0;
+	NextUpdateTime = 0.0;
+	DuplicateInvocationCount = 0;
+	SkippedUpdateCount = 0;
 
 	// Maps virtual shader source directory to the plugin's actual shaders directory.
 	FString PluginShaderDir = FPaths::Combine(IPluginManager::Get().FindPlugin(TEXT("TemaranShaderTutorial"))->GetBaseDir(), TEXT("Shaders"));
@@ -36,17 +267,48 @@ void FShaderDeclarationDemoModule::StartupModule()
 
 void FShaderDeclarationDemoModule::ShutdownModule()
 {
-	EndRendering();
+	FParameterTrace::StopReplay();
+	FParameterTrace::StopRecording();
+
+	// Whoever still holds on to the renderer is going away with us.
+	RenderingRefCount = 0;
+	RemoveRenderingHooks();
 }
 
 void FShaderDeclarationDemoModule::BeginRendering()
 {
-	if (OnPostResolvedSceneColorHandle.IsValid())
+	check(IsInGameThread());
+
+	if (RenderingRefCount++ == 0)
+	{
+		AddRenderingHooks();
+	}
+}
+
+void FShaderDeclarationDemoModule::EndRendering()
+{
+	check(IsInGameThread());
+
+	// An unmatched end would take the hooks from under someone else, so it is ignored rather than counted.
+	if (RenderingRefCount == 0)
+	{
+		return;
+	}
+
+	if (--RenderingRefCount == 0)
+	{
+		RemoveRenderingHooks();
+	}
+}
+
+void FShaderDeclarationDemoModule::AddRenderingHooks()
+{
+	if (bRendering)
 	{
 		return;
 	}
 
-	bCachedParametersValid = false;
+	bRendering = true;
 
 	const FName RendererModuleName("Renderer");
 	IRendererModule* RendererModule = FModuleManager::GetModulePtr<IRendererModule>(RendererModuleName);
@@ -54,49 +316,1064 @@ void FShaderDeclarationDemoModule::BeginRendering()
 	{
 		OnPostResolvedSceneColorHandle = RendererModule->GetResolvedSceneColorCallbacks().AddRaw(this, &FShaderDeclarationDemoModule::PostResolveSceneColor_RenderThread);
 	}
+
+	// The scene is never rendered without an RHI, so the CPU backend runs at the end of each frame instead.
+	OnEndFrameRenderThreadHandle = FCoreDelegates::OnEndFrameRT.AddRaw(this, &FShaderDeclarationDemoModule::EndFrame_RenderThread);
+
+	// We publish the instances after the actors have ticked, which is before the frame gets rendered.
+	// The end of frame hook covers frames where no world was ticked.
+	OnWorldPostActorTickHandle = FWorldDelegates::OnWorldPostActorTick.AddLambda([this](UWorld*, ELevelTick, float) { PublishInstances_GameThread(); });
+	OnEndFrameHandle = FCoreDelegates::OnEndFrame.AddRaw(this, &FShaderDeclarationDemoModule::PublishInstances_GameThread);
+	bInstancesDirty = true;
 }
 
-void FShaderDeclarationDemoModule::EndRendering()
+void FShaderDeclarationDemoModule::RemoveRenderingHooks()
 {
-	if (!OnPostResolvedSceneColorHandle.IsValid())
+	if (!bRendering)
 	{
 		return;
 	}
 
+	bRendering = false;
+
 	const FName RendererModuleName("Renderer");
 	IRendererModule* RendererModule = FModuleManager::GetModulePtr<IRendererModule>(RendererModuleName);
-	if (RendererModule)
+	if (RendererModule && OnPostResolvedSceneColorHandle.IsValid())
 	{
 		RendererModule->GetResolvedSceneColorCallbacks().Remove(OnPostResolvedSceneColorHandle);
 	}
 
+	FCoreDelegates::OnEndFrameRT.Remove(OnEndFrameRenderThreadHandle);
+	FWorldDelegates::OnWorldPostActorTick.Remove(OnWorldPostActorTickHandle);
+	FCoreDelegates::OnEndFrame.Remove(OnEndFrameHandle);
+
 	OnPostResolvedSceneColorHandle.Reset();
+	OnEndFrameRenderThreadHandle.Reset();
+	OnWorldPostActorTickHandle.Reset();
+	OnEndFrameHandle.Reset();
+
+	// The intermediates belong to the render thread, so that's where we let go of them.
+	ENQUEUE_RENDER_COMMAND(ShaderPlugin_ReleaseIntermediates)([this](FRHICommandListImmediate& RHICmdList)
+	{
+		ReleaseComputeOutputs_RenderThread();
+		ReleaseReadbacks_RenderThread();
+	});
+}
+
+FShaderUsageExampleHandle FShaderDeclarationDemoModule::RegisterInstance(const FShaderUsageExampleParameters& DrawParameters)
+{
+	check(IsInGameThread());
+
+	FShaderUsageExampleHandle Handle;
+	Handle.Id = NextInstanceId++;
+
+	const int32 InstanceIndex = Instances.Add({ Handle, DrawParameters });
+	InstanceIndices.Add(Handle, InstanceIndex);
+	bInstancesDirty = true;
+
+	FParameterTrace::RecordRegister(Handle, DrawParameters);
+
+	return Handle;
+}
+
+void FShaderDeclarationDemoModule::UpdateInstance(FShaderUsageExampleHandle Handle, const FShaderUsageExampleParameters& DrawParameters)
+{
+	check(IsInGameThread());
+
+	if (const int32* InstanceIndex = InstanceIndices.Find(Handle))
+	{
+		Instances[*InstanceIndex].Parameters = DrawParameters;
+		bInstancesDirty = true;
+
+		FParameterTrace::RecordUpdate(Handle, DrawParameters);
+	}
+}
+
+void FShaderDeclarationDemoModule::UnregisterInstance(FShaderUsageExampleHandle& Handle)
+{
+	check(IsInGameThread());
+
+	int32 InstanceIndex;
+	if (InstanceIndices.RemoveAndCopyValue(Handle, InstanceIndex))
+	{
+		// Move the last instance into the hole to keep the array contiguous.
+		Instances.RemoveAtSwap(InstanceIndex, 1, false);
+		if (InstanceIndex < Instances.Num())
+		{
+			InstanceIndices[Instances[InstanceIndex].Handle] = InstanceIndex;
+		}
+
+		InstanceConsumers.Remove(Handle);
+		bInstancesDirty = true;
+
+		FParameterTrace::RecordUnregister(Handle);
+	}
+
+	Handle.Invalidate();
+}
+
+void FShaderDeclarationDemoModule::SetReadbackEnabled(FShaderUsageExampleHandle Handle, bool bEnabled)
+{
+	check(IsInGameThread());
+
+	if (const int32* InstanceIndex = InstanceIndices.Find(Handle))
+	{
+		Instances[*InstanceIndex].bReadback = bEnabled;
+		bInstancesDirty = true;
+	}
+}
+
+void FShaderDeclarationDemoModule::SetMipGenerationEnabled(FShaderUsageExampleHandle Handle, bool bEnabled)
+{
+	check(IsInGameThread());
+
+	if (const int32* InstanceIndex = InstanceIndices.Find(Handle))
+	{
+		Instances[*InstanceIndex].bGenerateMips = bEnabled;
+		bInstancesDirty = true;
+	}
+}
+
+void FShaderDeclarationDemoModule::SetPostChain(FShaderUsageExampleHandle Handle, FShaderPluginPostChainPtr PostChain)
+{
+	check(IsInGameThread());
+
+	if (const int32* InstanceIndex = InstanceIndices.Find(Handle))
+	{
+		Instances[*InstanceIndex].PostChain = MoveTemp(PostChain);
+		bInstancesDirty = true;
+	}
+}
+
+void FShaderDeclarationDemoModule::AddInstanceConsumer(FShaderUsageExampleHandle Handle, UPrimitiveComponent* Component)
+{
+	check(IsInGameThread());
+
+	if (Component && InstanceIndices.Contains(Handle))
+	{
+		InstanceConsumers.FindOrAdd(Handle).AddUnique(Component);
+	}
+}
+
+void FShaderDeclarationDemoModule::AddInstanceConsumers(FShaderUsageExampleHandle Handle, TConstArrayView<UPrimitiveComponent*> Components)
+{
+	check(IsInGameThread());
+
+	if (Components.Num() == 0 || !InstanceIndices.Contains(Handle))
+	{
+		return;
+	}
+
+	TArray<TWeakObjectPtr<UPrimitiveComponent>>& Consumers = InstanceConsumers.FindOrAdd(Handle);
+	TSet<TWeakObjectPtr<UPrimitiveComponent>> KnownConsumers(Consumers);
+	for (UPrimitiveComponent* Component : Components)
+	{
+		bool bAlreadyKnown = false;
+		KnownConsumers.Add(Component, &bAlreadyKnown);
+		if (Component && !bAlreadyKnown)
+		{
+			Consumers.Add(Component);
+		}
+	}
+}
+
+void FShaderDeclarationDemoModule::RemoveInstanceConsumer(FShaderUsageExampleHandle Handle, UPrimitiveComponent* Component)
+{
+	check(IsInGameThread());
+
+	// The instance keeps its entry even when this was the last consumer, so it counts as hidden rather than going back to always drawing.
+	if (TArray<TWeakObjectPtr<UPrimitiveComponent>>* Consumers = InstanceConsumers.Find(Handle))
+	{
+		Consumers->RemoveSwap(Component);
+	}
 }
 
 void FShaderDeclarationDemoModule::UpdateParameters(FShaderUsageExampleParameters& DrawParameters)
 {
-	RenderEveryFrameLock.Lock();
-	CachedShaderUsageExampleParameters = DrawParameters;
-	bCachedParametersValid = true;
-	RenderEveryFrameLock.Unlock();
+	if (DefaultInstance.IsValid())
+	{
+		UpdateInstance(DefaultInstance, DrawParameters);
+	}
+	else
+	{
+		DefaultInstance = RegisterInstance(DrawParameters);
+	}
+}
+
+void FShaderDeclarationDemoModule::UpdateInstanceVisibility_GameThread()
+{
+	const bool bThrottle = CVarShaderPluginVisibilityThrottling.GetValueOnGameThread() != 0;
+	const float Tolerance = CVarShaderPluginVisibilityThrottlingTolerance.GetValueOnGameThread();
+
+	for (TPair<FShaderUsageExampleHandle, TArray<TWeakObjectPtr<UPrimitiveComponent>>>& Consumers : InstanceConsumers)
+	{
+		Consumers.Value.RemoveAllSwap([](const TWeakObjectPtr<UPrimitiveComponent>& Consumer) { return !Consumer.IsValid(); }, false);
+
+		// The renderer stamps each primitive it draws with the time, so this also catches consumers that are culled or off-screen.
+		bool bVisible = !bThrottle;
+		for (int32 ConsumerIndex = 0; ConsumerIndex < Consumers.Value.Num() && !bVisible; ConsumerIndex++)
+		{
+			bVisible = Consumers.Value[ConsumerIndex]->WasRecentlyRendered(Tolerance);
+		}
+
+		// Only a change needs publishing, so a hidden instance that nobody updates costs the renderer nothing.
+		FShaderUsageExampleInstance& Instance = Instances[InstanceIndices[Consumers.Key]];
+		if (Instance.bVisible != bVisible)
+		{
+			Instance.bVisible = bVisible;
+			bInstancesDirty = true;
+		}
+	}
 }
 
-void FShaderDeclarationDemoModule::PostResolveSceneColor_RenderThread(FRDGBuilder& builder, const FSceneTextures& SceneTexture)
+void FShaderDeclarationDemoModule::PublishInstances_GameThread()
 {
-	if (!bCachedParametersValid)
+	check(IsInGameThread());
+
+	UpdateInstanceVisibility_GameThread();
+
+	if (!bInstancesDirty)
 	{
 		return;
 	}
 
-	// Depending on your data, you might not have to lock here, just added this code to show how you can do it if you have to.
-	RenderEveryFrameLock.Lock();
-	FShaderUsageExampleParameters Copy = CachedShaderUsageExampleParameters;
-	RenderEveryFrameLock.Unlock();
+	// The write buffer holds instances from an older frame, so assigning to it mostly reuses its allocation.
+	FShaderUsageExampleInstancesFrame& InstancesFrame = InstancesBuffer.GetWriteBuffer();
+	InstancesFrame.Instances = Instances;
+	InstancesFrame.FrameNumber = GFrameCounter;
+	InstancesBuffer.SwapWriteBuffers();
 
-	Draw_RenderThread(Copy);
+	bInstancesDirty = false;
+
+	// This marks the end of a frame in the trace. Everything recorded since the last one reached the renderer together.
+	FParameterTrace::RecordPublish();
+}
+
+bool FShaderDeclarationDemoModule::StartRecording(const FString& Filename)
+{
+	return FParameterTrace::StartRecording(Filename, Instances);
 }
 
-void FShaderDeclarationDemoModule::Draw_RenderThread(const FShaderUsageExampleParameters& DrawParameters)
+void FShaderDeclarationDemoModule::StopRecording()
+{
+	FParameterTrace::StopRecording();
+}
+
+bool FShaderDeclarationDemoModule::StartReplay(const FString& Filename, bool bMaxSpeed)
+{
+	return FParameterTrace::StartReplay(Filename, bMaxSpeed);
+}
+
+void FShaderDeclarationDemoModule::StopReplay()
+{
+	FParameterTrace::StopReplay();
+}
+
+FShaderUsageExampleInstancesFrame& FShaderDeclarationDemoModule::ConsumeInstances_RenderThread()
+{
+	check(IsInRenderingThread());
+
+	// If the game thread hasn't published anything since last time, we keep drawing with what we already have.
+	if (InstancesBuffer.IsDirty())
+	{
+		InstancesBuffer.SwapReadBuffers();
+	}
+
+	FShaderUsageExampleInstancesFrame& InstancesFrame = InstancesBuffer.Read();
+	ConsumedParametersFrameNumber = InstancesFrame.FrameNumber;
+	return InstancesFrame;
+}
+
+FShaderDeclarationDemoModule::FComputeOutputKey FShaderDeclarationDemoModule::GetComputeOutputKey(const FShaderUsageExampleParameters& DrawParameters)
+{
+	FComputeOutputKey Key;
+	// When we're over the GPU budget the fractal is computed at a lower resolution, and the pixel pass upsamples it.
+	const FIntPoint RenderTargetSize = DrawParameters.GetRenderTargetSize();
+	const float ResolutionScale = FGPUBudgetController::GetResolutionScale();
+	Key.Size = FIntPoint(FMath::Max(FMath::RoundToInt(RenderTargetSize.X * ResolutionScale), 1), FMath::Max(FMath::RoundToInt(RenderTargetSize.Y * ResolutionScale), 1));
+	Key.Format = GetComputeShaderOutputFormat();
+	return Key;
+}
+
+FShaderDeclarationDemoModule::FInstanceRenderState* FShaderDeclarationDemoModule::PrepareInstanceDraw_RenderThread(const FShaderUsageExampleInstance& Instance, FRHITexture* RenderTargetTexture, double CurrentTime, bool& bOutNeedsCompute)
+{
+	const FShaderUsageExampleParameters& DrawParameters = Instance.Parameters;
+	FInstanceRenderState& State = InstanceRenderStates.FindOrAdd(Instance.Handle);
+	State.LastSeenFrame = RenderFrameIndex;
+
+	// Nobody has seen the target lately, so it only gets drawn every now and then, if at all. It is still drawn once, so it
+	// doesn't come into view showing garbage, and readbacks count as being seen since someone on the CPU is waiting for them.
+	// When it comes back into view, the checks below compare against what it last drew, so it catches up right away.
+	if (!Instance.bVisible && !Instance.bReadback && State.bHasDrawn)
+	{
+		const float HiddenRate = CVarShaderPluginVisibilityThrottlingHiddenRate.GetValueOnRenderThread();
+		if (HiddenRate <= 0.0f || CurrentTime - State.LastDrawTime < 1.0 / HiddenRate)
+		{
+			INC_DWORD_STAT(STAT_ShaderPlugin_ThrottledInstances);
+			return nullptr;
+		}
+	}
+
+	// MainPixelShader multiplies the compute shader output with the blend factor, and the color gradient with one minus it.
+	const bool bComputeVisible = DrawParameters.ComputeShaderBlend != 0.0f;
+	const bool bGradientVisible = DrawParameters.ComputeShaderBlend != 1.0f;
+	const bool bSkipUnchanged = CVarShaderPluginSkipUnchanged.GetValueOnRenderThread() != 0;
+	const int32 Quality = FComputeShaderExample::GetQuality();
+	const bool bHalfPrecision = FComputeShaderExample::UseHalfPrecision();
+
+	const FShaderUsageExampleParameters& LastDrawn = State.LastDrawnParameters;
+	const bool bMustDraw = !bSkipUnchanged
+		|| !State.bHasDrawn
+		|| State.LastDrawnTexture != RenderTargetTexture
+		|| LastDrawn.GetRenderTargetSize() != DrawParameters.GetRenderTargetSize()
+		|| LastDrawn.ComputeShaderBlend != DrawParameters.ComputeShaderBlend
+		|| State.LastDrawnPostChain != GetActivePostChain(Instance);
+
+	// An amortized instance keeps computing after the simulation stops, until every pixel has caught up with it.
+	const bool bComputeConverging = bComputeVisible && State.bComputeOutputValid && State.NumAmortizePhasesAtComputedState < State.AmortizeFactor;
+
+	// The budget controller changing the quality tier, or r.ShaderPlugin.HalfPrecision being toggled, changes the fractal just
+	// as much as the simulation moving on does.
+	const bool bComputeChanged = bComputeVisible && (LastDrawn.SimulationState != DrawParameters.SimulationState
+		|| State.ComputedQuality != Quality
+		|| State.bComputedHalfPrecision != bHalfPrecision);
+	const bool bGradientChanged = bGradientVisible && (LastDrawn.StartColor != DrawParameters.StartColor || LastDrawn.EndColor != DrawParameters.EndColor);
+	if (!bMustDraw && !bComputeChanged && !bGradientChanged && !bComputeConverging)
+	{
+		bOutNeedsCompute = false;
+		return nullptr;
+	}
+
+	// The intermediate still holds what we computed last time, so we only recompute when that is gone or out of date.
+	bOutNeedsCompute = bComputeVisible && (!bSkipUnchanged
+		|| !State.bComputeOutputValid
+		|| State.ComputeOutputKey != GetComputeOutputKey(DrawParameters)
+		|| State.ComputedSimulationState != DrawParameters.SimulationState
+		|| State.ComputedQuality != Quality
+		|| State.bComputedHalfPrecision != bHalfPrecision
+		|| bComputeConverging);
+
+	State.LastDrawnParameters = DrawParameters;
+	State.LastDrawnTexture = RenderTargetTexture;
+	State.LastDrawnPostChain = GetActivePostChain(Instance);
+	State.LastDrawTime = CurrentTime;
+	State.bHasDrawn = true;
+	return &State;
+}
+
+void FShaderDeclarationDemoModule::ReleaseStaleInstanceRenderStates_RenderThread()
+{
+	for (auto It = InstanceRenderStates.CreateIterator(); It; ++It)
+	{
+		if (It.Value().LastSeenFrame != RenderFrameIndex)
+		{
+			ReleaseComputeOutputSlice_RenderThread(It.Value());
+			It.RemoveCurrent();
+		}
+	}
+}
+
+bool FShaderDeclarationDemoModule::AcquireComputeOutputSlice_RenderThread(FShaderUsageExampleHandle Handle, FInstanceRenderState& State, const FComputeOutputKey& Key)
+{
+	if (State.ComputeOutputSlice != INDEX_NONE && State.ComputeOutputKey == Key)
+	{
+		return true;
+	}
+
+	// The render target was resized or this is the first time we compute the instance, so it moves to the intermediate matching its new size.
+	ReleaseComputeOutputSlice_RenderThread(State);
+
+	FComputeOutputArray& ComputeOutputArray = ComputeOutputArrays.FindOrAdd(Key);
+	int32 SliceIndex = ComputeOutputArray.SliceOwners.IndexOfByKey(FShaderUsageExampleHandle());
+	if (SliceIndex == INDEX_NONE)
+	{
+		if (ComputeOutputArray.SliceOwners.Num() >= FMath::Max<int32>(GMaxTextureArrayLayers, 1))
+		{
+			return false;
+		}
+		SliceIndex = ComputeOutputArray.SliceOwners.AddDefaulted();
+	}
+
+	ComputeOutputArray.SliceOwners[SliceIndex] = Handle;
+	State.ComputeOutputKey = Key;
+	State.ComputeOutputSlice = SliceIndex;
+	State.bComputeOutputValid = false;
+	return true;
+}
+
+void FShaderDeclarationDemoModule::ReleaseComputeOutputSlice_RenderThread(FInstanceRenderState& State)
+{
+	if (State.ComputeOutputSlice != INDEX_NONE)
+	{
+		if (FComputeOutputArray* ComputeOutputArray = ComputeOutputArrays.Find(State.ComputeOutputKey))
+		{
+			TArray<FShaderUsageExampleHandle>& SliceOwners = ComputeOutputArray->SliceOwners;
+			SliceOwners[State.ComputeOutputSlice].Invalidate();
+			while (SliceOwners.Num() > 0 && !SliceOwners.Last().IsValid())
+			{
+				SliceOwners.Pop(false);
+			}
+		}
+	}
+
+	State.ComputeOutputSlice = INDEX_NONE;
+	State.bComputeOutputValid = false;
+	State.bHistoryValid = false;
+}
+
+FRDGTextureRef FShaderDeclarationDemoModule::GetComputeOutputTexture_RenderThread(FRDGBuilder& GraphBuilder, const FComputeOutputKey& Key, FComputeOutputArray& ComputeOutputArray)
+{
+	const int32 NumUsedSlices = ComputeOutputArray.SliceOwners.Num();
+	if (ComputeOutputArray.PooledTexture.IsValid() && NumUsedSlices <= ComputeOutputArray.NumAllocatedSlices)
+	{
+		return GraphBuilder.RegisterExternalTexture(ComputeOutputArray.PooledTexture);
+	}
+
+	// We grow in powers of two so instances registering one at a time don't reallocate the intermediate every frame.
+	const int32 NumSlices = FMath::Min<int32>(FMath::RoundUpToPowerOfTwo(NumUsedSlices), FMath::Max<int32>(GMaxTextureArrayLayers, 1));
+	FRDGTextureDesc ComputeShaderOutputDesc = FRDGTextureDesc::Create2DArray(Key.Size, Key.Format, FClearValueBinding::None, TexCreate_ShaderResource | TexCreate_UAV, NumSlices);
+	FRDGTextureRef ComputeShaderOutput = GraphBuilder.CreateTexture(ComputeShaderOutputDesc, TEXT("ShaderPlugin_ComputeShaderOutput"));
+
+	// Instances that already had a slice keep their output, since they might not be recomputed this frame.
+	if (ComputeOutputArray.PooledTexture.IsValid())
+	{
+		FRHICopyTextureInfo CopyInfo;
+		CopyInfo.NumSlices = ComputeOutputArray.NumAllocatedSlices;
+		AddCopyTexturePass(GraphBuilder, GraphBuilder.RegisterExternalTexture(ComputeOutputArray.PooledTexture), ComputeShaderOutput, CopyInfo);
+	}
+
+	// Turning the texture into an external one makes the graph allocate it from GRenderTargetPool, so a matching
+	// target someone else released gets reused, and lets us hold on to it after the graph has executed.
+	ComputeOutputArray.PooledTexture = GraphBuilder.ConvertToExternalTexture(ComputeShaderOutput);
+	ComputeOutputArray.NumAllocatedSlices = NumSlices;
+	UpdateIntermediateMemoryStats_RenderThread();
+
+	return ComputeShaderOutput;
+}
+
+void FShaderDeclarationDemoModule::UpdateComputeOutputHistory_RenderThread(FRDGBuilder& GraphBuilder, FRDGTextureRef ComputeShaderOutput, FComputeOutputArray& ComputeOutputArray)
+{
+	FRDGTextureRef History = nullptr;
+	if (ComputeOutputArray.HistoryPooledTexture.IsValid() && ComputeOutputArray.HistoryPooledTexture->GetDesc().ArraySize == ComputeShaderOutput->Desc.ArraySize)
+	{
+		History = GraphBuilder.RegisterExternalTexture(ComputeOutputArray.HistoryPooledTexture);
+	}
+	else
+	{
+		History = GraphBuilder.CreateTexture(ComputeShaderOutput->Desc, TEXT("ShaderPlugin_ComputeShaderOutputHistory"));
+		ComputeOutputArray.HistoryPooledTexture = GraphBuilder.ConvertToExternalTexture(History);
+		UpdateIntermediateMemoryStats_RenderThread();
+	}
+
+	// Copying every slice is a single pass, and at the update rates this is meant for it's cheaper than tracking which
+	// slices are about to change. The ones that aren't recomputed end up the same in both, so they don't fade.
+	FRHICopyTextureInfo CopyInfo;
+	CopyInfo.NumSlices = ComputeShaderOutput->Desc.ArraySize;
+	AddCopyTexturePass(GraphBuilder, ComputeShaderOutput, History, CopyInfo);
+
+	for (const FShaderUsageExampleHandle& Owner : ComputeOutputArray.SliceOwners)
+	{
+		if (FInstanceRenderState* State = Owner.IsValid() ? InstanceRenderStates.Find(Owner) : nullptr)
+		{
+			State->bHistoryValid = false;
+		}
+	}
+}
+
+void FShaderDeclarationDemoModule::ReleaseIdleComputeOutputs_RenderThread(double CurrentTime)
+{
+	const double IdleTime = CVarShaderPluginIntermediateIdleTime.GetValueOnRenderThread();
+
+	bool bReleasedAny = false;
+	for (auto It = ComputeOutputArrays.CreateIterator(); It; ++It)
+	{
+		if (CurrentTime - It.Value().LastUsedTime <= IdleTime)
+		{
+			continue;
+		}
+
+		// The owners will recompute into a new intermediate the next time their output is needed.
+		for (const FShaderUsageExampleHandle& Owner : It.Value().SliceOwners)
+		{
+			if (FInstanceRenderState* State = Owner.IsValid() ? InstanceRenderStates.Find(Owner) : nullptr)
+			{
+				State->ComputeOutputSlice = INDEX_NONE;
+				State->bComputeOutputValid = false;
+				State->bHistoryValid = false;
+			}
+		}
+
+		It.RemoveCurrent();
+		bReleasedAny = true;
+	}
+
+	if (bReleasedAny)
+	{
+		UpdateIntermediateMemoryStats_RenderThread();
+	}
+}
+
+void FShaderDeclarationDemoModule::ReleaseComputeOutputs_RenderThread()
+{
+	check(IsInRenderingThread());
+
+	// Forgetting the render states as well makes everything draw again if rendering is started back up.
+	ComputeOutputArrays.Empty();
+	InstanceRenderStates.Empty();
+	PendingDraws.Empty();
+	PendingComputes.Empty();
+	UpdateIntermediateMemoryStats_RenderThread();
+	FGPUBudgetController::Reset_RenderThread();
+}
+
+void FShaderDeclarationDemoModule::UpdateIntermediateMemoryStats_RenderThread()
+{
+	uint64 MemorySize = 0;
+	for (const TPair<FComputeOutputKey, FComputeOutputArray>& ComputeOutputArray : ComputeOutputArrays)
+	{
+		if (ComputeOutputArray.Value.PooledTexture.IsValid())
+		{
+			MemorySize += ComputeOutputArray.Value.PooledTexture->ComputeMemorySize();
+		}
+		if (ComputeOutputArray.Value.HistoryPooledTexture.IsValid())
+		{
+			MemorySize += ComputeOutputArray.Value.HistoryPooledTexture->ComputeMemorySize();
+		}
+	}
+
+	IntermediateMemorySize = MemorySize;
+	SET_MEMORY_STAT(STAT_ShaderPlugin_IntermediateMemory, MemorySize);
+	SET_DWORD_STAT(STAT_ShaderPlugin_NumIntermediates, ComputeOutputArrays.Num());
+}
+
+void FShaderDeclarationDemoModule::PostResolveSceneColor_RenderThread(FRDGBuilder& GraphBuilder, const FSceneTextures& SceneTexture)
+{
+	if (UseCPUBackend())
+	{
+		return;
+	}
+
+	// Every scene render calls us, so split screen, scene captures and extra editor viewports would each draw the effect again.
+	// The first one in a frame draws it for everyone, since they all sample the same render targets.
+	if (LastScheduledFrameNumber == GFrameNumberRenderThread)
+	{
+		DuplicateInvocationCount++;
+		INC_DWORD_STAT(STAT_ShaderPlugin_DuplicateInvocations);
+		return;
+	}
+	LastScheduledFrameNumber = GFrameNumberRenderThread;
+
+	const double CurrentTime = FPlatformTime::Seconds();
+	switch (Schedule_RenderThread(CurrentTime, true))
+	{
+	case EScheduledWork::Update:
+		Render_RenderThread(GraphBuilder);
+		break;
+	case EScheduledWork::Interpolate:
+		PollReadbacks_RenderThread();
+		RenderInterpolated_RenderThread(GraphBuilder, CurrentTime);
+		break;
+	default:
+		// Copies made by earlier updates finish in between them too, and whoever waits for them shouldn't also have to wait
+		// for the next update.
+		PollReadbacks_RenderThread();
+		break;
+	}
+}
+
+void FShaderDeclarationDemoModule::EndFrame_RenderThread()
+{
+	// This only runs once per frame to begin with, but the update rate still applies.
+	if (UseCPUBackend() && Schedule_RenderThread(FPlatformTime::Seconds(), false) == EScheduledWork::Update)
+	{
+		RenderCPU_RenderThread();
+	}
+}
+
+FShaderDeclarationDemoModule::EScheduledWork FShaderDeclarationDemoModule::Schedule_RenderThread(double CurrentTime, bool bCanInterpolate)
+{
+	const float UpdateRate = CVarShaderPluginUpdateRate.GetValueOnRenderThread();
+	if (UpdateRate <= 0.0f || CurrentTime >= NextUpdateTime)
+	{
+		// Stepping on from the previous deadline keeps the average rate right when it doesn't divide the frame rate, but after
+		// a hitch we start over from now rather than trying to catch up.
+		const double UpdateInterval = UpdateRate > 0.0f ? 1.0 / UpdateRate : 0.0;
+		NextUpdateTime = CurrentTime - NextUpdateTime < UpdateInterval ? NextUpdateTime + UpdateInterval : CurrentTime + UpdateInterval;
+		LastUpdateTime = CurrentTime;
+		return EScheduledWork::Update;
+	}
+
+	SkippedUpdateCount++;
+	INC_DWORD_STAT(STAT_ShaderPlugin_SkippedUpdates);
+	return bCanInterpolate && UseUpdateRateInterpolation() ? EScheduledWork::Interpolate : EScheduledWork::None;
+}
+
+float FShaderDeclarationDemoModule::GetInterpolationAlpha_RenderThread(double CurrentTime) const
+{
+	const float UpdateRate = CVarShaderPluginUpdateRate.GetValueOnRenderThread();
+	return UpdateRate > 0.0f ? FMath::Clamp<float>((CurrentTime - LastUpdateTime) * UpdateRate, 0.0f, 1.0f) : 1.0f;
+}
+
+void FShaderDeclarationDemoModule::RenderFrame_GameThread()
+{
+	check(IsInGameThread());
+
+	PublishInstances_GameThread();
+
+	// Without a scene being rendered there's no graph handed to us, so we make our own.
+	ENQUEUE_RENDER_COMMAND(ShaderPlugin_RenderFrame)([this](FRHICommandListImmediate& RHICmdList)
+	{
+		if (UseCPUBackend())
+		{
+			RenderCPU_RenderThread();
+		}
+		else
+		{
+			FRDGBuilder GraphBuilder(RHICmdList, RDG_EVENT_NAME("ShaderPlugin_RenderFrame"));
+			Render_RenderThread(GraphBuilder);
+			GraphBuilder.Execute();
+		}
+	});
+}
+
+void FShaderDeclarationDemoModule::Render_RenderThread(FRDGBuilder& GraphBuilder)
+{
+	// The read buffer stays untouched by the game thread until we swap it again, so there is no need to copy or lock.
+	FShaderUsageExampleInstancesFrame& InstancesFrame = ConsumeInstances_RenderThread();
+	RenderFrameIndex++;
+
+	PollReadbacks_RenderThread();
+
+	// This has to happen before we pick the intermediate sizes, since it can change the resolution scale.
+	FGPUBudgetController::Update_RenderThread();
+
+	const double CurrentTime = FPlatformTime::Seconds();
+
+	// We hold on to pointers to the render states below, so make sure adding new ones doesn't move the old ones around. States
+	// of instances that are gone are only released after the loop, so there has to be room for every instance on top of them.
+	InstanceRenderStates.Reserve(InstanceRenderStates.Num() + InstancesFrame.Instances.Num());
+
+	const bool bUseFusedCompute = CVarShaderPluginFusedCompute.GetValueOnRenderThread() != 0;
+
+	PendingDraws.Reset();
+	for (FShaderUsageExampleInstance& Instance : InstancesFrame.Instances)
+	{
+		FRHITexture* RenderTargetTexture = GetRenderTargetTexture(Instance.Parameters);
+		if (!RenderTargetTexture)
+		{
+			continue;
+		}
+
+		// The game thread might not have seen the render target get resized yet, so we trust the RHI texture over the parameters.
+		Instance.Parameters.SetRenderTargetSize(RenderTargetTexture->GetSizeXY());
+		if (Instance.Parameters.GetRenderTargetSize().GetMin() <= 0)
+		{
+			continue;
+		}
+
+		bool bNeedsCompute = false;
+		if (FInstanceRenderState* State = PrepareInstanceDraw_RenderThread(Instance, RenderTargetTexture, CurrentTime, bNeedsCompute))
+		{
+			// The fused pass has nowhere to keep the fractal, so the instance gives up its intermediate slice.
+			const bool bFused = bUseFusedCompute && FComputeShaderExample::SupportsFusedComputeShader(RenderTargetTexture);
+			if (bFused)
+			{
+				ReleaseComputeOutputSlice_RenderThread(*State);
+			}
+
+			PendingDraws.Add({ Instance.Handle, &Instance.Parameters, State, GetComputeOutputKey(Instance.Parameters), bNeedsCompute && !bFused, bFused, Instance.bReadback, Instance.bGenerateMips, GetActivePostChain(Instance).Get() });
+		}
+	}
+
+	ReleaseStaleInstanceRenderStates_RenderThread();
+
+	PendingComputes.Reset();
+	for (FPendingDraw& PendingDraw : PendingDraws)
+	{
+		if (!PendingDraw.bNeedsCompute)
+		{
+			continue;
+		}
+
+		if (AcquireComputeOutputSlice_RenderThread(PendingDraw.Handle, *PendingDraw.State, PendingDraw.ComputeOutputKey))
+		{
+			PendingComputes.Add(&PendingDraw);
+		}
+		else
+		{
+			static bool bWarnedAboutSlices = false;
+			if (!bWarnedAboutSlices)
+			{
+				UE_LOG(LogShaderPlugin, Warning, TEXT("More than %d instances render to %dx%d targets, which is more than a texture array can hold. The rest are not drawn."), GMaxTextureArrayLayers, PendingDraw.ComputeOutputKey.Size.X, PendingDraw.ComputeOutputKey.Size.Y);
+				bWarnedAboutSlices = true;
+			}
+		}
+	}
+
+	// Instances sharing an intermediate end up next to each other, and each run of them is computed with one dispatch.
+	Algo::Sort(PendingComputes, [](const FPendingDraw* A, const FPendingDraw* B)
+	{
+		const FComputeOutputKey& KeyA = A->ComputeOutputKey;
+		const FComputeOutputKey& KeyB = B->ComputeOutputKey;
+		if (KeyA.Size.X != KeyB.Size.X)
+		{
+			return KeyA.Size.X < KeyB.Size.X;
+		}
+		return KeyA.Size.Y != KeyB.Size.Y ? KeyA.Size.Y < KeyB.Size.Y : KeyA.Format < KeyB.Format;
+	});
+
+	if (PendingDraws.Num() > 0)
+	{
+		FGPUBudgetController::BeginMeasurement_RenderThread(GraphBuilder);
+	}
+
+	for (int32 BatchStart = 0; BatchStart < PendingComputes.Num();)
+	{
+		int32 BatchEnd = BatchStart + 1;
+		while (BatchEnd < PendingComputes.Num() && PendingComputes[BatchEnd]->ComputeOutputKey == PendingComputes[BatchStart]->ComputeOutputKey)
+		{
+			BatchEnd++;
+		}
+
+		Compute_RenderThread(GraphBuilder, TConstArrayView<FPendingDraw*>(PendingComputes.GetData() + BatchStart, BatchEnd - BatchStart), CurrentTime);
+		BatchStart = BatchEnd;
+	}
+
+	if (PendingDraws.Num() > 0)
+	{
+		DrawFused_RenderThread(GraphBuilder);
+		DrawPending_RenderThread(GraphBuilder, CurrentTime);
+		DrawPostChains_RenderThread(GraphBuilder);
+		GenerateMips_RenderThread(GraphBuilder);
+
+		const bool bHasComputeWork = PendingComputes.Num() > 0 || PendingDraws.ContainsByPredicate([](const FPendingDraw& PendingDraw) { return PendingDraw.bFused; });
+		FGPUBudgetController::EndMeasurement_RenderThread(GraphBuilder, bHasComputeWork);
+
+		EnqueueReadbacks_RenderThread(GraphBuilder, InstancesFrame.FrameNumber);
+	}
+
+	ReleaseIdleComputeOutputs_RenderThread(CurrentTime);
+}
+
+void FShaderDeclarationDemoModule::RenderCPU_RenderThread()
+{
+	FShaderUsageExampleInstancesFrame& InstancesFrame = ConsumeInstances_RenderThread();
+	RenderFrameIndex++;
+
+	// Copies made on the GPU before switching backends still get delivered.
+	PollReadbacks_RenderThread();
+
+	const double CurrentTime = FPlatformTime::Seconds();
+
+	// The CPU backend evaluates both shaders in one go, and skips the fractal by itself when it is blended away.
+	for (FShaderUsageExampleInstance& Instance : InstancesFrame.Instances)
+	{
+		FRHITexture* RenderTargetTexture = GetRenderTargetTexture(Instance.Parameters);
+		if (RenderTargetTexture && !GUsingNullRHI)
+		{
+			Instance.Parameters.SetRenderTargetSize(RenderTargetTexture->GetSizeXY());
+		}
+
+		bool bNeedsCompute = false;
+		if (FInstanceRenderState* State = PrepareInstanceDraw_RenderThread(Instance, RenderTargetTexture, CurrentTime, bNeedsCompute))
+		{
+			DrawCPU_RenderThread(Instance.Parameters, State->CPUOutput);
+
+			// The output is already on the CPU, so there is nothing to copy or wait for.
+			if (Instance.bReadback && State->CPUOutput.Num() > 0)
+			{
+				FShaderUsageExampleReadback Readback;
+				Readback.Handle = Instance.Handle;
+				Readback.FrameNumber = InstancesFrame.FrameNumber;
+				Readback.Size = Instance.Parameters.GetRenderTargetSize();
+				Readback.Format = PF_B8G8R8A8;
+				Readback.Data = (const uint8*)State->CPUOutput.GetData();
+				Readback.RowPitch = Readback.Size.X * sizeof(FColor);
+				OnReadbackDelegate.Broadcast(Readback);
+			}
+		}
+	}
+
+	ReleaseStaleInstanceRenderStates_RenderThread();
+}
+
+void FShaderDeclarationDemoModule::RenderInterpolated_RenderThread(FRDGBuilder& GraphBuilder, double CurrentTime)
+{
+	// We still pick up the latest instances, so the ones we fade are drawn with their latest colors. Everything else, including
+	// an instance whose colors changed but whose fractal didn't, keeps what it showed until the next update.
+	FShaderUsageExampleInstancesFrame& InstancesFrame = ConsumeInstances_RenderThread();
+	const float InterpolationAlpha = GetInterpolationAlpha_RenderThread(CurrentTime);
+
+	QUICK_SCOPE_CYCLE_COUNTER(STAT_ShaderPlugin_RenderInterpolated); // Used to gather CPU profiling data for the UE4 session frontend
+	RDG_EVENT_SCOPE(GraphBuilder, "ShaderPlugin_RenderInterpolated"); // Used to profile GPU activity and add metadata to be consumed by for example RenderDoc
+	RDG_GPU_STAT_SCOPE(GraphBuilder, ShaderPlugin_Render);
+	RDG_GPU_STAT_SCOPE(GraphBuilder, ShaderPlugin_Pixel);
+
+	for (FShaderUsageExampleInstance& Instance : InstancesFrame.Instances)
+	{
+		// Only instances whose last update changed the fractal have anything to fade. The rest stay as they were drawn.
+		FInstanceRenderState* State = InstanceRenderStates.Find(Instance.Handle);
+		if (!State || !State->bHistoryValid || !State->bComputeOutputValid || !Instance.bVisible || Instance.Parameters.ComputeShaderBlend == 0.0f)
+		{
+			continue;
+		}
+
+		FRHITexture* RenderTargetTexture = GetRenderTargetTexture(Instance.Parameters);
+		FComputeOutputArray* ComputeOutputArray = ComputeOutputArrays.Find(State->ComputeOutputKey);
+		if (!RenderTargetTexture || RenderTargetTexture != State->LastDrawnTexture || !ComputeOutputArray || !ComputeOutputArray->HistoryPooledTexture.IsValid())
+		{
+			continue;
+		}
+
+		Instance.Parameters.SetRenderTargetSize(RenderTargetTexture->GetSizeXY());
+		ComputeOutputArray->LastUsedTime = CurrentTime;
+		FRDGTextureRef OutputTexture = AddOutputPass(GraphBuilder, Instance.Parameters, GraphBuilder.RegisterExternalTexture(ComputeOutputArray->PooledTexture),
+			GraphBuilder.RegisterExternalTexture(ComputeOutputArray->HistoryPooledTexture), InterpolationAlpha, State->ComputeOutputSlice);
+
+		if (const FShaderPluginPostChain* PostChain = GetActivePostChain(Instance).Get())
+		{
+			RDG_GPU_STAT_SCOPE(GraphBuilder, ShaderPlugin_PostChain);
+			PostChain->AddPasses_RenderThread(GraphBuilder, OutputTexture);
+			INC_DWORD_STAT_BY(STAT_ShaderPlugin_PostChainIntermediates, PostChain->GetNumIntermediates());
+		}
+
+		if (Instance.bGenerateMips && CVarShaderPluginGenerateMips.GetValueOnRenderThread() != 0 && FMipChainGenerator::SupportsMipGeneration(RenderTargetTexture))
+		{
+			RDG_GPU_STAT_SCOPE(GraphBuilder, ShaderPlugin_GenerateMips);
+			FMipChainGenerator::GenerateMips_RenderThread(GraphBuilder, OutputTexture);
+		}
+
+		// The fade changes what's on screen, so whoever reads the instance back should get it too.
+		if (Instance.bReadback)
+		{
+			RDG_EVENT_SCOPE(GraphBuilder, "ShaderPlugin_Readback");
+			EnqueueReadback_RenderThread(GraphBuilder, Instance.Handle, InstancesFrame.FrameNumber, OutputTexture);
+		}
+
+		// Once the fade is done, the render target shows the latest compute and there's nothing left to blend until the next one.
+		if (InterpolationAlpha >= 1.0f)
+		{
+			State->bHistoryValid = false;
+		}
+	}
+}
+
+void FShaderDeclarationDemoModule::Compute_RenderThread(FRDGBuilder& GraphBuilder, TConstArrayView<FPendingDraw*> Batch, double CurrentTime)
+{
+	check(IsInRenderingThread());
+
+	const FComputeOutputKey& Key = Batch[0]->ComputeOutputKey;
+
+	QUICK_SCOPE_CYCLE_COUNTER(STAT_ShaderPlugin_Render); // Used to gather CPU profiling data for the UE4 session frontend
+	RDG_EVENT_SCOPE(GraphBuilder, "ShaderPlugin_Render %dx%d (%d instances)", Key.Size.X, Key.Size.Y, Batch.Num()); // Used to profile GPU activity and add metadata to be consumed by for example RenderDoc
+	RDG_GPU_STAT_SCOPE(GraphBuilder, ShaderPlugin_Render);
+
+	FComputeOutputArray& ComputeOutputArray = ComputeOutputArrays.FindChecked(Key);
+	FRDGTextureRef ComputeShaderOutput = GetComputeOutputTexture_RenderThread(GraphBuilder, Key, ComputeOutputArray);
+	ComputeOutputArray.LastUsedTime = CurrentTime;
+
+	// Between updates, the pixel pass fades from what the intermediate holds now to what we're about to compute.
+	const bool bInterpolate = UseUpdateRateInterpolation();
+	if (bInterpolate)
+	{
+		UpdateComputeOutputHistory_RenderThread(GraphBuilder, ComputeShaderOutput, ComputeOutputArray);
+	}
+	else if (ComputeOutputArray.HistoryPooledTexture.IsValid())
+	{
+		ComputeOutputArray.HistoryPooledTexture.SafeRelease();
+		UpdateIntermediateMemoryStats_RenderThread();
+	}
+
+	// With amortization, the slices that have nothing to build on or jumped too far are computed in full, and the rest only
+	// compute the next pixel of every block. Those need differently sized dispatches, so they go in two batches.
+	const int32 AmortizeFactor = GetAmortizeFactor();
+	const float ResetThreshold = CVarShaderPluginAmortizeResetThreshold.GetValueOnRenderThread();
+	const int32 Quality = FComputeShaderExample::GetQuality();
+	const bool bHalfPrecision = FComputeShaderExample::UseHalfPrecision();
+
+	TArray<FComputeShaderSliceParameters, TInlineAllocator<16>> FullSlices;
+	TArray<FComputeShaderSliceParameters, TInlineAllocator<16>> AmortizedSlices;
+	for (FPendingDraw* PendingDraw : Batch)
+	{
+		FInstanceRenderState& State = *PendingDraw->State;
+		const float SimulationState = PendingDraw->Parameters->SimulationState;
+
+		const bool bReset = AmortizeFactor == 1
+			|| !State.bComputeOutputValid
+			|| State.AmortizeFactor != AmortizeFactor
+			|| State.ComputedQuality != Quality
+			|| State.bComputedHalfPrecision != bHalfPrecision
+			|| FMath::Abs(SimulationState - State.ComputedSimulationState) > ResetThreshold;
+
+		FComputeShaderSliceParameters Slice;
+		Slice.SimulationState = SimulationState;
+		Slice.SliceIndex = State.ComputeOutputSlice;
+		if (bReset)
+		{
+			Slice.AmortizeOffset = 0;
+			FullSlices.Add(Slice);
+
+			State.AmortizeFactor = AmortizeFactor;
+			State.AmortizePhase = 0;
+			State.NumAmortizePhasesAtComputedState = AmortizeFactor;
+		}
+		else
+		{
+			State.AmortizePhase = (State.AmortizePhase + 1) % AmortizeFactor;
+			State.NumAmortizePhasesAtComputedState = SimulationState == State.ComputedSimulationState ? State.NumAmortizePhasesAtComputedState + 1 : 1;
+
+			Slice.AmortizeOffset = FComputeShaderExample::GetAmortizeOffset(AmortizeFactor, State.AmortizePhase);
+			AmortizedSlices.Add(Slice);
+		}
+
+		State.bHistoryValid = bInterpolate && State.bComputeOutputValid;
+		State.ComputedSimulationState = SimulationState;
+		State.ComputedQuality = Quality;
+		State.bComputedHalfPrecision = bHalfPrecision;
+		State.bComputeOutputValid = true;
+	}
+
+	// On the async compute pipe, the dispatch overlaps with the graphics work the renderer adds to the graph after this callback.
+	// The graph inserts the fork and join fences between the pipes itself, since the pixel passes read ComputeShaderOutput.
+	RDG_GPU_STAT_SCOPE(GraphBuilder, ShaderPlugin_Compute);
+	if (FullSlices.Num() > 0)
+	{
+		FComputeShaderExample::RunComputeShader_RenderThread(GraphBuilder, Key.Size, FIntPoint(1, 1), FullSlices, ComputeShaderOutput, GetComputePassFlags());
+	}
+	if (AmortizedSlices.Num() > 0)
+	{
+		FComputeShaderExample::RunComputeShader_RenderThread(GraphBuilder, Key.Size, FComputeShaderExample::GetAmortizeCell(AmortizeFactor), AmortizedSlices, ComputeShaderOutput, GetComputePassFlags());
+	}
+}
+
+void FShaderDeclarationDemoModule::DrawFused_RenderThread(FRDGBuilder& GraphBuilder)
+{
+	check(IsInRenderingThread());
+
+	QUICK_SCOPE_CYCLE_COUNTER(STAT_ShaderPlugin_RenderFused); // Used to gather CPU profiling data for the UE4 session frontend
+	RDG_EVENT_SCOPE(GraphBuilder, "ShaderPlugin_RenderFused"); // Used to profile GPU activity and add metadata to be consumed by for example RenderDoc
+	RDG_GPU_STAT_SCOPE(GraphBuilder, ShaderPlugin_Render);
+	RDG_GPU_STAT_SCOPE(GraphBuilder, ShaderPlugin_Fused);
+
+	for (FPendingDraw& PendingDraw : PendingDraws)
+	{
+		if (PendingDraw.bFused)
+		{
+			// Same as in AddOutputPass, except the render target is written as a UAV.
+			FRDGTextureRef RenderTargetTexture = RegisterExternalTexture(GraphBuilder, GetRenderTargetTexture(*PendingDraw.Parameters), TEXT("ShaderPlugin_RenderTarget"));
+			FComputeShaderExample::RunFusedComputeShader_RenderThread(GraphBuilder, *PendingDraw.Parameters, RenderTargetTexture, GetComputePassFlags());
+			PendingDraw.State->ComputedQuality = FComputeShaderExample::GetQuality();
+			PendingDraw.State->bComputedHalfPrecision = FComputeShaderExample::UseHalfPrecision();
+			GraphBuilder.SetTextureAccessFinal(RenderTargetTexture, ERHIAccess::SRVMask);
+			PendingDraw.OutputTexture = RenderTargetTexture;
+		}
+	}
+}
+
+void FShaderDeclarationDemoModule::DrawPending_RenderThread(FRDGBuilder& GraphBuilder, double CurrentTime)
+{
+	check(IsInRenderingThread());
+
+	QUICK_SCOPE_CYCLE_COUNTER(STAT_ShaderPlugin_RenderPixel); // Used to gather CPU profiling data for the UE4 session frontend
+	RDG_EVENT_SCOPE(GraphBuilder, "ShaderPlugin_RenderPixel (%d instances)", PendingDraws.Num()); // Used to profile GPU activity and add metadata to be consumed by for example RenderDoc
+	RDG_GPU_STAT_SCOPE(GraphBuilder, ShaderPlugin_Render);
+	RDG_GPU_STAT_SCOPE(GraphBuilder, ShaderPlugin_Pixel);
+
+	FRDGTextureRef DummyComputeShaderOutput = nullptr;
+	for (FPendingDraw& PendingDraw : PendingDraws)
+	{
+		FInstanceRenderState& State = *PendingDraw.State;
+		if (PendingDraw.bFused)
+		{
+			continue;
+		}
+
+		if (PendingDraw.Parameters->ComputeShaderBlend == 0.0f)
+		{
+			// The pixel shader still needs something bound, but the value read from it gets multiplied by zero.
+			if (!DummyComputeShaderOutput)
+			{
+				FRDGTextureDesc DummyDesc = FRDGTextureDesc::Create2DArray(FIntPoint(1, 1), PF_R32_UINT, FClearValueBinding::None, TexCreate_ShaderResource | TexCreate_UAV, 1);
+				DummyComputeShaderOutput = GraphBuilder.CreateTexture(DummyDesc, TEXT("ShaderPlugin_DummyComputeShaderOutput"));
+				const uint32 ClearValues[4] = { 0, 0, 0, 0 };
+				AddClearUAVPass(GraphBuilder, GraphBuilder.CreateUAV(DummyComputeShaderOutput), ClearValues);
+			}
+
+			PendingDraw.OutputTexture = AddOutputPass(GraphBuilder, *PendingDraw.Parameters, DummyComputeShaderOutput, nullptr, 0.0f, 0);
+			continue;
+		}
+
+		// This happens when the intermediate was full. We'll try again next frame.
+		FComputeOutputArray* ComputeOutputArray = State.bComputeOutputValid ? ComputeOutputArrays.Find(State.ComputeOutputKey) : nullptr;
+		if (!ComputeOutputArray)
+		{
+			State.bHasDrawn = false;
+			continue;
+		}
+
+		// Right after an update that recomputed it, an instance that is being faded still shows the previous compute. One that
+		// is only redrawn for its colors skips the rest of any fade it was in, rather than starting over from an older compute.
+		FRDGTextureRef PreviousComputeShaderOutput = nullptr;
+		if (PendingDraw.bNeedsCompute && State.bHistoryValid && ComputeOutputArray->HistoryPooledTexture.IsValid())
+		{
+			PreviousComputeShaderOutput = GraphBuilder.RegisterExternalTexture(ComputeOutputArray->HistoryPooledTexture);
+		}
+		else
+		{
+			State.bHistoryValid = false;
+		}
+
+		ComputeOutputArray->LastUsedTime = CurrentTime;
+		PendingDraw.OutputTexture = AddOutputPass(GraphBuilder, *PendingDraw.Parameters, GraphBuilder.RegisterExternalTexture(ComputeOutputArray->PooledTexture),
+			PreviousComputeShaderOutput, 0.0f, State.ComputeOutputSlice);
+	}
+}
+
+void FShaderDeclarationDemoModule::DrawPostChains_RenderThread(FRDGBuilder& GraphBuilder)
+{
+	check(IsInRenderingThread());
+
+	QUICK_SCOPE_CYCLE_COUNTER(STAT_ShaderPlugin_RenderPostChains); // Used to gather CPU profiling data for the UE4 session frontend
+	RDG_EVENT_SCOPE(GraphBuilder, "ShaderPlugin_PostChains"); // Used to profile GPU activity and add metadata to be consumed by for example RenderDoc
+	RDG_GPU_STAT_SCOPE(GraphBuilder, ShaderPlugin_Render);
+	RDG_GPU_STAT_SCOPE(GraphBuilder, ShaderPlugin_PostChain);
+
+	for (const FPendingDraw& PendingDraw : PendingDraws)
+	{
+		// Every chain allocates its own intermediates, but they only live until its last stage, so the graph can give the
+		// same memory to the next chain.
+		if (PendingDraw.PostChain && PendingDraw.OutputTexture)
+		{
+			PendingDraw.PostChain->AddPasses_RenderThread(GraphBuilder, PendingDraw.OutputTexture);
+			INC_DWORD_STAT_BY(STAT_ShaderPlugin_PostChainIntermediates, PendingDraw.PostChain->GetNumIntermediates());
+		}
+	}
+}
+
+void FShaderDeclarationDemoModule::GenerateMips_RenderThread(FRDGBuilder& GraphBuilder)
+{
+	check(IsInRenderingThread());
+
+	if (CVarShaderPluginGenerateMips.GetValueOnRenderThread() == 0)
+	{
+		return;
+	}
+
+	RDG_EVENT_SCOPE(GraphBuilder, "ShaderPlugin_GenerateMips"); // Used to profile GPU activity and add metadata to be consumed by for example RenderDoc
+	RDG_GPU_STAT_SCOPE(GraphBuilder, ShaderPlugin_Render);
+	RDG_GPU_STAT_SCOPE(GraphBuilder, ShaderPlugin_GenerateMips);
+
+	for (const FPendingDraw& PendingDraw : PendingDraws)
+	{
+		// Draws that were skipped this frame have no output, and their mips are still good from last time.
+		if (PendingDraw.bGenerateMips && PendingDraw.OutputTexture && FMipChainGenerator::SupportsMipGeneration(GetRenderTargetTexture(*PendingDraw.Parameters)))
+		{
+			FMipChainGenerator::GenerateMips_RenderThread(GraphBuilder, PendingDraw.OutputTexture);
+		}
+	}
+}
+
+void FShaderDeclarationDemoModule::DrawCPU_RenderThread(const FShaderUsageExampleParameters& DrawParameters, TArray<FColor>& CPUOutput)
 {
 	check(IsInRenderingThread());
 
@@ -105,18 +1382,171 @@ void FShaderDeclarationDemoModule::Draw_RenderThread(const FShaderUsageExamplePa
 		return;
 	}
 
+	QUICK_SCOPE_CYCLE_COUNTER(STAT_ShaderPlugin_RenderCPU); // Used to gather CPU profiling data for the UE4 session frontend
+
+	// Without an RHI there is no texture to upload to, so the frame only lives in CPUOutput.
+	FTextureRenderTargetResource* RenderTargetResource = DrawParameters.RenderTarget->GetRenderTargetResource();
+	FRHITexture2D* RenderTargetTexture = RenderTargetResource ? RenderTargetResource->GetRenderTargetTexture() : nullptr;
+	const bool bSRGB = RenderTargetTexture && EnumHasAnyFlags(RenderTargetTexture->GetFlags(), TexCreate_SRGB);
+
+	const FIntPoint Size = DrawParameters.GetRenderTargetSize();
+	CPUOutput.SetNumUninitialized(Size.X * Size.Y);
+	FCPUShaderExample::RenderToBuffer_AnyThread(DrawParameters, Size, FIntRect(FIntPoint::ZeroValue, Size), bSRGB, CPUOutput.GetData(), Size.X);
+
+	if (!RenderTargetTexture || GUsingNullRHI || RenderTargetTexture->GetSizeXY() != Size)
+	{
+		return;
+	}
+
 	FRHICommandListImmediate& RHICmdList = GRHICommandList.GetImmediateCommandList();
+	const FUpdateTextureRegion2D UpdateRegion(0, 0, 0, 0, Size.X, Size.Y);
 
-	QUICK_SCOPE_CYCLE_COUNTER(STAT_ShaderPlugin_Render); // Used to gather CPU profiling data for the UE4 session frontend
-	SCOPED_DRAW_EVENT(RHICmdList, ShaderPlugin_Render); // Used to profile GPU activity and add metadata to be consumed by for example RenderDoc
+	// The kernel writes BGRA8, which is what render targets use by default. We convert for the other common formats.
+	switch (RenderTargetTexture->GetFormat())
+	{
+	case PF_B8G8R8A8:
+		RHICmdList.UpdateTexture2D(RenderTargetTexture, 0, UpdateRegion, Size.X * sizeof(FColor), (const uint8*)CPUOutput.GetData());
+		break;
+
+	case PF_R8G8B8A8:
+		{
+			TArray<FColor> Swizzled;
+			Swizzled.SetNumUninitialized(CPUOutput.Num());
+			for (int32 PixelIndex = 0; PixelIndex < CPUOutput.Num(); PixelIndex++)
+			{
+				const FColor& Pixel = CPUOutput[PixelIndex];
+				Swizzled[PixelIndex] = FColor(Pixel.B, Pixel.G, Pixel.R, Pixel.A);
+			}
+			RHICmdList.UpdateTexture2D(RenderTargetTexture, 0, UpdateRegion, Size.X * sizeof(FColor), (const uint8*)Swizzled.GetData());
+		}
+		break;
 
-	if (!ComputeShaderOutput.IsValid())
+	case PF_FloatRGBA:
+		{
+			TArray<FFloat16Color> Converted;
+			Converted.SetNumUninitialized(CPUOutput.Num());
+			for (int32 PixelIndex = 0; PixelIndex < CPUOutput.Num(); PixelIndex++)
+			{
+				Converted[PixelIndex] = FFloat16Color(CPUOutput[PixelIndex].ReinterpretAsLinear());
+			}
+			RHICmdList.UpdateTexture2D(RenderTargetTexture, 0, UpdateRegion, Size.X * sizeof(FFloat16Color), (const uint8*)Converted.GetData());
+		}
+		break;
+
+	default:
+		{
+			static bool bWarnedAboutFormat = false;
+			if (!bWarnedAboutFormat)
+			{
+				UE_LOG(LogShaderPlugin, Warning, TEXT("The CPU backend can't upload to render targets with pixel format %s."), GPixelFormats[RenderTargetTexture->GetFormat()].Name);
+				bWarnedAboutFormat = true;
+			}
+		}
+		break;
+	}
+}
+
+void FShaderDeclarationDemoModule::EnqueueReadbacks_RenderThread(FRDGBuilder& GraphBuilder, uint64 FrameNumber)
+{
+	check(IsInRenderingThread());
+
+	if (!PendingDraws.ContainsByPredicate([](const FPendingDraw& PendingDraw) { return PendingDraw.bReadback && PendingDraw.OutputTexture; }))
 	{
-		FPooledRenderTargetDesc ComputeShaderOutputDesc(FPooledRenderTargetDesc::Create2DDesc(DrawParameters.GetRenderTargetSize(), PF_R32_UINT, FClearValueBinding::None, TexCreate_None, TexCreate_ShaderResource | TexCreate_UAV, false));
-		ComputeShaderOutputDesc.DebugName = TEXT("ShaderPlugin_ComputeShaderOutput");
-		GRenderTargetPool.FindFreeElement(RHICmdList, ComputeShaderOutputDesc, ComputeShaderOutput, TEXT("ShaderPlugin_ComputeShaderOutput"));
+		return;
 	}
 
-	FComputeShaderExample::RunComputeShader_RenderThread(RHICmdList, DrawParameters, ComputeShaderOutput->GetRenderTargetItem().UAV);
-	FPixelShaderExample::DrawToRenderTarget_RenderThread(RHICmdList, DrawParameters, ComputeShaderOutput->GetRenderTargetItem().TargetableTexture);
+	RDG_EVENT_SCOPE(GraphBuilder, "ShaderPlugin_Readback");
+
+	for (const FPendingDraw& PendingDraw : PendingDraws)
+	{
+		if (PendingDraw.bReadback && PendingDraw.OutputTexture)
+		{
+			EnqueueReadback_RenderThread(GraphBuilder, PendingDraw.Handle, FrameNumber, PendingDraw.OutputTexture);
+		}
+	}
+}
+
+void FShaderDeclarationDemoModule::EnqueueReadback_RenderThread(FRDGBuilder& GraphBuilder, FShaderUsageExampleHandle Handle, uint64 FrameNumber, FRDGTextureRef OutputTexture)
+{
+	check(IsInRenderingThread());
+
+	// The ring only changes size once all of its copies have landed, so the slots stay in the order they were filled.
+	const int32 NumSlots = FMath::Max(CVarShaderPluginReadbackNumSlots.GetValueOnRenderThread(), 1);
+	if (ReadbackSlots.Num() != NumSlots && !ReadbackSlots.ContainsByPredicate([](const FReadbackSlot& Slot) { return Slot.bInFlight; }))
+	{
+		ReadbackSlots.Reset();
+		ReadbackSlots.SetNum(NumSlots);
+		NextReadbackSlot = 0;
+	}
+
+	// Waiting for the slot to free up would stall the render thread on the GPU, so we skip this frame instead.
+	FReadbackSlot& Slot = ReadbackSlots[NextReadbackSlot];
+	if (Slot.bInFlight)
+	{
+		DroppedReadbackCount++;
+		INC_DWORD_STAT(STAT_ShaderPlugin_DroppedReadbacks);
+		return;
+	}
+
+	if (!Slot.Readback)
+	{
+		Slot.Readback = MakeUnique<FRHIGPUTextureReadback>(TEXT("ShaderPlugin_Readback"));
+	}
+
+	Slot.Handle = Handle;
+	Slot.FrameNumber = FrameNumber;
+	Slot.Size = OutputTexture->Desc.Extent;
+	Slot.Format = OutputTexture->Desc.Format;
+	Slot.bInFlight = true;
+
+	AddEnqueueCopyPass(GraphBuilder, Slot.Readback.Get(), OutputTexture);
+	NextReadbackSlot = (NextReadbackSlot + 1) % ReadbackSlots.Num();
+}
+
+void FShaderDeclarationDemoModule::PollReadbacks_RenderThread()
+{
+	check(IsInRenderingThread());
+
+	// NextReadbackSlot is the next one to be filled, which makes it the oldest one still in flight.
+	for (int32 Offset = 0; Offset < ReadbackSlots.Num(); Offset++)
+	{
+		FReadbackSlot& Slot = ReadbackSlots[(NextReadbackSlot + Offset) % ReadbackSlots.Num()];
+		if (!Slot.bInFlight)
+		{
+			continue;
+		}
+
+		// The copies finish in the order they were made, so once one isn't ready the ones after it won't be either.
+		if (!Slot.Readback->IsReady())
+		{
+			break;
+		}
+
+		void* Data = nullptr;
+		int32 RowPitchInPixels = 0;
+		Slot.Readback->LockTexture(GRHICommandList.GetImmediateCommandList(), Data, RowPitchInPixels);
+		if (Data)
+		{
+			FShaderUsageExampleReadback Readback;
+			Readback.Handle = Slot.Handle;
+			Readback.FrameNumber = Slot.FrameNumber;
+			Readback.Size = Slot.Size;
+			Readback.Format = Slot.Format;
+			Readback.Data = (const uint8*)Data;
+			Readback.RowPitch = RowPitchInPixels * GPixelFormats[Slot.Format].BlockBytes;
+			OnReadbackDelegate.Broadcast(Readback);
+		}
+
+		Slot.Readback->Unlock();
+		Slot.bInFlight = false;
+	}
+}
+
+void FShaderDeclarationDemoModule::ReleaseReadbacks_RenderThread()
+{
+	check(IsInRenderingThread());
+
+	// Copies still in flight are thrown away. Nobody is drawing anymore, so nobody is waiting for them.
+	ReadbackSlots.Empty();
+	NextReadbackSlot = 0;
 }
@@ -0,0 +1,129 @@
+// Copyright 2016-2020 Cadic AB. All Rights Reserved.
+// @Author	Fredrik Lindh [Temaran] (temaran@gmail.com) {https://github.com/Temaran}
+///////////////////////////////////////////////////////////////////////////////////////
+
+#include "ShaderPluginFlipbookBaker.h"
+
+#include "ComputeShaderExample.h"
+#include "CPUShaderExample.h"
+#include "OfflineReadbackPipeline.h"
+
+#include "Async/ParallelFor.h"
+#include "RenderGraphBuilder.h"
+
+DEFINE_LOG_CATEGORY_STATIC(LogShaderPluginFlipbook, Log, All);
+
+// How many frames the GPU may work on ahead of the one we're reading back.
+#define NUM_GPU_FRAMES_IN_FLIGHT 3
+
+namespace
+{
+	void RenderImagesOnCPU(const FShaderUsageExampleParameters& BaseParameters, FIntPoint Size, TConstArrayView<float> Times, TArray<TArray<FColor>>& OutImages)
+	{
+		// RenderToBuffer_AnyThread already spreads each image over every core.
+		for (int32 ImageIndex = 0; ImageIndex < Times.Num(); ImageIndex++)
+		{
+			FShaderUsageExampleParameters Parameters = BaseParameters;
+			Parameters.SimulationState = Times[ImageIndex];
+
+			OutImages[ImageIndex].SetNumUninitialized(Size.X * Size.Y);
+			FCPUShaderExample::RenderToBuffer_AnyThread(Parameters, Size, FIntRect(FIntPoint::ZeroValue, Size), true, OutImages[ImageIndex].GetData(), Size.X);
+		}
+	}
+
+	void RenderImagesOnGPU(const FShaderUsageExampleParameters& BaseParameters, FIntPoint Size, TConstArrayView<float> Times, TArray<TArray<FColor>>& OutImages)
+	{
+		FOfflineReadbackPipeline::Run(Times.Num(), NUM_GPU_FRAMES_IN_FLIGHT,
+			[&BaseParameters, Times, Size](FRDGBuilder& GraphBuilder, int32 ImageIndex)
+			{
+				FShaderUsageExampleParameters Parameters = BaseParameters;
+				Parameters.SimulationState = Times[ImageIndex];
+
+				const FRDGTextureDesc FrameDesc = FRDGTextureDesc::Create2D(Size, PF_R8G8B8A8, FClearValueBinding::None, TexCreate_ShaderResource | TexCreate_UAV);
+				FRDGTextureRef FrameTexture = GraphBuilder.CreateTexture(FrameDesc, TEXT("ShaderPlugin_FlipbookFrame"));
+				FComputeShaderExample::RunFusedComputeShaderTile_RenderThread(GraphBuilder, Parameters, Size, FIntPoint::ZeroValue, true, FrameTexture);
+				return FrameTexture;
+			},
+			[&OutImages, Size](int32 ImageIndex, const void* Data, int32 RowPitchInPixels)
+			{
+				// The GPU wrote RGBA, while FColor is laid out as BGRA.
+				TArray<FColor>& Image = OutImages[ImageIndex];
+				Image.SetNumUninitialized(Size.X * Size.Y);
+				for (int32 Y = 0; Y < Size.Y && Data; Y++)
+				{
+					const uint8* Source = (const uint8*)Data + (int64)Y * RowPitchInPixels * 4;
+					FColor* Destination = Image.GetData() + Y * Size.X;
+					for (int32 X = 0; X < Size.X; X++, Source += 4)
+					{
+						Destination[X] = FColor(Source[0], Source[1], Source[2], Source[3]);
+					}
+				}
+			});
+	}
+}
+
+bool FShaderPluginFlipbookBaker::BakeFrames(const FShaderPluginFlipbookSettings& Settings, TArray<TArray<FColor>>& OutFrames, FShaderPluginFlipbookStats& OutStats)
+{
+	check(IsInGameThread());
+
+	OutFrames.Reset();
+	OutStats = FShaderPluginFlipbookStats();
+
+	if (Settings.FrameSize.GetMin() <= 0 || Settings.NumFrames <= 0 || Settings.LoopPeriod <= 0.0f)
+	{
+		UE_LOG(LogShaderPluginFlipbook, Error, TEXT("Can't bake %d frames of %dx%d over a loop period of %f."), Settings.NumFrames, Settings.FrameSize.X, Settings.FrameSize.Y, Settings.LoopPeriod);
+		return false;
+	}
+
+	// The frames sit at the start of their slice of the loop, so the last one is a frame's length from wrapping around.
+	// With bSeamlessLoop, the second half of Times is the same sweep a loop period earlier.
+	TArray<float> Times;
+	for (int32 FrameIndex = 0; FrameIndex < Settings.NumFrames; FrameIndex++)
+	{
+		Times.Add(Settings.StartTime + Settings.LoopPeriod * FrameIndex / Settings.NumFrames);
+	}
+	if (Settings.bSeamlessLoop)
+	{
+		for (int32 FrameIndex = 0; FrameIndex < Settings.NumFrames; FrameIndex++)
+		{
+			Times.Add(Times[FrameIndex] - Settings.LoopPeriod);
+		}
+	}
+
+	const double StartTime = FPlatformTime::Seconds();
+
+	TArray<TArray<FColor>> Images;
+	Images.SetNum(Times.Num());
+	OutStats.bUsedGPU = Settings.bUseGPU && FComputeShaderExample::SupportsOfflineFusedComputeShader(PF_R8G8B8A8);
+	if (OutStats.bUsedGPU)
+	{
+		RenderImagesOnGPU(Settings.Parameters, Settings.FrameSize, Times, Images);
+	}
+	else
+	{
+		RenderImagesOnCPU(Settings.Parameters, Settings.FrameSize, Times, Images);
+	}
+
+	if (Settings.bSeamlessLoop)
+	{
+		// Fading from the frame at t to the one at t - LoopPeriod over the loop means the last frame runs straight
+		// into the first one. The fade is done in linear space, so the mid-point isn't darker than either end.
+		ParallelFor(Settings.NumFrames, [&Settings, &Images](int32 FrameIndex)
+		{
+			const float Alpha = (float)FrameIndex / Settings.NumFrames;
+			TArray<FColor>& Frame = Images[FrameIndex];
+			const TArray<FColor>& PreviousLoopFrame = Images[Settings.NumFrames + FrameIndex];
+			for (int32 PixelIndex = 0; PixelIndex < Frame.Num(); PixelIndex++)
+			{
+				Frame[PixelIndex] = FMath::Lerp(FLinearColor(Frame[PixelIndex]), FLinearColor(PreviousLoopFrame[PixelIndex]), Alpha).ToFColor(true);
+			}
+		});
+	}
+
+	OutStats.BakeSeconds = FPlatformTime::Seconds() - StartTime;
+	OutStats.NumEvaluatedPixels = (int64)Settings.FrameSize.X * Settings.FrameSize.Y * Times.Num();
+
+	Images.SetNum(Settings.NumFrames);
+	OutFrames = MoveTemp(Images);
+	return true;
+}
@@ -0,0 +1,357 @@
+// Copyright 2016-2020 Cadic AB. All Rights Reserved.
+// @Author	Fredrik Lindh [Temaran] (temaran@gmail.com) {https://github.com/Temaran}
+///////////////////////////////////////////////////////////////////////////////////////
+
+#include "ShaderPluginFrameEncoder.h"
+
+#include "HAL/Event.h"
+#include "HAL/FileManager.h"
+#include "HAL/IConsoleManager.h"
+#include "HAL/PlatformProcess.h"
+#include "IImageWrapper.h"
+#include "IImageWrapperModule.h"
+#include "Misc/Paths.h"
+#include "Misc/QueuedThreadPool.h"
+#include "Misc/ScopeLock.h"
+#include "RenderingThread.h"
+
+DEFINE_LOG_CATEGORY_STATIC(LogShaderPluginEncoder, Log, All);
+
+static FCriticalSection SharedThreadPoolCriticalSection;
+static FQueuedThreadPool* SharedThreadPool = nullptr;
+static int32 SharedThreadPoolNumUsers = 0;
+
+static int32 GetNumSharedThreadPoolThreads()
+{
+	return FMath::Max(FPlatformMisc::NumberOfCoresIncludingHyperthreads() - 2, 1);
+}
+
+static bool IsSupportedFrameFormat(EPixelFormat Format)
+{
+	return Format == PF_B8G8R8A8 || Format == PF_R8G8B8A8 || Format == PF_FloatRGBA;
+}
+
+// Encodes a single frame on one of the pool's threads, and hands the frame back to the encoder when done.
+class FShaderPluginFrameEncoder::FEncodeWork : public IQueuedWork
+{
+public:
+	FEncodeWork(FShaderPluginFrameEncoder& InEncoder, FFrame* InFrame)
+		: Encoder(InEncoder)
+		, Frame(InFrame)
+	{ }
+
+	virtual void DoThreadedWork() override
+	{
+		Encoder.EncodeFrame_AnyThread(*Frame);
+		Encoder.ReleaseFrame(Frame);
+		delete this;
+	}
+
+	virtual void Abandon() override
+	{
+		Encoder.NumDroppedFrames++;
+		Encoder.ReleaseFrame(Frame);
+		delete this;
+	}
+
+private:
+	FShaderPluginFrameEncoder& Encoder;
+	FFrame* Frame;
+};
+
+FShaderPluginFrameEncoder::FShaderPluginFrameEncoder(const FShaderPluginFrameEncoderSettings& InSettings)
+	: Settings(InSettings)
+	, NumFramesInFlight(0)
+	, NextSequenceIndex(0)
+	, NumEncodedFrames(0)
+	, NumDroppedFrames(0)
+	, NumFailedFrames(0)
+{
+	if (Settings.MaxQueuedFrames <= 0)
+	{
+		Settings.MaxQueuedFrames = GetNumSharedThreadPoolThreads() * 2;
+	}
+
+	// Modules can only be loaded on the game thread, so we do it here rather than on the workers.
+	ImageWrapperModule = &FModuleManager::LoadModuleChecked<IImageWrapperModule>(TEXT("ImageWrapper"));
+
+	IFileManager::Get().MakeDirectory(*Settings.OutputDirectory, true);
+
+	FrameReleasedEvent = FPlatformProcess::GetSynchEventFromPool(false);
+	AcquireThreadPool();
+}
+
+FShaderPluginFrameEncoder::~FShaderPluginFrameEncoder()
+{
+	Detach();
+	Flush();
+
+	ReleaseThreadPool();
+	FPlatformProcess::ReturnSynchEventToPool(FrameReleasedEvent);
+}
+
+void FShaderPluginFrameEncoder::Attach(FShaderUsageExampleHandle Handle)
+{
+	check(IsInGameThread());
+
+	Detach();
+
+	FShaderDeclarationDemoModule& ShaderModule = FShaderDeclarationDemoModule::Get();
+	ShaderModule.SetReadbackEnabled(Handle, true);
+	AttachedHandle = Handle;
+
+	// The readbacks are broadcast on the render thread, so that's where we bind to them.
+	ENQUEUE_RENDER_COMMAND(ShaderPlugin_AttachFrameEncoder)([this, &ShaderModule, Handle](FRHICommandListImmediate& RHICmdList)
+	{
+		OnReadbackHandle = ShaderModule.OnReadback().AddLambda([this, Handle](const FShaderUsageExampleReadback& Readback)
+		{
+			if (Readback.Handle == Handle)
+			{
+				EnqueueFrame(Readback);
+			}
+		});
+	});
+}
+
+void FShaderPluginFrameEncoder::Detach()
+{
+	if (!AttachedHandle.IsValid())
+	{
+		return;
+	}
+
+	check(IsInGameThread());
+
+	FShaderDeclarationDemoModule& ShaderModule = FShaderDeclarationDemoModule::Get();
+	ShaderModule.SetReadbackEnabled(AttachedHandle, false);
+	AttachedHandle.Invalidate();
+
+	ENQUEUE_RENDER_COMMAND(ShaderPlugin_DetachFrameEncoder)([this, &ShaderModule](FRHICommandListImmediate& RHICmdList)
+	{
+		ShaderModule.OnReadback().Remove(OnReadbackHandle);
+		OnReadbackHandle.Reset();
+	});
+
+	// Make sure the render thread is done calling us before we go anywhere.
+	FlushRenderingCommands();
+}
+
+bool FShaderPluginFrameEncoder::EnqueueFrame(const FShaderUsageExampleReadback& Readback)
+{
+	if (!IsSupportedFrameFormat(Readback.Format) || !Readback.Data || Readback.Size.GetMin() <= 0)
+	{
+		static bool bWarnedAboutFormat = false;
+		if (!bWarnedAboutFormat)
+		{
+			UE_LOG(LogShaderPluginEncoder, Warning, TEXT("Frames with pixel format %s can't be encoded."), GPixelFormats[Readback.Format].Name);
+			bWarnedAboutFormat = true;
+		}
+
+		NumFailedFrames++;
+		return false;
+	}
+
+	// This is the back-pressure. Once MaxQueuedFrames are waiting to be written, the producer either waits for one of
+	// them to finish or drops this one, so a slow disk can never make us run out of memory.
+	// The readbacks arrive on the render thread, which must never wait on the disk, so there we drop regardless.
+	const bool bCanWait = !Settings.bDropWhenFull && !IsInActualRenderingThread();
+	int32 FramesInFlight = NumFramesInFlight;
+	while (FramesInFlight >= Settings.MaxQueuedFrames || !NumFramesInFlight.compare_exchange_weak(FramesInFlight, FramesInFlight + 1))
+	{
+		if (FramesInFlight >= Settings.MaxQueuedFrames)
+		{
+			if (!bCanWait)
+			{
+				NumDroppedFrames++;
+				return false;
+			}
+
+			FrameReleasedEvent->Wait(10);
+			FramesInFlight = NumFramesInFlight;
+		}
+	}
+
+	FFrame* Frame = AllocateFrame();
+	Frame->Size = Readback.Size;
+	Frame->Format = Readback.Format;
+	Frame->SequenceIndex = NextSequenceIndex++;
+
+	// The readback is only valid during the callback, so this copy is the one thing we can't hand to the workers.
+	// It also drops the row padding of the staging buffer.
+	const int64 RowSize = (int64)Readback.Size.X * GPixelFormats[Readback.Format].BlockBytes;
+	Frame->Pixels.SetNumUninitialized(RowSize * Readback.Size.Y, false);
+	if (Readback.RowPitch == RowSize)
+	{
+		FMemory::Memcpy(Frame->Pixels.GetData(), Readback.Data, RowSize * Readback.Size.Y);
+	}
+	else
+	{
+		for (int32 Y = 0; Y < Readback.Size.Y; Y++)
+		{
+			FMemory::Memcpy(Frame->Pixels.GetData() + RowSize * Y, Readback.Data + (int64)Readback.RowPitch * Y, RowSize);
+		}
+	}
+
+	SharedThreadPool->AddQueuedWork(new FEncodeWork(*this, Frame));
+	return true;
+}
+
+void FShaderPluginFrameEncoder::WaitForCapacity()
+{
+	check(IsInGameThread());
+
+	if (Settings.bDropWhenFull)
+	{
+		return;
+	}
+
+	// Every slot of the readback ring can finish during the same frame, so that's how much room we need to be sure the
+	// render thread never finds the queue full. A queue smaller than the ring can't promise that, so we settle for empty.
+	static const IConsoleVariable* CVarReadbackNumSlots = IConsoleManager::Get().FindConsoleVariable(TEXT("r.ShaderPlugin.Readback.NumSlots"));
+	const int32 NumReadbackSlots = CVarReadbackNumSlots ? FMath::Max(CVarReadbackNumSlots->GetInt(), 1) : 1;
+	const int32 MaxFramesInFlight = FMath::Max(Settings.MaxQueuedFrames - NumReadbackSlots, 0);
+
+	while (NumFramesInFlight > MaxFramesInFlight)
+	{
+		FrameReleasedEvent->Wait(10);
+	}
+}
+
+void FShaderPluginFrameEncoder::Flush()
+{
+	while (NumFramesInFlight > 0)
+	{
+		FrameReleasedEvent->Wait(10);
+	}
+}
+
+FQueuedThreadPool* FShaderPluginFrameEncoder::AcquireThreadPool()
+{
+	FScopeLock Lock(&SharedThreadPoolCriticalSection);
+
+	if (SharedThreadPoolNumUsers++ == 0)
+	{
+		SharedThreadPool = FQueuedThreadPool::Allocate();
+		SharedThreadPool->Create(GetNumSharedThreadPoolThreads(), 128 * 1024, TPri_BelowNormal, TEXT("ShaderPluginFrameEncoder"));
+	}
+
+	return SharedThreadPool;
+}
+
+void FShaderPluginFrameEncoder::ReleaseThreadPool()
+{
+	FScopeLock Lock(&SharedThreadPoolCriticalSection);
+
+	// Every encoder flushes before it lets go, so the last one out leaves nothing in the pool to abandon.
+	if (--SharedThreadPoolNumUsers == 0)
+	{
+		SharedThreadPool->Destroy();
+		delete SharedThreadPool;
+		SharedThreadPool = nullptr;
+	}
+}
+
+FShaderPluginFrameEncoder::FFrame* FShaderPluginFrameEncoder::AllocateFrame()
+{
+	FScopeLock Lock(&FramePoolCriticalSection);
+
+	// The back-pressure keeps at most MaxQueuedFrames in flight, so that's as many frames as we'll ever allocate.
+	if (FreeFrames.Num() > 0)
+	{
+		return FreeFrames.Pop(false);
+	}
+
+	return AllFrames.Add_GetRef(MakeUnique<FFrame>()).Get();
+}
+
+void FShaderPluginFrameEncoder::ReleaseFrame(FFrame* Frame)
+{
+	{
+		FScopeLock Lock(&FramePoolCriticalSection);
+		FreeFrames.Add(Frame);
+	}
+
+	NumFramesInFlight--;
+	FrameReleasedEvent->Trigger();
+}
+
+void FShaderPluginFrameEncoder::EncodeFrame_AnyThread(FFrame& Frame)
+{
+	const int32 NumPixels = Frame.Size.X * Frame.Size.Y;
+	const bool bIsFloat = Frame.Format == PF_FloatRGBA;
+	const bool bWriteEXR = Settings.Format == EShaderPluginFrameFormat::EXR;
+
+	// Hand the pixels to the image wrapper as they are when we can, and convert them into the second buffer when we can't.
+	const uint8* RawPixels = Frame.Pixels.GetData();
+	ERGBFormat RawFormat = Frame.Format == PF_R8G8B8A8 ? ERGBFormat::RGBA : ERGBFormat::BGRA;
+	int32 RawBitDepth = 8;
+
+	if (bWriteEXR && bIsFloat)
+	{
+		RawFormat = ERGBFormat::RGBAF;
+		RawBitDepth = 16;
+	}
+	else if (bWriteEXR)
+	{
+		Frame.ConvertedPixels.SetNumUninitialized((int64)NumPixels * sizeof(FFloat16Color), false);
+		const FColor* Source = (const FColor*)Frame.Pixels.GetData();
+		FFloat16Color* Destination = (FFloat16Color*)Frame.ConvertedPixels.GetData();
+		for (int32 PixelIndex = 0; PixelIndex < NumPixels; PixelIndex++)
+		{
+			// FColor is laid out as BGRA, so RGBA sources just need the red and blue channels swapped back.
+			FColor Pixel = Source[PixelIndex];
+			if (Frame.Format == PF_R8G8B8A8)
+			{
+				Swap(Pixel.R, Pixel.B);
+			}
+			Destination[PixelIndex] = FFloat16Color(FLinearColor(Pixel));
+		}
+
+		RawPixels = Frame.ConvertedPixels.GetData();
+		RawFormat = ERGBFormat::RGBAF;
+		RawBitDepth = 16;
+	}
+	else if (bIsFloat)
+	{
+		Frame.ConvertedPixels.SetNumUninitialized((int64)NumPixels * sizeof(FColor), false);
+		const FFloat16Color* Source = (const FFloat16Color*)Frame.Pixels.GetData();
+		FColor* Destination = (FColor*)Frame.ConvertedPixels.GetData();
+		for (int32 PixelIndex = 0; PixelIndex < NumPixels; PixelIndex++)
+		{
+			Destination[PixelIndex] = FLinearColor(Source[PixelIndex]).ToFColor(true);
+		}
+
+		RawPixels = Frame.ConvertedPixels.GetData();
+		RawFormat = ERGBFormat::BGRA;
+	}
+
+	TSharedPtr<IImageWrapper> ImageWrapper = ImageWrapperModule->CreateImageWrapper(bWriteEXR ? EImageFormat::EXR : EImageFormat::PNG);
+	const int64 RawSize = (int64)NumPixels * (RawBitDepth / 8) * 4;
+	if (!ImageWrapper.IsValid() || !ImageWrapper->SetRaw(RawPixels, RawSize, Frame.Size.X, Frame.Size.Y, RawFormat, RawBitDepth))
+	{
+		NumFailedFrames++;
+		return;
+	}
+
+	const TArray64<uint8>& Compressed = ImageWrapper->GetCompressed();
+
+	// Writing straight from the worker keeps the encoded frames from piling up in memory when the disk is slow.
+	const FString Filename = FPaths::Combine(Settings.OutputDirectory, FString::Printf(TEXT("%s_%05d.%s"), *Settings.BaseFilename, Frame.SequenceIndex, bWriteEXR ? TEXT("exr") : TEXT("png")));
+	TUniquePtr<FArchive> Writer(IFileManager::Get().CreateFileWriter(*Filename));
+	if (!Writer || Compressed.Num() == 0)
+	{
+		UE_LOG(LogShaderPluginEncoder, Error, TEXT("Failed to write %s."), *Filename);
+		NumFailedFrames++;
+		return;
+	}
+
+	Writer->Serialize(const_cast<uint8*>(Compressed.GetData()), Compressed.Num());
+	if (!Writer->Close())
+	{
+		UE_LOG(LogShaderPluginEncoder, Error, TEXT("Failed to write %s."), *Filename);
+		NumFailedFrames++;
+		return;
+	}
+
+	NumEncodedFrames++;
+}
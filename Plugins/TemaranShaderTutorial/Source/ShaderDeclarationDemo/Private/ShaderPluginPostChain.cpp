@@ -0,0 +1,305 @@
+// Copyright 2016-2020 Cadic AB. All Rights Reserved.
+// @Author	Fredrik Lindh [Temaran] (temaran@gmail.com) {https://github.com/Temaran}
+///////////////////////////////////////////////////////////////////////////////////////
+
+#include "ShaderPluginPostChain.h"
+#include "GlobalShader.h"
+#include "PixelShaderUtils.h"
+#include "RenderGraphBuilder.h"
+#include "RenderGraphUtils.h"
+#include "RHIStaticStates.h"
+#include "ShaderParameterStruct.h"
+
+DEFINE_LOG_CATEGORY_STATIC(LogShaderPluginPostChain, Log, All);
+
+const FName FShaderPluginPostChain::Effect(TEXT("Effect"));
+const FName FShaderPluginPostChain::Output(TEXT("Output"));
+
+// Stages that leave their output unnamed write PostChainStage_0, PostChainStage_1 and so on. Stages may not use names
+// like that themselves, since those would clash with whatever the unnamed stages end up being called.
+static const FName GeneratedStageOutput(TEXT("PostChainStage"));
+
+static bool IsGeneratedStageOutput(FName Name)
+{
+	return FName(Name, NAME_NO_NUMBER_INTERNAL) == GeneratedStageOutput;
+}
+
+static const TCHAR* GetKernelName(EShaderPluginPostKernel Kernel)
+{
+	switch (Kernel)
+	{
+	case EShaderPluginPostKernel::Bloom: return TEXT("Bloom");
+	case EShaderPluginPostKernel::PaletteRemap: return TEXT("PaletteRemap");
+	case EShaderPluginPostKernel::Sharpen: return TEXT("Sharpen");
+	case EShaderPluginPostKernel::Blend: return TEXT("Blend");
+	}
+	return TEXT("Unknown");
+}
+
+/**********************************************************************************************/
+/* This class carries our parameter declarations and acts as the bridge between cpp and HLSL. */
+/**********************************************************************************************/
+class FPostChainPS : public FGlobalShader
+{
+public:
+	DECLARE_GLOBAL_SHADER(FPostChainPS);
+	SHADER_USE_PARAMETER_STRUCT(FPostChainPS, FGlobalShader);
+
+	// Which EShaderPluginPostKernel to run.
+	class FKernelDim : SHADER_PERMUTATION_INT("POST_KERNEL", 4);
+	using FPermutationDomain = TShaderPermutationDomain<FKernelDim>;
+
+	BEGIN_SHADER_PARAMETER_STRUCT(FParameters, )
+		SHADER_PARAMETER_RDG_TEXTURE(Texture2D, InputTexture)
+		SHADER_PARAMETER_RDG_TEXTURE(Texture2D, SecondInputTexture) // Only used by Blend
+		SHADER_PARAMETER_SAMPLER(SamplerState, InputSampler)
+		SHADER_PARAMETER(FVector2f, InvTextureSize)
+		SHADER_PARAMETER(float, Intensity)
+		SHADER_PARAMETER(float, Threshold)
+		SHADER_PARAMETER(float, Radius)
+		SHADER_PARAMETER_ARRAY(FVector4f, Palette, [4])
+		RENDER_TARGET_BINDING_SLOTS()
+	END_SHADER_PARAMETER_STRUCT()
+
+public:
+	static bool ShouldCompilePermutation(const FGlobalShaderPermutationParameters& Parameters)
+	{
+		return IsFeatureLevelSupported(Parameters.Platform, ERHIFeatureLevel::SM5);
+	}
+};
+
+IMPLEMENT_GLOBAL_SHADER(FPostChainPS, "/TutorialShaders/Private/PostChain.usf", "MainPS", SF_Pixel);
+
+FShaderPluginPostStage FShaderPluginPostStage::Bloom(float InThreshold, float InIntensity, float InRadius)
+{
+	FShaderPluginPostStage Stage;
+	Stage.Kernel = EShaderPluginPostKernel::Bloom;
+	Stage.Threshold = InThreshold;
+	Stage.Intensity = InIntensity;
+	Stage.Radius = InRadius;
+	return Stage;
+}
+
+FShaderPluginPostStage FShaderPluginPostStage::PaletteRemap(const FLinearColor& Dark, const FLinearColor& Shadows, const FLinearColor& Highlights, const FLinearColor& Bright, float InIntensity)
+{
+	FShaderPluginPostStage Stage;
+	Stage.Kernel = EShaderPluginPostKernel::PaletteRemap;
+	Stage.Palette[0] = Dark;
+	Stage.Palette[1] = Shadows;
+	Stage.Palette[2] = Highlights;
+	Stage.Palette[3] = Bright;
+	Stage.Intensity = InIntensity;
+	return Stage;
+}
+
+FShaderPluginPostStage FShaderPluginPostStage::Sharpen(float InIntensity)
+{
+	FShaderPluginPostStage Stage;
+	Stage.Kernel = EShaderPluginPostKernel::Sharpen;
+	Stage.Intensity = InIntensity;
+	return Stage;
+}
+
+FShaderPluginPostStage FShaderPluginPostStage::Blend(FName InInput, FName InSecondInput, float InIntensity)
+{
+	FShaderPluginPostStage Stage;
+	Stage.Kernel = EShaderPluginPostKernel::Blend;
+	Stage.Input = InInput;
+	Stage.SecondInput = InSecondInput;
+	Stage.Intensity = InIntensity;
+	return Stage;
+}
+
+FShaderPluginPostChainPtr FShaderPluginPostChain::Compile(const TArray<FShaderPluginPostStage>& InStages)
+{
+	if (InStages.Num() == 0)
+	{
+		UE_LOG(LogShaderPluginPostChain, Error, TEXT("A post chain needs at least one stage."));
+		return nullptr;
+	}
+
+	for (int32 StageIndex = 0; StageIndex < InStages.Num(); StageIndex++)
+	{
+		const FShaderPluginPostStage& Stage = InStages[StageIndex];
+		for (FName Name : { Stage.Input, Stage.SecondInput, Stage.Output })
+		{
+			if (IsGeneratedStageOutput(Name))
+			{
+				UE_LOG(LogShaderPluginPostChain, Error, TEXT("Stage %d uses %s, but names starting with %s are kept for stages that leave their output unnamed."), StageIndex, *Name.ToString(), *GeneratedStageOutput.ToString());
+				return nullptr;
+			}
+		}
+	}
+
+	TSharedRef<FShaderPluginPostChain, ESPMode::ThreadSafe> Chain = MakeShared<FShaderPluginPostChain, ESPMode::ThreadSafe>();
+	Chain->Stages = InStages;
+	const int32 LastStageIndex = Chain->Stages.Num() - 1;
+
+	// First fill in the names that were left out, and make sure every texture is written exactly once before anything reads it.
+	// That also means there can't be any cycles, since a stage can only read what the stages before it wrote.
+	TSet<FName> WrittenNames;
+	WrittenNames.Add(Effect);
+	for (int32 StageIndex = 0; StageIndex <= LastStageIndex; StageIndex++)
+	{
+		FShaderPluginPostStage& Stage = Chain->Stages[StageIndex];
+		if (Stage.Input.IsNone())
+		{
+			Stage.Input = StageIndex == 0 ? Effect : Chain->Stages[StageIndex - 1].Output;
+		}
+
+		if (Stage.Output.IsNone())
+		{
+			Stage.Output = StageIndex == LastStageIndex ? Output : FName(GeneratedStageOutput, StageIndex + 1);
+		}
+		else if ((StageIndex == LastStageIndex) != (Stage.Output == Output))
+		{
+			UE_LOG(LogShaderPluginPostChain, Error, TEXT("Stage %d writes %s, but only the last stage writes %s, and it can't write anything else."), StageIndex, *Stage.Output.ToString(), *Output.ToString());
+			return nullptr;
+		}
+
+		if (Stage.Kernel == EShaderPluginPostKernel::Blend && Stage.SecondInput.IsNone())
+		{
+			UE_LOG(LogShaderPluginPostChain, Error, TEXT("Stage %d blends, but doesn't say what to blend to."), StageIndex);
+			return nullptr;
+		}
+
+		for (FName ReadName : { Stage.Input, Stage.Kernel == EShaderPluginPostKernel::Blend ? Stage.SecondInput : Stage.Input })
+		{
+			if (!WrittenNames.Contains(ReadName))
+			{
+				UE_LOG(LogShaderPluginPostChain, Error, TEXT("Stage %d reads %s, which no earlier stage writes."), StageIndex, *ReadName.ToString());
+				return nullptr;
+			}
+		}
+
+		if (WrittenNames.Contains(Stage.Output))
+		{
+			UE_LOG(LogShaderPluginPostChain, Error, TEXT("Stage %d writes %s, which has already been written."), StageIndex, *Stage.Output.ToString());
+			return nullptr;
+		}
+		WrittenNames.Add(Stage.Output);
+	}
+
+	// A texture is needed from the stage that writes it until the last stage that reads it.
+	TMap<FName, int32> LastReadingStages;
+	for (int32 StageIndex = 0; StageIndex <= LastStageIndex; StageIndex++)
+	{
+		const FShaderPluginPostStage& Stage = Chain->Stages[StageIndex];
+		LastReadingStages.Add(Stage.Input, StageIndex);
+		if (Stage.Kernel == EShaderPluginPostKernel::Blend)
+		{
+			LastReadingStages.Add(Stage.SecondInput, StageIndex);
+		}
+	}
+
+	// Then hand out the intermediates in stage order, giving each output the first one whose texture nobody reads anymore.
+	// The stages run in order, so a straight chain only ever needs the one being read and the one being written.
+	TArray<int32> IntermediateLastReadingStages;
+	auto AllocateIntermediate = [&IntermediateLastReadingStages](int32 FirstStage, int32 LastStage)
+	{
+		for (int32 IntermediateIndex = 0; IntermediateIndex < IntermediateLastReadingStages.Num(); IntermediateIndex++)
+		{
+			if (IntermediateLastReadingStages[IntermediateIndex] < FirstStage)
+			{
+				IntermediateLastReadingStages[IntermediateIndex] = LastStage;
+				return IntermediateIndex;
+			}
+		}
+		return IntermediateLastReadingStages.Add(LastStage);
+	};
+
+	TMap<FName, int32> IntermediateIndices;
+	IntermediateIndices.Add(Effect, RenderTargetIndex);
+	const int32* EffectLastReadingStage = LastReadingStages.Find(Effect);
+	if (EffectLastReadingStage && *EffectLastReadingStage == LastStageIndex)
+	{
+		Chain->EffectCopyIndex = AllocateIntermediate(INDEX_NONE, LastStageIndex);
+		IntermediateIndices[Effect] = Chain->EffectCopyIndex;
+	}
+
+	for (int32 StageIndex = 0; StageIndex <= LastStageIndex; StageIndex++)
+	{
+		const FShaderPluginPostStage& Stage = Chain->Stages[StageIndex];
+		FCompiledStage& CompiledStage = Chain->CompiledStages.AddDefaulted_GetRef();
+		CompiledStage.InputIndex = IntermediateIndices[Stage.Input];
+		if (Stage.Kernel == EShaderPluginPostKernel::Blend)
+		{
+			CompiledStage.SecondInputIndex = IntermediateIndices[Stage.SecondInput];
+		}
+
+		if (StageIndex != LastStageIndex)
+		{
+			const int32* LastReadingStage = LastReadingStages.Find(Stage.Output);
+			if (!LastReadingStage)
+			{
+				UE_LOG(LogShaderPluginPostChain, Warning, TEXT("Nothing reads %s, so stage %d has no effect on the output."), *Stage.Output.ToString(), StageIndex);
+			}
+
+			CompiledStage.OutputIndex = AllocateIntermediate(StageIndex, LastReadingStage ? *LastReadingStage : StageIndex);
+			IntermediateIndices.Add(Stage.Output, CompiledStage.OutputIndex);
+		}
+	}
+
+	Chain->NumIntermediates = IntermediateLastReadingStages.Num();
+	UE_LOG(LogShaderPluginPostChain, Verbose, TEXT("Compiled a post chain of %d stages into %d intermediates."), Chain->Stages.Num(), Chain->NumIntermediates);
+	return Chain;
+}
+
+void FShaderPluginPostChain::AddPasses_RenderThread(FRDGBuilder& GraphBuilder, FRDGTextureRef RenderTargetTexture) const
+{
+	QUICK_SCOPE_CYCLE_COUNTER(STAT_ShaderPlugin_PostChain); // Used to gather CPU profiling data for the UE4 session frontend
+	RDG_EVENT_SCOPE(GraphBuilder, "ShaderPlugin_PostChain (%d stages)", Stages.Num()); // Used to profile GPU activity and add metadata to be consumed by for example RenderDoc
+
+	// The intermediates get the format of the render target, so the effect can be copied into one, and its sRGB flag, so all
+	// of them read back the same values. They only live for this graph, and the graph hands their memory back to the pool
+	// as soon as the last stage using them is done.
+	const FIntPoint Size = RenderTargetTexture->Desc.Extent;
+	const FRDGTextureDesc IntermediateDesc = FRDGTextureDesc::Create2D(Size, RenderTargetTexture->Desc.Format, FClearValueBinding::None,
+		TexCreate_ShaderResource | TexCreate_RenderTargetable | (RenderTargetTexture->Desc.Flags & TexCreate_SRGB));
+
+	TArray<FRDGTextureRef, TInlineAllocator<2>> Intermediates;
+	for (int32 IntermediateIndex = 0; IntermediateIndex < NumIntermediates; IntermediateIndex++)
+	{
+		Intermediates.Add(GraphBuilder.CreateTexture(IntermediateDesc, TEXT("ShaderPlugin_PostChainIntermediate")));
+	}
+
+	auto GetTexture = [&Intermediates, RenderTargetTexture](int32 Index)
+	{
+		return Index == RenderTargetIndex ? RenderTargetTexture : Intermediates[Index];
+	};
+
+	if (EffectCopyIndex != RenderTargetIndex)
+	{
+		AddCopyTexturePass(GraphBuilder, RenderTargetTexture, Intermediates[EffectCopyIndex]);
+	}
+
+	FGlobalShaderMap* ShaderMap = GetGlobalShaderMap(GMaxRHIFeatureLevel);
+	for (int32 StageIndex = 0; StageIndex < Stages.Num(); StageIndex++)
+	{
+		const FShaderPluginPostStage& Stage = Stages[StageIndex];
+		const FCompiledStage& CompiledStage = CompiledStages[StageIndex];
+
+		FPostChainPS::FPermutationDomain PermutationVector;
+		PermutationVector.Set<FPostChainPS::FKernelDim>((int32)Stage.Kernel);
+		TShaderMapRef<FPostChainPS> PixelShader(ShaderMap, PermutationVector);
+
+		// Every stage covers every pixel of its output, so there is no need to load or clear it first.
+		FPostChainPS::FParameters* PassParameters = GraphBuilder.AllocParameters<FPostChainPS::FParameters>();
+		PassParameters->InputTexture = GetTexture(CompiledStage.InputIndex);
+		PassParameters->SecondInputTexture = Stage.Kernel == EShaderPluginPostKernel::Blend ? GetTexture(CompiledStage.SecondInputIndex) : nullptr;
+		PassParameters->InputSampler = TStaticSamplerState<SF_Bilinear, AM_Clamp, AM_Clamp, AM_Clamp>::GetRHI();
+		PassParameters->InvTextureSize = FVector2f(1.0f / Size.X, 1.0f / Size.Y);
+		PassParameters->Intensity = Stage.Intensity;
+		PassParameters->Threshold = Stage.Threshold;
+		PassParameters->Radius = Stage.Radius;
+		for (int32 ColorIndex = 0; ColorIndex < (int32)UE_ARRAY_COUNT(Stage.Palette); ColorIndex++)
+		{
+			PassParameters->Palette[ColorIndex] = FVector4f(Stage.Palette[ColorIndex]);
+		}
+		PassParameters->RenderTargets[0] = FRenderTargetBinding(GetTexture(CompiledStage.OutputIndex), ERenderTargetLoadAction::ENoAction);
+
+		// The graph sees which textures each stage reads and writes, and only transitions the ones that change from one to the other.
+		FPixelShaderUtils::AddFullscreenPass(GraphBuilder, ShaderMap, RDG_EVENT_NAME("ShaderPlugin_PostChain %d %s", StageIndex, GetKernelName(Stage.Kernel)),
+			PixelShader, PassParameters, FIntRect(FIntPoint::ZeroValue, Size));
+	}
+}
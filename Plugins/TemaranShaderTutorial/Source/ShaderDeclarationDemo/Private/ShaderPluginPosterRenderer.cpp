@@ -0,0 +1,168 @@
+// Copyright 2016-2020 Cadic AB. All Rights Reserved.
+// @Author	Fredrik Lindh [Temaran] (temaran@gmail.com) {https://github.com/Temaran}
+///////////////////////////////////////////////////////////////////////////////////////
+
+#include "ShaderPluginPosterRenderer.h"
+
+#include "ComputeShaderExample.h"
+#include "CPUShaderExample.h"
+#include "OfflineReadbackPipeline.h"
+#include "TiledTiffWriter.h"
+
+#include "Async/Async.h"
+#include "HAL/IConsoleManager.h"
+#include "Misc/Paths.h"
+#include "RenderGraphBuilder.h"
+
+DEFINE_LOG_CATEGORY_STATIC(LogShaderPluginPoster, Log, All);
+
+// How many tiles the GPU may work on ahead of the one we're writing to disk.
+#define NUM_GPU_TILES_IN_FLIGHT 3
+
+namespace
+{
+	FIntPoint GetTile(int32 TileIndex, FIntPoint NumTiles)
+	{
+		return FIntPoint(TileIndex % NumTiles.X, TileIndex / NumTiles.X);
+	}
+
+	void LogProgress(int32 NumWrittenTiles, int32 NumTiles)
+	{
+		if (NumWrittenTiles == NumTiles || NumWrittenTiles % FMath::Max(NumTiles / 10, 1) == 0)
+		{
+			UE_LOG(LogShaderPluginPoster, Display, TEXT("Written %d of %d tiles."), NumWrittenTiles, NumTiles);
+		}
+	}
+
+	bool RenderOnCPU(const FShaderPluginPosterSettings& Settings, FTiledTiffWriter& Writer)
+	{
+		const FIntPoint NumTiles = Writer.GetNumTiles();
+		const int32 NumTilesTotal = NumTiles.X * NumTiles.Y;
+		const int32 TileSize = Settings.TileSize;
+
+		// RenderToBuffer_AnyThread already spreads each tile over every core, so we only need to keep the disk busy at the
+		// same time. One buffer is written while the next tile is evaluated into the other.
+		TArray<FColor> TileBuffers[2];
+		TFuture<bool> PendingWrite;
+		bool bSuccess = true;
+
+		for (int32 TileIndex = 0; TileIndex < NumTilesTotal && bSuccess; TileIndex++)
+		{
+			TArray<FColor>& TileBuffer = TileBuffers[TileIndex % 2];
+			TileBuffer.SetNumUninitialized(TileSize * TileSize, false);
+
+			const FIntPoint Tile = GetTile(TileIndex, NumTiles);
+			const FIntRect TileRect(Tile * TileSize, Tile * TileSize + TileSize);
+			FCPUShaderExample::RenderToBuffer_AnyThread(Settings.Parameters, Settings.Size, TileRect, true, TileBuffer.GetData(), TileSize);
+
+			if (PendingWrite.IsValid())
+			{
+				bSuccess &= PendingWrite.Get();
+				LogProgress(TileIndex, NumTilesTotal);
+			}
+
+			PendingWrite = Async(EAsyncExecution::ThreadPool, [&Writer, &TileBuffer, Tile, TileSize]()
+			{
+				return Writer.WriteTile(Tile.X, Tile.Y, (const uint8*)TileBuffer.GetData(), TileSize * sizeof(FColor), true);
+			});
+		}
+
+		if (PendingWrite.IsValid())
+		{
+			bSuccess &= PendingWrite.Get();
+			LogProgress(NumTilesTotal, NumTilesTotal);
+		}
+
+		return bSuccess;
+	}
+
+	bool RenderOnGPU(const FShaderPluginPosterSettings& Settings, FTiledTiffWriter& Writer)
+	{
+		const FIntPoint NumTiles = Writer.GetNumTiles();
+		const int32 NumTilesTotal = NumTiles.X * NumTiles.Y;
+		const int32 TileSize = Settings.TileSize;
+
+		bool bSuccess = true;
+		FOfflineReadbackPipeline::Run(NumTilesTotal, NUM_GPU_TILES_IN_FLIGHT,
+			[&Settings, NumTiles, TileSize](FRDGBuilder& GraphBuilder, int32 TileIndex)
+			{
+				// UAVs can't be sRGB, so the shader does the encoding itself.
+				const FRDGTextureDesc TileDesc = FRDGTextureDesc::Create2D(FIntPoint(TileSize, TileSize), PF_R8G8B8A8, FClearValueBinding::None, TexCreate_ShaderResource | TexCreate_UAV);
+				FRDGTextureRef TileTexture = GraphBuilder.CreateTexture(TileDesc, TEXT("ShaderPlugin_PosterTile"));
+				FComputeShaderExample::RunFusedComputeShaderTile_RenderThread(GraphBuilder, Settings.Parameters, Settings.Size, GetTile(TileIndex, NumTiles) * TileSize, true, TileTexture);
+				return TileTexture;
+			},
+			[&Writer, &bSuccess, NumTiles](int32 TileIndex, const void* Data, int32 RowPitchInPixels)
+			{
+				const FIntPoint Tile = GetTile(TileIndex, NumTiles);
+				bSuccess &= Data && Writer.WriteTile(Tile.X, Tile.Y, (const uint8*)Data, RowPitchInPixels * GPixelFormats[PF_R8G8B8A8].BlockBytes, false);
+			},
+			[NumTilesTotal](int32 NumWrittenTiles)
+			{
+				LogProgress(NumWrittenTiles, NumTilesTotal);
+			});
+
+		return bSuccess;
+	}
+}
+
+bool FShaderPluginPosterRenderer::Render(const FShaderPluginPosterSettings& Settings)
+{
+	check(IsInGameThread());
+
+	if (Settings.Size.GetMin() <= 0 || Settings.TileSize <= 0 || Settings.TileSize % 16 != 0)
+	{
+		UE_LOG(LogShaderPluginPoster, Error, TEXT("Can't render a %dx%d poster in %d pixel tiles. The tile size must be a multiple of 16."), Settings.Size.X, Settings.Size.Y, Settings.TileSize);
+		return false;
+	}
+
+	FTiledTiffWriter Writer;
+	if (!Writer.Open(Settings.Filename, Settings.Size, Settings.TileSize))
+	{
+		UE_LOG(LogShaderPluginPoster, Error, TEXT("Couldn't open %s for writing."), *Settings.Filename);
+		return false;
+	}
+
+	const bool bUseGPU = Settings.bUseGPU && FComputeShaderExample::SupportsOfflineFusedComputeShader(PF_R8G8B8A8);
+	UE_LOG(LogShaderPluginPoster, Display, TEXT("Rendering a %dx%d poster in %d %dx%d tiles on the %s to %s."), Settings.Size.X, Settings.Size.Y,
+		Writer.GetNumTiles().X * Writer.GetNumTiles().Y, Settings.TileSize, Settings.TileSize, bUseGPU ? TEXT("GPU") : TEXT("CPU"), *Settings.Filename);
+
+	const double StartTime = FPlatformTime::Seconds();
+	bool bSuccess = bUseGPU ? RenderOnGPU(Settings, Writer) : RenderOnCPU(Settings, Writer);
+	bSuccess &= Writer.Close();
+
+	if (!bSuccess)
+	{
+		UE_LOG(LogShaderPluginPoster, Error, TEXT("Failed to write %s."), *Settings.Filename);
+		return false;
+	}
+
+	UE_LOG(LogShaderPluginPoster, Display, TEXT("Done in %.1f seconds."), FPlatformTime::Seconds() - StartTime);
+	return true;
+}
+
+static FAutoConsoleCommand CmdShaderPluginRenderPoster(
+	TEXT("r.ShaderPlugin.RenderPoster"),
+	TEXT("Renders the shader plugin effect to a tiled TIFF, at sizes far beyond what fits in a render target.\n")
+	TEXT("Usage: r.ShaderPlugin.RenderPoster [Width=16384] [Height=16384] [Tile=1024] [Time=1] [Blend=1] [File=Saved/ShaderPlugin/Poster.tif] [CPU]"),
+	FConsoleCommandWithArgsDelegate::CreateLambda([](const TArray<FString>& Args)
+	{
+		const FString Params = FString::Join(Args, TEXT(" "));
+
+		FShaderPluginPosterSettings Settings;
+		Settings.Filename = FPaths::Combine(FPaths::ProjectSavedDir(), TEXT("ShaderPlugin"), TEXT("Poster.tif"));
+		Settings.Parameters = FShaderUsageExampleParameters(nullptr);
+		Settings.Parameters.StartColor = FColor::Green;
+		Settings.Parameters.EndColor = FColor::Red;
+		Settings.Parameters.ComputeShaderBlend = 1.0f;
+
+		FParse::Value(*Params, TEXT("Width="), Settings.Size.X);
+		FParse::Value(*Params, TEXT("Height="), Settings.Size.Y);
+		FParse::Value(*Params, TEXT("Tile="), Settings.TileSize);
+		FParse::Value(*Params, TEXT("Time="), Settings.Parameters.SimulationState);
+		FParse::Value(*Params, TEXT("Blend="), Settings.Parameters.ComputeShaderBlend);
+		FParse::Value(*Params, TEXT("File="), Settings.Filename);
+		Settings.bUseGPU = !Args.Contains(TEXT("CPU"));
+
+		FShaderPluginPosterRenderer::Render(Settings);
+	}));
@@ -0,0 +1,258 @@
+// Copyright 2016-2020 Cadic AB. All Rights Reserved.
+// @Author	Fredrik Lindh [Temaran] (temaran@gmail.com) {https://github.com/Temaran}
+///////////////////////////////////////////////////////////////////////////////////////
+
+#include "TiledTiffWriter.h"
+
+#include "HAL/FileManager.h"
+#include "Misc/ScopeLock.h"
+
+// The field types and tags we use, from the TIFF 6.0 and BigTIFF specs.
+#define TIFF_SHORT 3
+#define TIFF_LONG 4
+#define TIFF_LONG8 16
+
+#define TIFF_TAG_IMAGE_WIDTH 256
+#define TIFF_TAG_IMAGE_LENGTH 257
+#define TIFF_TAG_BITS_PER_SAMPLE 258
+#define TIFF_TAG_COMPRESSION 259
+#define TIFF_TAG_PHOTOMETRIC_INTERPRETATION 262
+#define TIFF_TAG_SAMPLES_PER_PIXEL 277
+#define TIFF_TAG_PLANAR_CONFIGURATION 284
+#define TIFF_TAG_TILE_WIDTH 322
+#define TIFF_TAG_TILE_LENGTH 323
+#define TIFF_TAG_TILE_OFFSETS 324
+#define TIFF_TAG_TILE_BYTE_COUNTS 325
+
+#define TIFF_BYTES_PER_PIXEL 3
+
+FTiledTiffWriter::FTiledTiffWriter()
+	: ImageSize(FIntPoint::ZeroValue)
+	, NumTiles(FIntPoint::ZeroValue)
+	, TileSize(0)
+	, bBigTiff(false)
+{ }
+
+FTiledTiffWriter::~FTiledTiffWriter()
+{
+	Close();
+}
+
+bool FTiledTiffWriter::Open(const FString& Filename, FIntPoint InImageSize, int32 InTileSize)
+{
+	check(InTileSize > 0 && InTileSize % 16 == 0);
+
+	ImageSize = InImageSize;
+	TileSize = InTileSize;
+	NumTiles = FIntPoint(FMath::DivideAndRoundUp(ImageSize.X, TileSize), FMath::DivideAndRoundUp(ImageSize.Y, TileSize));
+
+	// Classic TIFF offsets are 32 bits, so anything that doesn't fit in 4GB has to be a BigTIFF.
+	const uint64 TileBytes = (uint64)TileSize * TileSize * TIFF_BYTES_PER_PIXEL;
+	bBigTiff = TileBytes * NumTiles.X * NumTiles.Y + 4096 > MAX_uint32;
+
+	TileOffsets.Init(0, NumTiles.X * NumTiles.Y);
+	TileByteCounts.Init(0, NumTiles.X * NumTiles.Y);
+
+	Writer.Reset(IFileManager::Get().CreateFileWriter(*Filename));
+	if (!Writer)
+	{
+		return false;
+	}
+
+	// The header points at the directory, which we only know the position of once all the tiles are in. Close() fills it in.
+	uint8 ByteOrder[2] = { 'I', 'I' };
+	Writer->Serialize(ByteOrder, 2);
+	if (bBigTiff)
+	{
+		uint16 Version = 43;
+		uint16 OffsetSize = 8;
+		uint16 Reserved = 0;
+		uint64 DirectoryOffset = 0;
+		*Writer << Version << OffsetSize << Reserved << DirectoryOffset;
+	}
+	else
+	{
+		uint16 Version = 42;
+		uint32 DirectoryOffset = 0;
+		*Writer << Version << DirectoryOffset;
+	}
+
+	return !Writer->IsError();
+}
+
+bool FTiledTiffWriter::WriteTile(int32 TileX, int32 TileY, const uint8* Pixels, int32 RowPitch, bool bBGRA)
+{
+	const FIntPoint TileMin(TileX * TileSize, TileY * TileSize);
+	const FIntPoint ValidSize(FMath::Min(TileSize, ImageSize.X - TileMin.X), FMath::Min(TileSize, ImageSize.Y - TileMin.Y));
+	if (TileX < 0 || TileY < 0 || ValidSize.X <= 0 || ValidSize.Y <= 0)
+	{
+		return false;
+	}
+
+	// Tiles are always stored at their full size, so the ones on the right and bottom edges get padded with black.
+	// The conversion happens before taking the lock, so tiles from different threads only wait for each other's disk writes.
+	// Large tiles go past 2GB, so the size is worked out in 64 bits like the offsets are.
+	TArray64<uint8> TileData;
+	TileData.SetNumZeroed((int64)TileSize * TileSize * TIFF_BYTES_PER_PIXEL);
+
+	const int32 RedIndex = bBGRA ? 2 : 0;
+	const int32 BlueIndex = bBGRA ? 0 : 2;
+	for (int32 Y = 0; Y < ValidSize.Y; Y++)
+	{
+		const uint8* Source = Pixels + (int64)Y * RowPitch;
+		uint8* Destination = TileData.GetData() + (int64)Y * TileSize * TIFF_BYTES_PER_PIXEL;
+		for (int32 X = 0; X < ValidSize.X; X++)
+		{
+			Destination[0] = Source[RedIndex];
+			Destination[1] = Source[1];
+			Destination[2] = Source[BlueIndex];
+			Source += 4;
+			Destination += TIFF_BYTES_PER_PIXEL;
+		}
+	}
+
+	FScopeLock Lock(&WriterCriticalSection);
+	if (!Writer)
+	{
+		return false;
+	}
+
+	const int32 TileIndex = TileY * NumTiles.X + TileX;
+	TileOffsets[TileIndex] = Writer->Tell();
+	TileByteCounts[TileIndex] = TileData.Num();
+	Writer->Serialize(TileData.GetData(), TileData.Num());
+	return !Writer->IsError();
+}
+
+bool FTiledTiffWriter::Close()
+{
+	FScopeLock Lock(&WriterCriticalSection);
+	if (!Writer)
+	{
+		return false;
+	}
+
+	WriteDirectory();
+
+	const bool bSuccess = !Writer->IsError();
+	Writer->Close();
+	Writer.Reset();
+	return bSuccess;
+}
+
+void FTiledTiffWriter::WriteDirectory()
+{
+	FArchive& Ar = *Writer;
+
+	struct FEntry
+	{
+		uint16 Tag;
+		uint16 Type;
+		uint64 Count;
+		uint64 ValueOrOffset;
+	};
+
+	// Values that fit in the entry itself must be stored there, and the rest go in front of the directory.
+	const int32 InlineSize = bBigTiff ? 8 : 4;
+	auto WriteOffsetArray = [&](uint16 Tag, const TArray<uint64>& Values) -> FEntry
+	{
+		const uint16 Type = bBigTiff ? TIFF_LONG8 : TIFF_LONG;
+		if (Values.Num() == 1)
+		{
+			return { Tag, Type, 1, Values[0] };
+		}
+
+		const uint64 Offset = Ar.Tell();
+		for (uint64 Value : Values)
+		{
+			if (bBigTiff)
+			{
+				Ar << Value;
+			}
+			else
+			{
+				uint32 Value32 = (uint32)Value;
+				Ar << Value32;
+			}
+		}
+		return { Tag, Type, (uint64)Values.Num(), Offset };
+	};
+
+	FEntry BitsPerSample = { TIFF_TAG_BITS_PER_SAMPLE, TIFF_SHORT, TIFF_BYTES_PER_PIXEL, 0 };
+	if ((int32)(TIFF_BYTES_PER_PIXEL * sizeof(uint16)) <= InlineSize)
+	{
+		BitsPerSample.ValueOrOffset = 8ull | (8ull << 16) | (8ull << 32);
+	}
+	else
+	{
+		BitsPerSample.ValueOrOffset = Ar.Tell();
+		uint16 Bits[TIFF_BYTES_PER_PIXEL] = { 8, 8, 8 };
+		Ar.Serialize(Bits, sizeof(Bits));
+	}
+
+	const FEntry TileOffsetsEntry = WriteOffsetArray(TIFF_TAG_TILE_OFFSETS, TileOffsets);
+	const FEntry TileByteCountsEntry = WriteOffsetArray(TIFF_TAG_TILE_BYTE_COUNTS, TileByteCounts);
+
+	// The entries have to be sorted by tag.
+	const FEntry Entries[] =
+	{
+		{ TIFF_TAG_IMAGE_WIDTH, TIFF_LONG, 1, (uint64)ImageSize.X },
+		{ TIFF_TAG_IMAGE_LENGTH, TIFF_LONG, 1, (uint64)ImageSize.Y },
+		BitsPerSample,
+		{ TIFF_TAG_COMPRESSION, TIFF_SHORT, 1, 1 },							// None
+		{ TIFF_TAG_PHOTOMETRIC_INTERPRETATION, TIFF_SHORT, 1, 2 },			// RGB
+		{ TIFF_TAG_SAMPLES_PER_PIXEL, TIFF_SHORT, 1, TIFF_BYTES_PER_PIXEL },
+		{ TIFF_TAG_PLANAR_CONFIGURATION, TIFF_SHORT, 1, 1 },				// Interleaved
+		{ TIFF_TAG_TILE_WIDTH, TIFF_LONG, 1, (uint64)TileSize },
+		{ TIFF_TAG_TILE_LENGTH, TIFF_LONG, 1, (uint64)TileSize },
+		TileOffsetsEntry,
+		TileByteCountsEntry,
+	};
+
+	// Everything we write is an even number of bytes, so the directory lands on a word boundary like the spec wants.
+	const uint64 DirectoryOffset = Ar.Tell();
+	if (bBigTiff)
+	{
+		uint64 NumEntries = UE_ARRAY_COUNT(Entries);
+		Ar << NumEntries;
+	}
+	else
+	{
+		uint16 NumEntries = UE_ARRAY_COUNT(Entries);
+		Ar << NumEntries;
+	}
+
+	// Values smaller than the field are stored in its first bytes, which is where a little endian write puts them.
+	for (FEntry Entry : Entries)
+	{
+		Ar << Entry.Tag << Entry.Type;
+		if (bBigTiff)
+		{
+			Ar << Entry.Count << Entry.ValueOrOffset;
+		}
+		else
+		{
+			uint32 Count = (uint32)Entry.Count;
+			uint32 ValueOrOffset = (uint32)Entry.ValueOrOffset;
+			Ar << Count << ValueOrOffset;
+		}
+	}
+
+	// There's only the one image, so there is no next directory.
+	if (bBigTiff)
+	{
+		uint64 NextDirectoryOffset = 0;
+		Ar << NextDirectoryOffset;
+		Ar.Seek(8);
+		uint64 DirectoryOffset64 = DirectoryOffset;
+		Ar << DirectoryOffset64;
+	}
+	else
+	{
+		uint32 NextDirectoryOffset = 0;
+		Ar << NextDirectoryOffset;
+		Ar.Seek(4);
+		uint32 DirectoryOffset32 = (uint32)DirectoryOffset;
+		Ar << DirectoryOffset32;
+	}
+}
@@ -0,0 +1,46 @@
+// Copyright 2016-2020 Cadic AB. All Rights Reserved.
+// @Author	Fredrik Lindh [Temaran] (temaran@gmail.com) {https://github.com/Temaran}
+///////////////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include "CoreMinimal.h"
+
+/**************************************************************************************/
+/* Writes an uncompressed 8 bit RGB TIFF one tile at a time, so an image never has to  */
+/* be in memory as a whole. Tiles can be written in any order and from any thread.     */
+/* Images over 4GB are written as BigTIFF, which most tools that deal in print and     */
+/* mega-textures can read.                                                            */
+/**************************************************************************************/
+class FTiledTiffWriter
+{
+public:
+	FTiledTiffWriter();
+	~FTiledTiffWriter();
+
+	// TileSize must be a multiple of 16, since that's what the TIFF spec asks for.
+	bool Open(const FString& Filename, FIntPoint InImageSize, int32 InTileSize);
+
+	// Writes the tile at TileX, TileY in tile units. Pixels holds the part of the tile that's inside the image, as rows of
+	// RowPitch bytes with 4 bytes per pixel, either in BGRA (FColor) or RGBA order. Alpha is dropped. Thread safe.
+	bool WriteTile(int32 TileX, int32 TileY, const uint8* Pixels, int32 RowPitch, bool bBGRA);
+
+	// Writes the directory that tells readers where the tiles are. The image is unreadable until this has been called.
+	bool Close();
+
+	FIntPoint GetNumTiles() const { return NumTiles; }
+
+private:
+	void WriteDirectory();
+
+	TUniquePtr<FArchive> Writer;
+	FCriticalSection WriterCriticalSection;
+	FIntPoint ImageSize;
+	FIntPoint NumTiles;
+	int32 TileSize;
+	bool bBigTiff;
+
+	// Indexed by TileY * NumTiles.X + TileX, which is the order TIFF wants them in.
+	TArray<uint64> TileOffsets;
+	TArray<uint64> TileByteCounts;
+};
@@ -6,12 +6,20 @@
 
 #include "CoreMinimal.h"
 
+#include <atomic>
+
 #include "Modules/ModuleInterface.h"
 #include "Modules/ModuleManager.h"
 
+#include "Containers/TripleBuffer.h"
 #include "RenderGraphResources.h"
+#include "RendererInterface.h"
+#include "RHIGPUReadback.h"
+#include "ShaderPluginPostChain.h"
 #include "Runtime/Engine/Classes/Engine/TextureRenderTarget2D.h"
 
+class UPrimitiveComponent;
+
 // This struct contains all the data we need to pass from the game thread to draw our effect.
 struct FShaderUsageExampleParameters
 {
@@ -26,6 +34,13 @@ struct FShaderUsageExampleParameters
 		return CachedRenderTargetSize;
 	}
 
+	// The renderer calls this with the size of the render target's RHI texture, since the render target
+	// may have been resized after these parameters were made.
+	void SetRenderTargetSize(FIntPoint InRenderTargetSize)
+	{
+		CachedRenderTargetSize = InRenderTargetSize;
+	}
+
 	FShaderUsageExampleParameters()	{ }
 	FShaderUsageExampleParameters(UTextureRenderTarget2D* InRenderTarget)
 		: RenderTarget(InRenderTarget)
@@ -40,6 +55,56 @@ private:
 	FIntPoint CachedRenderTargetSize;
 };
 
+// Identifies an instance of the effect registered with FShaderDeclarationDemoModule.
+struct FShaderUsageExampleHandle
+{
+	uint32 Id = 0;
+
+	bool IsValid() const { return Id != 0; }
+	void Invalidate() { Id = 0; }
+
+	bool operator==(const FShaderUsageExampleHandle& Other) const { return Id == Other.Id; }
+	bool operator!=(const FShaderUsageExampleHandle& Other) const { return Id != Other.Id; }
+	friend uint32 GetTypeHash(const FShaderUsageExampleHandle& Handle) { return Handle.Id; }
+};
+
+// A registered instance and the parameters it should be drawn with.
+struct FShaderUsageExampleInstance
+{
+	FShaderUsageExampleHandle Handle;
+	FShaderUsageExampleParameters Parameters;
+	bool bReadback = false;
+	bool bGenerateMips = false;
+
+	// Run on the render target after every draw. Null when there is none.
+	FShaderPluginPostChainPtr PostChain;
+
+	// Whether one of the instance's consumers was rendered recently. Instances nobody can see are drawn at
+	// r.ShaderPlugin.VisibilityThrottling.HiddenRate instead of every frame.
+	bool bVisible = true;
+};
+
+// A frame of an instance's output that has been copied back from the GPU. Data points straight into the mapped staging
+// memory, so it is only valid during the callback. Copy it if you need to keep it.
+struct FShaderUsageExampleReadback
+{
+	FShaderUsageExampleHandle Handle;
+	uint64 FrameNumber = 0; // The game thread frame the parameters were published on
+	FIntPoint Size = FIntPoint::ZeroValue;
+	EPixelFormat Format = PF_Unknown;
+	const uint8* Data = nullptr;
+	int32 RowPitch = 0; // In bytes
+};
+
+DECLARE_MULTICAST_DELEGATE_OneParam(FOnShaderUsageExampleReadback, const FShaderUsageExampleReadback&);
+
+// All registered instances as published by the game thread, tagged with the frame they were published on.
+struct FShaderUsageExampleInstancesFrame
+{
+	TArray<FShaderUsageExampleInstance> Instances;
+	uint64 FrameNumber = 0;
+};
+
 /*
  * Since we already have a module interface due to us being in a plugin, it's pretty handy to just use it
  * to interact with the renderer. It gives us the added advantage of being able to decouple any render
@@ -52,9 +117,10 @@ private:
  * Render graphs:
  * In UE4, you generally want to work with graphs if you are working with larger rendering jobs and working with engine
  * pooled render targets. As the engine almost exclusively uses task graphs now for rendering tasks as well, learning
- * by example is also easier right now if you elect to use them. They are quite hard (if not impossible?) to use when
- * interfacing with UObject render resources like UTextures however, so if you want to do that, you need to use passes instead.
- * Graphs generally perform better if you use them for larger jobs. For smaller work, you yet again want to look at passes instead.
+ * by example is also easier right now if you elect to use them. UObject render resources like UTextures can be brought
+ * into a graph by registering their RHI texture as an external texture, which is what we do with our output render target.
+ * Since the renderer hands us the graph builder it is using for the scene, we add our passes to that graph. This lets the
+ * graph cull, schedule and place barriers for our work together with the rest of the frame.
  *
  * Render passes:
  * Passes are very similar to the previous graphics API and are now used when using the rasterizer. 
@@ -84,23 +150,309 @@ public:
 
 public:
 	// Call this when you want to hook onto the renderer and start drawing. The shader will be executed once per frame.
+	// Calls are counted, so every user (a pawn, a trace replay, the benchmark) can begin and end on its own schedule.
 	void BeginRendering();
 
-	// When you are done, call this to stop drawing.
+	// When you are done, call this to stop drawing. The hooks only come off when the last user to begin has ended.
 	void EndRendering();
 	
-	// Call this whenever you have new parameters to share. You could set this up to update different sets of properties at
-	// different intervals to save on locking and GPU transfer time.
+	// Adds an instance of the effect that is drawn with its own parameters, and returns the handle used to refer to it.
+	// Instances that render to targets of the same size are computed together in a single dispatch. Game thread only.
+	FShaderUsageExampleHandle RegisterInstance(const FShaderUsageExampleParameters& DrawParameters);
+
+	// Call this from the game thread whenever you have new parameters for an instance. This never blocks, and all changes
+	// made during a frame are handed to the renderer together once the frame's actors have ticked.
+	void UpdateInstance(FShaderUsageExampleHandle Handle, const FShaderUsageExampleParameters& DrawParameters);
+
+	// Stops drawing an instance and invalidates the handle. Game thread only.
+	void UnregisterInstance(FShaderUsageExampleHandle& Handle);
+
+	// Tells the module that Component samples the render target of an instance, usually through a material. Once an instance
+	// has consumers, it is only drawn every frame while one of them has been rendered recently, and drops to
+	// r.ShaderPlugin.VisibilityThrottling.HiddenRate otherwise. Instances without consumers are always drawn, since there is
+	// no telling who else reads their target. Game thread only.
+	void AddInstanceConsumer(FShaderUsageExampleHandle Handle, UPrimitiveComponent* Component);
+	// Same as above for many components at once, without comparing each of them against every consumer already there.
+	void AddInstanceConsumers(FShaderUsageExampleHandle Handle, TConstArrayView<UPrimitiveComponent*> Components);
+	void RemoveInstanceConsumer(FShaderUsageExampleHandle Handle, UPrimitiveComponent* Component);
+
+	// Convenience for when you only need a single instance. The first call registers it, and the following calls update it.
 	void UpdateParameters(FShaderUsageExampleParameters& DrawParameters);
 
+	// Publishes the instances and draws them right away, on whichever backend is selected. This is for tools that don't
+	// run the engine loop, like the benchmark commandlet, so it ignores r.ShaderPlugin.UpdateRate and always draws. Call FlushRenderingCommands() afterwards if you need to wait for
+	// the frame to finish. Game thread only.
+	void RenderFrame_GameThread();
+
+	// Copies the output of an instance back to the CPU every time it is drawn, and hands it to OnReadback. That includes the
+	// frames r.ShaderPlugin.UpdateRate.Interpolate fades between updates, but not the ones where nothing changed. This never waits
+	// for the GPU: the copies go through a ring of r.ShaderPlugin.Readback.NumSlots staging buffers, and when all of them are
+	// still in flight the frame is dropped instead. Game thread only.
+	void SetReadbackEnabled(FShaderUsageExampleHandle Handle, bool bEnabled);
+
+	// Fills in the mip chain of an instance's render target every time it is drawn, so materials sampling it from a distance
+	// don't alias. The target needs mips and UAV support for this, so its asset must have bAutoGenerateMips and bCanCreateUAV
+	// set, otherwise this does nothing. Its GPU cost shows up as "ShaderPlugin: Generate Mips" in "stat GPU". Game thread only.
+	void SetMipGenerationEnabled(FShaderUsageExampleHandle Handle, bool bEnabled);
+
+	// Runs a chain of full screen passes on an instance's render target every time it is drawn, after the effect and before
+	// the mips are built. Build one with FShaderPluginPostChain::Compile, and pass null to go back to the plain effect. The
+	// CPU backend doesn't run chains. Their GPU cost shows up as "ShaderPlugin: Post Chain" in "stat GPU". Game thread only.
+	void SetPostChain(FShaderUsageExampleHandle Handle, FShaderPluginPostChainPtr PostChain);
+
+	// Broadcast on the render thread for every finished readback, oldest first. Bind to it before enabling readback.
+	FOnShaderUsageExampleReadback& OnReadback()
+	{
+		return OnReadbackDelegate;
+	}
+
+	// How many readbacks were dropped because the ring was full. Safe to call from any thread.
+	uint64 GetDroppedReadbackCount() const
+	{
+		return DroppedReadbackCount;
+	}
+
+	// Records every instance change to a binary trace file, starting with the instances that already exist. Game thread only.
+	// You can also use r.ShaderPlugin.Trace.Record and r.ShaderPlugin.Trace.StopRecording from the console.
+	bool StartRecording(const FString& Filename);
+	void StopRecording();
+
+	// Plays a recorded trace back through RegisterInstance/UpdateInstance, so no pawn is needed. With bMaxSpeed, each recorded
+	// frame is drawn in an engine frame of its own instead of following the recorded timestamps. Game thread only.
+	bool StartReplay(const FString& Filename, bool bMaxSpeed);
+	void StopReplay();
+
+	// The game thread frame number of the parameters the renderer most recently drew with.
+	uint64 GetConsumedParametersFrameNumber_RenderThread() const
+	{
+		return ConsumedParametersFrameNumber;
+	}
+
+	// How many times the renderer called us again during an engine frame we had already drawn, which happens for every extra
+	// scene render, like split screen views, scene captures and additional editor viewports. Safe to call from any thread.
+	uint64 GetDuplicateInvocationCount() const
+	{
+		return DuplicateInvocationCount;
+	}
+
+	// How many engine frames didn't compute the effect because r.ShaderPlugin.UpdateRate said it wasn't time yet. With
+	// r.ShaderPlugin.UpdateRate.Interpolate, the pixel pass still ran on those. Safe to call from any thread.
+	uint64 GetSkippedUpdateCount() const
+	{
+		return SkippedUpdateCount;
+	}
+
+	// How many bytes of GPU memory the compute shader intermediates currently hold. Safe to call from any thread.
+	// The same number is shown under "stat ShaderPlugin".
+	uint64 GetIntermediateMemorySize() const
+	{
+		return IntermediateMemorySize;
+	}
+
 private:
-	TRefCountPtr<IPooledRenderTarget> ComputeShaderOutput;
-	FShaderUsageExampleParameters CachedShaderUsageExampleParameters;
+	// The game thread copy of all instances. They are kept contiguous, so publishing them to the renderer is a single array copy.
+	TArray<FShaderUsageExampleInstance> Instances;
+	TMap<FShaderUsageExampleHandle, int32> InstanceIndices;
+	FShaderUsageExampleHandle DefaultInstance;
+
+	// The components sampling each instance's render target. Destroyed ones are dropped when visibility is next updated.
+	TMap<FShaderUsageExampleHandle, TArray<TWeakObjectPtr<UPrimitiveComponent>>> InstanceConsumers;
+	uint32 NextInstanceId;
+	bool bInstancesDirty;
+
+	// The game thread writes and the render thread reads from different buffers of this triple buffer, so neither ever
+	// waits for the other. Publishing only swaps pointers, which is how stale parameters get dropped.
+	TTripleBuffer<FShaderUsageExampleInstancesFrame> InstancesBuffer;
+	uint64 ConsumedParametersFrameNumber;
+
+	// The scene renderer calls us once per scene render, but the effect only needs drawing once per engine frame, and
+	// with r.ShaderPlugin.UpdateRate not even that often. These track when we last did.
+	enum class EScheduledWork : uint8
+	{
+		None,        // Nothing this frame
+		Update,      // Compute and draw everything that changed
+		Interpolate, // Only run the pixel pass, blending from the previous compute to the latest one
+	};
+	uint32 LastScheduledFrameNumber;
+	double LastUpdateTime;
+	double NextUpdateTime;
+	std::atomic<uint64> DuplicateInvocationCount;
+	std::atomic<uint64> SkippedUpdateCount;
+
+	// Whether the hooks below are installed. Not every one of them can be, so none of the handles tells us that.
+	bool bRendering;
+	int32 RenderingRefCount;
+
 	FDelegateHandle OnPostResolvedSceneColorHandle;
-	FCriticalSection RenderEveryFrameLock;
-	volatile bool bCachedParametersValid;
+	FDelegateHandle OnEndFrameRenderThreadHandle;
+	FDelegateHandle OnWorldPostActorTickHandle;
+	FDelegateHandle OnEndFrameHandle;
+
+	// Identifies a compute shader intermediate. Instances share one when their render targets have the same size and the same output format.
+	struct FComputeOutputKey
+	{
+		FIntPoint Size = FIntPoint::ZeroValue;
+		EPixelFormat Format = PF_Unknown;
+
+		bool operator==(const FComputeOutputKey& Other) const { return Size == Other.Size && Format == Other.Format; }
+		bool operator!=(const FComputeOutputKey& Other) const { return !(*this == Other); }
+		friend uint32 GetTypeHash(const FComputeOutputKey& Key) { return HashCombine(GetTypeHash(Key.Size), GetTypeHash((uint8)Key.Format)); }
+	};
+
+	// What the renderer last drew for each instance, so we can skip the work when the output wouldn't change.
+	struct FInstanceRenderState
+	{
+		FShaderUsageExampleParameters LastDrawnParameters;
+		FRHITexture* LastDrawnTexture = nullptr;
+		bool bHasDrawn = false;
+		uint32 LastSeenFrame = 0;
+		double LastDrawTime = 0.0;
+
+		// The chain the render target was last drawn with. Held on to, so a new chain is never mistaken for a freed one.
+		FShaderPluginPostChainPtr LastDrawnPostChain;
+
+		// The slice of the intermediate holding this instance's compute shader output, and the simulation state it was computed with.
+		FComputeOutputKey ComputeOutputKey;
+		int32 ComputeOutputSlice = INDEX_NONE;
+		float ComputedSimulationState = 0.0f;
+
+		// The quality tier and precision the fractal was last evaluated with, by either the compute pass or the fused one.
+		int32 ComputedQuality = INDEX_NONE;
+		bool bComputedHalfPrecision = false;
+		bool bComputeOutputValid = false;
+
+		// With r.ShaderPlugin.UpdateRate.Interpolate, whether the history slice holds an older compute than the intermediate
+		// does, so the pixel pass has something to blend from.
+		bool bHistoryValid = false;
+
+		// With r.ShaderPlugin.Amortize, which pixel of every block was computed last, and how many of them have been computed
+		// with ComputedSimulationState. The slice is fully up to date once that reaches AmortizeFactor.
+		int32 AmortizeFactor = 1;
+		int32 AmortizePhase = 0;
+		int32 NumAmortizePhasesAtComputedState = 1;
+
+		// Output of the CPU backend, kept around so we don't reallocate it every frame.
+		TArray<FColor> CPUOutput;
+	};
+	TMap<FShaderUsageExampleHandle, FInstanceRenderState> InstanceRenderStates;
+	uint32 RenderFrameIndex;
+
+	// The compute shader output of all instances with the same key, one slice per instance. It comes from GRenderTargetPool and is
+	// kept between frames, so an instance whose simulation state didn't change can skip the compute pass even when its colors did.
+	// Once no pass has used it for r.ShaderPlugin.IntermediateIdleTime seconds, it is handed back to the pool.
+	struct FComputeOutputArray
+	{
+		TRefCountPtr<IPooledRenderTarget> PooledTexture;
+		int32 NumAllocatedSlices = 0;
+
+		// What PooledTexture held before the latest compute, for interpolating between updates. Only allocated while
+		// r.ShaderPlugin.UpdateRate.Interpolate is in effect.
+		TRefCountPtr<IPooledRenderTarget> HistoryPooledTexture;
+		TArray<FShaderUsageExampleHandle> SliceOwners;
+		double LastUsedTime = 0.0;
+	};
+	TMap<FComputeOutputKey, FComputeOutputArray> ComputeOutputArrays;
+	std::atomic<uint64> IntermediateMemorySize;
+
+	// An instance the renderer decided to draw this frame.
+	struct FPendingDraw
+	{
+		FShaderUsageExampleHandle Handle;
+		const FShaderUsageExampleParameters* Parameters;
+		FInstanceRenderState* State;
+		FComputeOutputKey ComputeOutputKey;
+		bool bNeedsCompute;
+		bool bFused; // Drawn by the fused compute pass instead of the compute and pixel passes.
+		bool bReadback;
+		bool bGenerateMips;
+		const FShaderPluginPostChain* PostChain;
+		FRDGTextureRef OutputTexture = nullptr; // The render target as registered by the pass that drew to it.
+	};
+
+	// Render thread scratch space for sorting out what needs to be drawn this frame.
+	TArray<FPendingDraw> PendingDraws;
+	TArray<FPendingDraw*> PendingComputes;
+
+	// A staging buffer in the readback ring, and what was copied into it.
+	struct FReadbackSlot
+	{
+		TUniquePtr<FRHIGPUTextureReadback> Readback;
+		FShaderUsageExampleHandle Handle;
+		uint64 FrameNumber = 0;
+		FIntPoint Size = FIntPoint::ZeroValue;
+		EPixelFormat Format = PF_Unknown;
+		bool bInFlight = false;
+	};
+	TArray<FReadbackSlot> ReadbackSlots;
+	int32 NextReadbackSlot;
+	FOnShaderUsageExampleReadback OnReadbackDelegate;
+	std::atomic<uint64> DroppedReadbackCount;
+
+	void AddRenderingHooks();
+	void RemoveRenderingHooks();
+	void PublishInstances_GameThread();
+
+	// Marks every instance with consumers as visible or not, depending on whether any of them was rendered recently.
+	void UpdateInstanceVisibility_GameThread();
+	void PostResolveSceneColor_RenderThread(FRDGBuilder& GraphBuilder, const FSceneTextures& SceneTexture);
+	void EndFrame_RenderThread();
+
+	// Decides what to do this engine frame, given r.ShaderPlugin.UpdateRate. Interpolation is only ever returned when bCanInterpolate.
+	EScheduledWork Schedule_RenderThread(double CurrentTime, bool bCanInterpolate);
+
+	// How far between the previous compute and the latest one the pixel pass should blend.
+	float GetInterpolationAlpha_RenderThread(double CurrentTime) const;
+
+	// Draws the latest instances, either into the graph or on the CPU.
+	void Render_RenderThread(FRDGBuilder& GraphBuilder);
+	void RenderCPU_RenderThread();
+
+	// Runs only the pixel pass of every instance that has an older compute to blend from. Used between updates.
+	void RenderInterpolated_RenderThread(FRDGBuilder& GraphBuilder, double CurrentTime);
+
+	// Picks up the latest instances published by the game thread. The render thread owns the returned frame until the next call.
+	FShaderUsageExampleInstancesFrame& ConsumeInstances_RenderThread();
+
+	// Returns the render state of an instance if it needs to be drawn, and records that it has been. Bumps the instance's LastSeenFrame either way.
+	FInstanceRenderState* PrepareInstanceDraw_RenderThread(const FShaderUsageExampleInstance& Instance, FRHITexture* RenderTargetTexture, double CurrentTime, bool& bOutNeedsCompute);
+	void ReleaseStaleInstanceRenderStates_RenderThread();
+
+	static FComputeOutputKey GetComputeOutputKey(const FShaderUsageExampleParameters& DrawParameters);
+
+	// Gives the instance a slice in the intermediate matching Key, keeping the one it has if it already matches. Fails if the intermediate is full.
+	bool AcquireComputeOutputSlice_RenderThread(FShaderUsageExampleHandle Handle, FInstanceRenderState& State, const FComputeOutputKey& Key);
+	void ReleaseComputeOutputSlice_RenderThread(FInstanceRenderState& State);
+
+	// Registers the intermediate with the graph, first growing it if more slices are in use than it has room for.
+	FRDGTextureRef GetComputeOutputTexture_RenderThread(FRDGBuilder& GraphBuilder, const FComputeOutputKey& Key, FComputeOutputArray& ComputeOutputArray);
+
+	// Copies the intermediate into its history before it gets recomputed, allocating the history if it doesn't match.
+	void UpdateComputeOutputHistory_RenderThread(FRDGBuilder& GraphBuilder, FRDGTextureRef ComputeShaderOutput, FComputeOutputArray& ComputeOutputArray);
+	void ReleaseIdleComputeOutputs_RenderThread(double CurrentTime);
+	void ReleaseComputeOutputs_RenderThread();
+	void UpdateIntermediateMemoryStats_RenderThread();
+
+	// Computes a batch of instances that all share the same intermediate.
+	void Compute_RenderThread(FRDGBuilder& GraphBuilder, TConstArrayView<FPendingDraw*> Batch, double CurrentTime);
+
+	// Runs the fused compute pass of every pending draw whose render target supports it.
+	void DrawFused_RenderThread(FRDGBuilder& GraphBuilder);
+
+	// Runs the pixel pass of every other pending draw, reading each instance's slice of its intermediate.
+	void DrawPending_RenderThread(FRDGBuilder& GraphBuilder, double CurrentTime);
+	void DrawCPU_RenderThread(const FShaderUsageExampleParameters& DrawParameters, TArray<FColor>& CPUOutput);
+
+	// Runs the post chain of every pending draw that has one, on what the draw wrote to its render target.
+	void DrawPostChains_RenderThread(FRDGBuilder& GraphBuilder);
+
+	// Builds the mip chain of every pending draw that wants it, after the draw has written the top mip.
+	void GenerateMips_RenderThread(FRDGBuilder& GraphBuilder);
 
-	void PostResolveSceneColor_RenderThread(FRDGBuilder& builder, const FSceneTextures& SceneTexture);
+	// Copies the output of every pending draw that wants it into the next free readback slot.
+	void EnqueueReadbacks_RenderThread(FRDGBuilder& GraphBuilder, uint64 FrameNumber);
+	void EnqueueReadback_RenderThread(FRDGBuilder& GraphBuilder, FShaderUsageExampleHandle Handle, uint64 FrameNumber, FRDGTextureRef OutputTexture);
 
-	void Draw_RenderThread(const FShaderUsageExampleParameters& DrawParameters);
+	// Hands every finished readback to OnReadback, without waiting for the ones that aren't.
+	void PollReadbacks_RenderThread();
+	void ReleaseReadbacks_RenderThread();
 };
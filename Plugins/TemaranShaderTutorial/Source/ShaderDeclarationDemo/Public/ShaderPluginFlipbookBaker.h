@@ -0,0 +1,50 @@
+// Copyright 2016-2020 Cadic AB. All Rights Reserved.
+// @Author	Fredrik Lindh [Temaran] (temaran@gmail.com) {https://github.com/Temaran}
+///////////////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "ShaderDeclarationDemoModule.h"
+
+struct FShaderPluginFlipbookSettings
+{
+	FIntPoint FrameSize = FIntPoint(256, 256);
+	int32 NumFrames = 64;
+
+	// SimulationState is swept from StartTime to StartTime + LoopPeriod, so the flipbook should be played back
+	// at one loop per LoopPeriod of whatever drives SimulationState at runtime.
+	float StartTime = 0.0f;
+	float LoopPeriod = 20.0f;
+
+	// The effect never repeats by itself, so we crossfade every frame with the one a LoopPeriod earlier to hide the seam.
+	// This renders everything twice.
+	bool bSeamlessLoop = true;
+
+	// What to draw. The render target and SimulationState are ignored.
+	FShaderUsageExampleParameters Parameters;
+
+	// Renders the frames with the fused compute shader when there is a GPU that can run it, and with the CPU kernel otherwise.
+	bool bUseGPU = true;
+};
+
+struct FShaderPluginFlipbookStats
+{
+	bool bUsedGPU = false;
+	double BakeSeconds = 0.0;
+
+	// How many pixels the effect was evaluated for, which is twice the flipbook size with bSeamlessLoop.
+	int64 NumEvaluatedPixels = 0;
+};
+
+/*
+ * Renders the effect to a sequence of frames that loops over a fixed period, so it can be played back from a texture
+ * array on platforms that can't afford to run the fractal. The frames are sRGB encoded BGRA8 (FColor), which is what
+ * the texture source of the flipbook asset expects. Turning them into an asset is up to the caller, since that needs the editor.
+ */
+class SHADERDECLARATIONDEMO_API FShaderPluginFlipbookBaker
+{
+public:
+	// Blocks until every frame is done. Game thread only.
+	static bool BakeFrames(const FShaderPluginFlipbookSettings& Settings, TArray<TArray<FColor>>& OutFrames, FShaderPluginFlipbookStats& OutStats);
+};
@@ -0,0 +1,117 @@
+// Copyright 2016-2020 Cadic AB. All Rights Reserved.
+// @Author	Fredrik Lindh [Temaran] (temaran@gmail.com) {https://github.com/Temaran}
+///////////////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include "CoreMinimal.h"
+
+#include <atomic>
+
+#include "ShaderDeclarationDemoModule.h"
+
+class FEvent;
+class FQueuedThreadPool;
+class IImageWrapperModule;
+
+enum class EShaderPluginFrameFormat : uint8
+{
+	PNG,	// 8 bits per channel. Float render targets are quantized
+	EXR,	// 16 bit floats per channel. 8 bit render targets are converted from sRGB to linear
+};
+
+struct FShaderPluginFrameEncoderSettings
+{
+	// Frames are written to OutputDirectory/BaseFilename_00000.png and so on, numbered in the order they were queued.
+	FString OutputDirectory;
+	FString BaseFilename = TEXT("Frame");
+	EShaderPluginFrameFormat Format = EShaderPluginFrameFormat::PNG;
+
+	// How many frames can wait to be written before the producer has to wait or drop. 0 means twice the number of threads
+	// in the shared worker pool.
+	// This is also the number of pixel buffers the encoder allocates, since they are reused from frame to frame.
+	int32 MaxQueuedFrames = 0;
+
+	// What to do when the queue is full. Live streaming would rather skip a frame, while offline captures usually want every
+	// frame and accept the lower frame rate. Frames coming in on the render thread are always dropped when the queue is full
+	// though, since waiting there would stall rendering for everything else too, so attached encoders rely on the game thread
+	// calling WaitForCapacity before it renders a frame instead.
+	bool bDropWhenFull = true;
+};
+
+/*
+ * Compresses frames read back from the plugin (see FShaderDeclarationDemoModule::SetReadbackEnabled) to image files on a
+ * pool of worker threads, so neither the game thread nor the render thread ever waits for the compression.
+ * The only work done by the caller is one copy of the pixels into a pooled buffer.
+ * All encoders share the same pool, which leaves a couple of cores for the game and render threads, so having one encoder
+ * per instance doesn't put more threads on the CPU than it has cores.
+ */
+class SHADERDECLARATIONDEMO_API FShaderPluginFrameEncoder
+{
+public:
+	explicit FShaderPluginFrameEncoder(const FShaderPluginFrameEncoderSettings& InSettings);
+
+	// Waits for all queued frames to be written.
+	~FShaderPluginFrameEncoder();
+
+	FShaderPluginFrameEncoder(const FShaderPluginFrameEncoder&) = delete;
+	FShaderPluginFrameEncoder& operator=(const FShaderPluginFrameEncoder&) = delete;
+
+	// Enables readback for an instance and encodes every frame of it that comes back. Game thread only.
+	void Attach(FShaderUsageExampleHandle Handle);
+	void Detach();
+
+	// Copies the frame and queues it for encoding. Returns false if the frame was dropped, either because the queue
+	// was full and we couldn't wait for it, or because its pixel format can't be encoded. Any thread.
+	bool EnqueueFrame(const FShaderUsageExampleReadback& Readback);
+
+	// Blocks until the queue has room for every readback the plugin can hand us in one frame, which is what keeps attached
+	// encoders from dropping frames on the render thread. Call it on the game thread before rendering each frame. Does
+	// nothing when bDropWhenFull is set, since dropping is fine then.
+	void WaitForCapacity();
+
+	// Blocks until every queued frame has been written.
+	void Flush();
+
+	int32 GetNumEncodedFrames() const { return NumEncodedFrames; }
+	int32 GetNumDroppedFrames() const { return NumDroppedFrames; }
+	int32 GetNumFailedFrames() const { return NumFailedFrames; }
+
+private:
+	// A frame on its way through the encoder. The buffers keep their allocations when the frame is reused.
+	struct FFrame
+	{
+		TArray64<uint8> Pixels;
+		TArray64<uint8> ConvertedPixels;
+		FIntPoint Size = FIntPoint::ZeroValue;
+		EPixelFormat Format = PF_Unknown;
+		int32 SequenceIndex = 0;
+	};
+
+	class FEncodeWork;
+
+	FFrame* AllocateFrame();
+	void ReleaseFrame(FFrame* Frame);
+	void EncodeFrame_AnyThread(FFrame& Frame);
+
+	// The pool lives for as long as there is an encoder using it.
+	static FQueuedThreadPool* AcquireThreadPool();
+	static void ReleaseThreadPool();
+
+	FShaderPluginFrameEncoderSettings Settings;
+	IImageWrapperModule* ImageWrapperModule;
+	FEvent* FrameReleasedEvent;
+
+	FCriticalSection FramePoolCriticalSection;
+	TArray<FFrame*> FreeFrames;
+	TArray<TUniquePtr<FFrame>> AllFrames;
+
+	std::atomic<int32> NumFramesInFlight;
+	std::atomic<int32> NextSequenceIndex;
+	std::atomic<int32> NumEncodedFrames;
+	std::atomic<int32> NumDroppedFrames;
+	std::atomic<int32> NumFailedFrames;
+
+	FShaderUsageExampleHandle AttachedHandle;
+	FDelegateHandle OnReadbackHandle;
+};
@@ -0,0 +1,110 @@
+// Copyright 2016-2020 Cadic AB. All Rights Reserved.
+// @Author	Fredrik Lindh [Temaran] (temaran@gmail.com) {https://github.com/Temaran}
+///////////////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "RenderGraphResources.h"
+
+// The kernels a post chain stage can run. They all read and write textures the size and format of the render target.
+enum class EShaderPluginPostKernel : uint8
+{
+	// Adds a blurred copy of the parts of Input brighter than Threshold, scaled by Intensity. Radius is in pixels.
+	Bloom,
+
+	// Maps the luminance of Input onto a gradient through the four Palette colors, and blends that in by Intensity.
+	PaletteRemap,
+
+	// Pushes Input away from the average of its neighbours by Intensity, which is an unsharp mask with a 3x3 blur.
+	Sharpen,
+
+	// Fades from Input to SecondInput by Intensity.
+	Blend,
+};
+
+// One pass of a post chain, and the named textures it reads and writes.
+struct SHADERDECLARATIONDEMO_API FShaderPluginPostStage
+{
+	EShaderPluginPostKernel Kernel = EShaderPluginPostKernel::Bloom;
+
+	// Either FShaderPluginPostChain::Effect, or the Output of an earlier stage. Left empty, it's the output of the stage right
+	// before this one, or the effect for the first stage, so a straight chain doesn't need to name anything.
+	FName Input;
+
+	// The second texture Blend reads. The other kernels ignore it.
+	FName SecondInput;
+
+	// What later stages call this one's output. Left empty it gets a name nobody else can use, except on the last stage,
+	// which always writes FShaderPluginPostChain::Output. Compile rejects names made from PostChainStage for that reason,
+	// so name the output of any stage you want to read out of order.
+	FName Output;
+
+	float Intensity = 1.0f;
+	float Threshold = 0.8f;
+	float Radius = 4.0f;
+	FLinearColor Palette[4] = { FLinearColor::Black, FLinearColor(0.5f, 0.0f, 0.5f), FLinearColor(1.0f, 0.5f, 0.0f), FLinearColor::White };
+
+	static FShaderPluginPostStage Bloom(float InThreshold = 0.8f, float InIntensity = 1.0f, float InRadius = 4.0f);
+	static FShaderPluginPostStage PaletteRemap(const FLinearColor& Dark, const FLinearColor& Shadows, const FLinearColor& Highlights, const FLinearColor& Bright, float InIntensity = 1.0f);
+	static FShaderPluginPostStage Sharpen(float InIntensity = 0.5f);
+	static FShaderPluginPostStage Blend(FName InInput, FName InSecondInput, float InIntensity = 0.5f);
+};
+
+class FShaderPluginPostChain;
+using FShaderPluginPostChainPtr = TSharedPtr<const FShaderPluginPostChain, ESPMode::ThreadSafe>;
+
+/*
+ * A chain of full screen passes that runs on the render target of an instance after the effect has been drawn into it, like
+ * fractal -> bloom -> palette remap -> sharpen. Stages only say which textures they read and write. Compile works out how
+ * long each of those is needed, and hands out the intermediates so that ones whose lifetimes don't overlap share the same
+ * texture. A straight chain of any length never needs more than two textures besides the render target. The graph places
+ * the barriers between the stages, and since the same texture is reused, only the transitions that are actually needed.
+ *
+ * Chains can't be changed once compiled, so the renderer can hold on to one while the game thread builds the next.
+ */
+class SHADERDECLARATIONDEMO_API FShaderPluginPostChain
+{
+public:
+	// What the effect drew into the render target, before any stage has run.
+	static const FName Effect;
+
+	// What ends up in the render target. Only the last stage writes it.
+	static const FName Output;
+
+	// Checks that the stages make a chain and assigns their textures. Returns null and logs why if they don't.
+	static FShaderPluginPostChainPtr Compile(const TArray<FShaderPluginPostStage>& InStages);
+
+	const TArray<FShaderPluginPostStage>& GetStages() const
+	{
+		return Stages;
+	}
+
+	// How many textures the size of the render target the chain allocates when it runs.
+	int32 GetNumIntermediates() const
+	{
+		return NumIntermediates;
+	}
+
+	// Runs every stage on RenderTargetTexture, which must hold the drawn effect.
+	void AddPasses_RenderThread(FRDGBuilder& GraphBuilder, FRDGTextureRef RenderTargetTexture) const;
+
+private:
+	// Stands for the render target wherever an intermediate index would go.
+	static constexpr int32 RenderTargetIndex = INDEX_NONE;
+
+	struct FCompiledStage
+	{
+		int32 InputIndex = RenderTargetIndex;
+		int32 SecondInputIndex = RenderTargetIndex;
+		int32 OutputIndex = RenderTargetIndex;
+	};
+
+	TArray<FShaderPluginPostStage> Stages;
+	TArray<FCompiledStage> CompiledStages;
+	int32 NumIntermediates = 0;
+
+	// When the last stage still reads the effect, the render target can't be both its input and its output, so the effect
+	// is copied to this intermediate first.
+	int32 EffectCopyIndex = RenderTargetIndex;
+};
@@ -0,0 +1,36 @@
+// Copyright 2016-2020 Cadic AB. All Rights Reserved.
+// @Author	Fredrik Lindh [Temaran] (temaran@gmail.com) {https://github.com/Temaran}
+///////////////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "ShaderDeclarationDemoModule.h"
+
+struct FShaderPluginPosterSettings
+{
+	// The image is written as a tiled TIFF, or a BigTIFF once it goes over 4GB.
+	FString Filename;
+	FIntPoint Size = FIntPoint(16384, 16384);
+
+	// The image is rendered and written this many pixels square at a time. Must be a multiple of 16.
+	int32 TileSize = 1024;
+
+	// What to draw. The render target is ignored.
+	FShaderUsageExampleParameters Parameters;
+
+	// Renders the tiles with the fused compute shader when there is a GPU that can run it, and with the CPU kernel otherwise.
+	bool bUseGPU = true;
+};
+
+/*
+ * Renders the effect at sizes that would never fit in a single render target, like 16k-32k posters for print. The image is
+ * evaluated one tile at a time, with every pixel placed in the whole image so the tiles join up seamlessly, and each tile
+ * is written to disk as soon as it is done. Only a handful of tiles are ever in memory, however large the image is.
+ */
+class SHADERDECLARATIONDEMO_API FShaderPluginPosterRenderer
+{
+public:
+	// Blocks until the whole image has been written. Game thread only.
+	static bool Render(const FShaderPluginPosterSettings& Settings);
+};
@@ -24,7 +24,9 @@ namespace UnrealBuildTool.Rules
                 "Renderer",
                 "RenderCore",
                 "RHI",
-                "Projects"
+                "Projects",
+                "ImageWrapper",
+                "Json"
 			});
 		}
 	}
@@ -0,0 +1,64 @@
+// Copyright 2016-2020 Cadic AB. All Rights Reserved.
+// @Author	Fredrik Lindh [Temaran] (temaran@gmail.com) {https://github.com/Temaran}
+///////////////////////////////////////////////////////////////////////////////////////
+
+#include "ShaderDemoMaterialInstancePool.h"
+
+#include "Components/PrimitiveComponent.h"
+#include "Engine/Texture.h"
+#include "Materials/MaterialInstanceDynamic.h"
+
+UMaterialInstanceDynamic* UShaderDemoMaterialInstancePool::FindOrCreate(UMaterialInterface* BaseMaterial, FName TextureParameterName, UTexture* Texture)
+{
+	check(IsInGameThread());
+
+	if (!BaseMaterial)
+	{
+		return nullptr;
+	}
+
+	const FKey Key{ BaseMaterial, TextureParameterName, Texture };
+	if (UMaterialInstanceDynamic** Instance = InstanceLookup.Find(Key))
+	{
+		return *Instance;
+	}
+
+	// The instance is shared between components, so it can't be outered to any one of them like CreateAndSetMaterialInstanceDynamic does.
+	UMaterialInstanceDynamic* Instance = UMaterialInstanceDynamic::Create(BaseMaterial, this);
+	Instance->SetTextureParameterValue(TextureParameterName, Texture);
+	Instances.Add(Instance);
+	InstanceLookup.Add(Key, Instance);
+	return Instance;
+}
+
+int32 UShaderDemoMaterialInstancePool::ApplyToComponents(TConstArrayView<UPrimitiveComponent*> Components, int32 ElementIndex, UMaterialInterface* BaseMaterial, FName TextureParameterName, UTexture* Texture, TArray<UPrimitiveComponent*>* OutChangedComponents)
+{
+	UMaterialInstanceDynamic* Instance = FindOrCreate(BaseMaterial, TextureParameterName, Texture);
+	if (!Instance)
+	{
+		return 0;
+	}
+
+	int32 NumChanged = 0;
+	for (UPrimitiveComponent* Component : Components)
+	{
+		if (Component && Component->GetMaterial(ElementIndex) != Instance)
+		{
+			Component->SetMaterial(ElementIndex, Instance);
+			NumChanged++;
+
+			if (OutChangedComponents)
+			{
+				OutChangedComponents->Add(Component);
+			}
+		}
+	}
+
+	return NumChanged;
+}
+
+void UShaderDemoMaterialInstancePool::Empty()
+{
+	Instances.Empty();
+	InstanceLookup.Empty();
+}
@@ -0,0 +1,63 @@
+// Copyright 2016-2020 Cadic AB. All Rights Reserved.
+// @Author	Fredrik Lindh [Temaran] (temaran@gmail.com) {https://github.com/Temaran}
+///////////////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include "CoreMinimal.h"
+
+#include "UObject/Object.h"
+#include "ShaderDemoMaterialInstancePool.generated.h"
+
+class UMaterialInstanceDynamic;
+class UMaterialInterface;
+class UPrimitiveComponent;
+class UTexture;
+
+/*
+ * Every mesh we paint shows the same render target through the same material, so there's no reason for each of them
+ * to have a dynamic material instance of its own. This hands out one shared instance per base material, texture
+ * parameter and texture, and keeps it alive for as long as the pool is around, so repeated hits don't allocate anything
+ * and there's nothing for the garbage collector to clean up afterwards. Keep the pool in a UPROPERTY of whoever owns it.
+ */
+UCLASS(Transient)
+class UShaderDemoMaterialInstancePool : public UObject
+{
+	GENERATED_BODY()
+
+public:
+	// Returns the shared instance of BaseMaterial that has Texture bound to TextureParameterName, making it on first use.
+	UMaterialInstanceDynamic* FindOrCreate(UMaterialInterface* BaseMaterial, FName TextureParameterName, UTexture* Texture);
+
+	// Sets the shared instance on ElementIndex of every component in one go. Components that already show it are left alone,
+	// since setting a material marks the render state dirty even when nothing changed. Returns how many were changed, and
+	// adds those to OutChangedComponents if given.
+	int32 ApplyToComponents(TConstArrayView<UPrimitiveComponent*> Components, int32 ElementIndex, UMaterialInterface* BaseMaterial, FName TextureParameterName, UTexture* Texture, TArray<UPrimitiveComponent*>* OutChangedComponents = nullptr);
+
+	// Lets go of every instance. Components still using them keep them alive until they stop.
+	void Empty();
+
+	int32 Num() const
+	{
+		return Instances.Num();
+	}
+
+private:
+	struct FKey
+	{
+		UMaterialInterface* BaseMaterial = nullptr;
+		FName TextureParameterName;
+		UTexture* Texture = nullptr;
+
+		bool operator==(const FKey& Other) const { return BaseMaterial == Other.BaseMaterial && TextureParameterName == Other.TextureParameterName && Texture == Other.Texture; }
+		friend uint32 GetTypeHash(const FKey& Key) { return HashCombine(HashCombine(GetTypeHash(Key.BaseMaterial), GetTypeHash(Key.TextureParameterName)), GetTypeHash(Key.Texture)); }
+	};
+
+	// Every instance we have handed out, which is what keeps them alive.
+	UPROPERTY(Transient)
+	TArray<UMaterialInstanceDynamic*> Instances;
+
+	// The keys are only compared, never dereferenced, and the values are the ones in Instances.
+	// If a base material or texture goes away, its entry is never looked up again and is dropped with Empty.
+	TMap<FKey, UMaterialInstanceDynamic*> InstanceLookup;
+};
@@ -0,0 +1,424 @@
+// Copyright 2016-2020 Cadic AB. All Rights Reserved.
+// @Author	Fredrik Lindh [Temaran] (temaran@gmail.com) {https://github.com/Temaran}
+///////////////////////////////////////////////////////////////////////////////////////
+
+#include "ShaderPluginBenchmarkCommandlet.h"
+
+#include "ShaderDeclarationDemoModule.h"
+#include "ShaderPluginFrameEncoder.h"
+
+#include "Dom/JsonObject.h"
+#include "Engine/TextureRenderTarget2D.h"
+#include "HAL/IConsoleManager.h"
+#include "Misc/App.h"
+#include "Misc/EngineVersion.h"
+#include "Misc/FileHelper.h"
+#include "Misc/Paths.h"
+#include "RenderingThread.h"
+#include "RHI.h"
+#include "RHICommandList.h"
+#include "Serialization/JsonSerializer.h"
+#include "Serialization/JsonWriter.h"
+
+DEFINE_LOG_CATEGORY_STATIC(LogShaderPluginBenchmark, Log, All);
+
+namespace
+{
+	// An execution mode is a set of console variable values, applied for the duration of the mode.
+	struct FBenchmarkMode
+	{
+		const TCHAR* Name;
+		bool bNeedsGPU;
+		TArray<TPair<const TCHAR*, const TCHAR*>> ConsoleVariables;
+	};
+
+	struct FBenchmarkParameterSet
+	{
+		const TCHAR* Name;
+		float ComputeShaderBlend;
+	};
+
+	const FBenchmarkParameterSet ParameterSets[] =
+	{
+		{ TEXT("Gradient"), 0.0f }, // Only the color gradient, so the fractal is skipped
+		{ TEXT("Blend"), 0.5f },    // What the demo character starts with
+		{ TEXT("Fractal"), 1.0f },  // Only the fractal
+	};
+
+	TArray<FBenchmarkMode> GetModes()
+	{
+		return
+		{
+			{ TEXT("CPU"), false, { { TEXT("r.ShaderPlugin.Backend"), TEXT("2") } } },
+			{ TEXT("GPU"), true, { { TEXT("r.ShaderPlugin.Backend"), TEXT("1") } } },
+			{ TEXT("GPUPacked"), true, { { TEXT("r.ShaderPlugin.Backend"), TEXT("1") }, { TEXT("r.ShaderPlugin.TypedUAVOutput"), TEXT("0") } } },
+			{ TEXT("GPUFused"), true, { { TEXT("r.ShaderPlugin.Backend"), TEXT("1") }, { TEXT("r.ShaderPlugin.FusedCompute"), TEXT("1") } } },
+			{ TEXT("GPUAsyncCompute"), true, { { TEXT("r.ShaderPlugin.Backend"), TEXT("1") }, { TEXT("r.ShaderPlugin.AsyncCompute"), TEXT("1") } } },
+			{ TEXT("GPUTileCulling"), true, { { TEXT("r.ShaderPlugin.Backend"), TEXT("1") }, { TEXT("r.ShaderPlugin.TileCulling"), TEXT("1") } } },
+			{ TEXT("GPUHalf"), true, { { TEXT("r.ShaderPlugin.Backend"), TEXT("1") }, { TEXT("r.ShaderPlugin.HalfPrecision"), TEXT("1") } } },
+		};
+	}
+
+	// Brackets the GPU work of a frame with timestamps, since the frame time only tells how long it took to submit.
+	// Timestamps are taken on the graphics pipe, so with async compute they include the wait for the compute work to finish.
+	struct FGPUFrameTimer
+	{
+		FRenderQueryRHIRef BeginQuery;
+		FRenderQueryRHIRef EndQuery;
+
+		static bool IsSupported()
+		{
+			return !GUsingNullRHI && GSupportsTimestampRenderQueries;
+		}
+
+		void Begin()
+		{
+			ENQUEUE_RENDER_COMMAND(ShaderPluginBenchmark_BeginTimestamp)([this](FRHICommandListImmediate& RHICmdList)
+			{
+				if (!BeginQuery.IsValid())
+				{
+					BeginQuery = RHICreateRenderQuery(RQT_AbsoluteTime);
+					EndQuery = RHICreateRenderQuery(RQT_AbsoluteTime);
+				}
+				RHICmdList.EndRenderQuery(BeginQuery);
+			});
+		}
+
+		void End()
+		{
+			ENQUEUE_RENDER_COMMAND(ShaderPluginBenchmark_EndTimestamp)([this](FRHICommandListImmediate& RHICmdList)
+			{
+				RHICmdList.EndRenderQuery(EndQuery);
+			});
+		}
+
+		// Waits for the GPU to get through the frame, and returns the milliseconds between the two timestamps, or a negative
+		// number if they couldn't be read.
+		double Resolve()
+		{
+			double GPUTime = -1.0;
+			ENQUEUE_RENDER_COMMAND(ShaderPluginBenchmark_ResolveTimestamps)([this, &GPUTime](FRHICommandListImmediate& RHICmdList)
+			{
+				RHICmdList.ImmediateFlush(EImmediateFlushType::FlushRHIThread);
+
+				// Timestamp queries are resolved to microseconds.
+				uint64 BeginTime = 0;
+				uint64 EndTime = 0;
+				if (RHIGetRenderQueryResult(BeginQuery, BeginTime, true) && RHIGetRenderQueryResult(EndQuery, EndTime, true) && EndTime >= BeginTime)
+				{
+					GPUTime = (EndTime - BeginTime) / 1000.0;
+				}
+			});
+			FlushRenderingCommands();
+			return GPUTime;
+		}
+
+		void Release()
+		{
+			ENQUEUE_RENDER_COMMAND(ShaderPluginBenchmark_ReleaseTimestamps)([this](FRHICommandListImmediate& RHICmdList)
+			{
+				BeginQuery.SafeRelease();
+				EndQuery.SafeRelease();
+			});
+			FlushRenderingCommands();
+		}
+	};
+
+	TSharedRef<FJsonObject> MakeSummary(TArray<double> Samples)
+	{
+		TSharedRef<FJsonObject> Summary = MakeShared<FJsonObject>();
+		if (Samples.Num() == 0)
+		{
+			return Summary;
+		}
+
+		Samples.Sort();
+		double Total = 0.0;
+		for (double Sample : Samples)
+		{
+			Total += Sample;
+		}
+
+		Summary->SetNumberField(TEXT("Min"), Samples[0]);
+		Summary->SetNumberField(TEXT("Mean"), Total / Samples.Num());
+		Summary->SetNumberField(TEXT("Median"), Samples[Samples.Num() / 2]);
+		Summary->SetNumberField(TEXT("P95"), Samples[FMath::Min(FMath::FloorToInt(Samples.Num() * 0.95), Samples.Num() - 1)]);
+		Summary->SetNumberField(TEXT("Max"), Samples.Last());
+		return Summary;
+	}
+}
+
+UShaderPluginBenchmarkCommandlet::UShaderPluginBenchmarkCommandlet()
+{
+	IsClient = false;
+	IsServer = false;
+	IsEditor = false;
+	LogToConsole = true;
+}
+
+int32 UShaderPluginBenchmarkCommandlet::Main(const FString& Params)
+{
+	int32 NumFrames = 100;
+	int32 NumWarmupFrames = 10;
+	int32 NumInstances = 1;
+	FString SizesString = TEXT("256,512,1024");
+	FString ModesString;
+	FString EncodeString;
+	FString OutputPath = FPaths::Combine(FPaths::ProjectSavedDir(), TEXT("Benchmarks"), TEXT("ShaderPluginBenchmark.json"));
+	FParse::Value(*Params, TEXT("Frames="), NumFrames);
+	FParse::Value(*Params, TEXT("WarmupFrames="), NumWarmupFrames);
+	FParse::Value(*Params, TEXT("Instances="), NumInstances);
+	FParse::Value(*Params, TEXT("Sizes="), SizesString, false);
+	FParse::Value(*Params, TEXT("Modes="), ModesString, false);
+	FParse::Value(*Params, TEXT("Output="), OutputPath);
+	FParse::Value(*Params, TEXT("Encode="), EncodeString);
+	NumFrames = FMath::Max(NumFrames, 1);
+	NumInstances = FMath::Max(NumInstances, 1);
+
+	TArray<FString> SizeStrings;
+	SizesString.ParseIntoArray(SizeStrings, TEXT(","));
+	TArray<FString> RequestedModes;
+	ModesString.ParseIntoArray(RequestedModes, TEXT(","));
+
+	const bool bEncode = !EncodeString.IsEmpty();
+	const EShaderPluginFrameFormat EncodeFormat = EncodeString.Equals(TEXT("EXR"), ESearchCase::IgnoreCase) ? EShaderPluginFrameFormat::EXR : EShaderPluginFrameFormat::PNG;
+
+	FShaderDeclarationDemoModule& ShaderModule = FShaderDeclarationDemoModule::Get();
+	ShaderModule.BeginRendering();
+
+	TArray<TSharedPtr<FJsonValue>> Results;
+	for (const FBenchmarkMode& Mode : GetModes())
+	{
+		if (RequestedModes.Num() > 0 && !RequestedModes.Contains(Mode.Name))
+		{
+			continue;
+		}
+
+		if (Mode.bNeedsGPU && GUsingNullRHI)
+		{
+			UE_LOG(LogShaderPluginBenchmark, Display, TEXT("Skipping %s, since there is no GPU with -nullrhi."), Mode.Name);
+			continue;
+		}
+
+		// Remember what the console variables were, so the next mode starts from the same defaults.
+		TArray<TPair<IConsoleVariable*, FString>> PreviousValues;
+		for (const TPair<const TCHAR*, const TCHAR*>& ConsoleVariable : Mode.ConsoleVariables)
+		{
+			if (IConsoleVariable* Variable = IConsoleManager::Get().FindConsoleVariable(ConsoleVariable.Key))
+			{
+				PreviousValues.Emplace(Variable, Variable->GetString());
+				Variable->Set(ConsoleVariable.Value, ECVF_SetByCode);
+			}
+		}
+
+		for (const FString& SizeString : SizeStrings)
+		{
+			// Sizes are either square, like 512, or WidthxHeight, like 1024x256.
+			FString WidthString = SizeString;
+			FString HeightString = SizeString;
+			SizeString.Split(TEXT("x"), &WidthString, &HeightString, ESearchCase::IgnoreCase);
+			const FIntPoint Size(FCString::Atoi(*WidthString), FCString::Atoi(*HeightString));
+			if (Size.GetMin() <= 0)
+			{
+				continue;
+			}
+
+			// The fused mode only kicks in for render targets that can be written as a UAV, so we make them all like that.
+			TArray<UTextureRenderTarget2D*> RenderTargets;
+			for (int32 InstanceIndex = 0; InstanceIndex < NumInstances; InstanceIndex++)
+			{
+				UTextureRenderTarget2D* RenderTarget = NewObject<UTextureRenderTarget2D>(GetTransientPackage());
+				RenderTarget->AddToRoot();
+				RenderTarget->bCanCreateUAV = true;
+				RenderTarget->InitCustomFormat(Size.X, Size.Y, PF_B8G8R8A8, true);
+				RenderTarget->UpdateResourceImmediate(false);
+				RenderTargets.Add(RenderTarget);
+			}
+			FlushRenderingCommands();
+
+			for (const FBenchmarkParameterSet& ParameterSet : ParameterSets)
+			{
+				TArray<FShaderUsageExampleHandle> Handles;
+				TArray<TUniquePtr<FShaderPluginFrameEncoder>> Encoders;
+				TArray<double> FrameTimes;
+				TArray<double> GPUTimes;
+				FGPUFrameTimer GPUTimer;
+				const bool bMeasureGPU = Mode.bNeedsGPU && FGPUFrameTimer::IsSupported();
+
+				for (int32 FrameIndex = 0; FrameIndex < NumWarmupFrames + NumFrames; FrameIndex++)
+				{
+					const double FrameStartTime = FPlatformTime::Seconds();
+
+					// Everything changes every frame, like in the demo, so nothing gets skipped for being unchanged.
+					for (int32 InstanceIndex = 0; InstanceIndex < NumInstances; InstanceIndex++)
+					{
+						FShaderUsageExampleParameters DrawParameters(RenderTargets[InstanceIndex]);
+						DrawParameters.SimulationState = FrameIndex / 60.0f + InstanceIndex;
+						DrawParameters.ComputeShaderBlend = ParameterSet.ComputeShaderBlend;
+						DrawParameters.StartColor = FColor::Green;
+						DrawParameters.EndColor = FColor((FrameIndex * 4) % 256, 0, 0, 255);
+
+						if (Handles.Num() <= InstanceIndex)
+						{
+							Handles.Add(ShaderModule.RegisterInstance(DrawParameters));
+
+							if (bEncode)
+							{
+								FShaderPluginFrameEncoderSettings EncoderSettings;
+								EncoderSettings.OutputDirectory = FPaths::Combine(FPaths::GetPath(OutputPath), TEXT("Frames"), FString::Printf(TEXT("%s_%dx%d_%s"), Mode.Name, Size.X, Size.Y, ParameterSet.Name));
+								EncoderSettings.BaseFilename = FString::Printf(TEXT("Instance%d"), InstanceIndex);
+								EncoderSettings.Format = EncodeFormat;
+								EncoderSettings.bDropWhenFull = false;
+								Encoders.Add(MakeUnique<FShaderPluginFrameEncoder>(EncoderSettings));
+								Encoders.Last()->Attach(Handles.Last());
+							}
+						}
+						else
+						{
+							ShaderModule.UpdateInstance(Handles[InstanceIndex], DrawParameters);
+						}
+					}
+
+					// Every frame is written, so when the disk can't keep up this shows up as a longer frame time.
+					for (TUniquePtr<FShaderPluginFrameEncoder>& Encoder : Encoders)
+					{
+						Encoder->WaitForCapacity();
+					}
+
+					if (bMeasureGPU)
+					{
+						GPUTimer.Begin();
+					}
+					ShaderModule.RenderFrame_GameThread();
+					if (bMeasureGPU)
+					{
+						GPUTimer.End();
+					}
+					FlushRenderingCommands();
+					GFrameCounter++;
+
+					// This is how long the game and render threads took to submit the frame. The GPU may well still be at it.
+					const double FrameTime = (FPlatformTime::Seconds() - FrameStartTime) * 1000.0;
+
+					// Waiting for the GPU every frame keeps it from overlapping frames, but it is the only way to put a number on
+					// a single frame, and it is outside of the frame time above.
+					const double GPUTime = bMeasureGPU ? GPUTimer.Resolve() : -1.0;
+
+					if (FrameIndex >= NumWarmupFrames)
+					{
+						FrameTimes.Add(FrameTime);
+						if (GPUTime >= 0.0)
+						{
+							GPUTimes.Add(GPUTime);
+						}
+					}
+				}
+				GPUTimer.Release();
+
+				// The frame times above include the copies into the encoder, but the compression runs in the background.
+				// Waiting for the encoder to catch up tells us how far behind real time it fell.
+				const double EncodeFlushStartTime = FPlatformTime::Seconds();
+				int32 NumEncodedFrames = 0;
+				int32 NumDroppedEncodes = 0;
+				for (TUniquePtr<FShaderPluginFrameEncoder>& Encoder : Encoders)
+				{
+					Encoder->Flush();
+					NumEncodedFrames += Encoder->GetNumEncodedFrames();
+					NumDroppedEncodes += Encoder->GetNumDroppedFrames() + Encoder->GetNumFailedFrames();
+				}
+				const double EncodeFlushTime = (FPlatformTime::Seconds() - EncodeFlushStartTime) * 1000.0;
+				Encoders.Reset();
+
+				for (FShaderUsageExampleHandle& Handle : Handles)
+				{
+					ShaderModule.UnregisterInstance(Handle);
+				}
+
+				double TotalFrameTime = 0.0;
+				for (double FrameTime : FrameTimes)
+				{
+					TotalFrameTime += FrameTime;
+				}
+				double TotalGPUTime = 0.0;
+				for (double GPUTime : GPUTimes)
+				{
+					TotalGPUTime += GPUTime;
+				}
+
+				// The CPU backend does all of its work in the frame time, but for the GPU ones only the GPU time says anything
+				// about throughput.
+				const double PixelsPerFrame = (double)Size.X * Size.Y * NumInstances;
+				const double PixelsPerSecond = TotalFrameTime > 0.0 ? PixelsPerFrame * FrameTimes.Num() / (TotalFrameTime / 1000.0) : 0.0;
+				const double GPUPixelsPerSecond = TotalGPUTime > 0.0 ? PixelsPerFrame * GPUTimes.Num() / (TotalGPUTime / 1000.0) : 0.0;
+
+				TSharedRef<FJsonObject> Result = MakeShared<FJsonObject>();
+				Result->SetStringField(TEXT("Mode"), Mode.Name);
+				Result->SetStringField(TEXT("Parameters"), ParameterSet.Name);
+				Result->SetNumberField(TEXT("Width"), Size.X);
+				Result->SetNumberField(TEXT("Height"), Size.Y);
+				Result->SetNumberField(TEXT("Instances"), NumInstances);
+				Result->SetObjectField(TEXT("FrameTimeMs"), MakeSummary(FrameTimes));
+				Result->SetNumberField(TEXT("PixelsPerSecond"), PixelsPerSecond);
+				if (GPUTimes.Num() > 0)
+				{
+					Result->SetObjectField(TEXT("GPUTimeMs"), MakeSummary(GPUTimes));
+					Result->SetNumberField(TEXT("GPUPixelsPerSecond"), GPUPixelsPerSecond);
+				}
+				if (bEncode)
+				{
+					Result->SetNumberField(TEXT("EncodedFrames"), NumEncodedFrames);
+					Result->SetNumberField(TEXT("DroppedEncodes"), NumDroppedEncodes);
+					Result->SetNumberField(TEXT("EncodeFlushMs"), EncodeFlushTime);
+				}
+
+				TArray<TSharedPtr<FJsonValue>> FrameTimeValues;
+				for (double FrameTime : FrameTimes)
+				{
+					FrameTimeValues.Add(MakeShared<FJsonValueNumber>(FrameTime));
+				}
+				Result->SetArrayField(TEXT("FrameTimesMs"), FrameTimeValues);
+				Results.Add(MakeShared<FJsonValueObject>(Result));
+
+				UE_LOG(LogShaderPluginBenchmark, Display, TEXT("%s %dx%d %s: %.3f ms/frame, %.1f Mpixels/s, GPU %.3f ms/frame, %.1f Mpixels/s"), Mode.Name, Size.X, Size.Y, ParameterSet.Name,
+					FrameTimes.Num() > 0 ? TotalFrameTime / FrameTimes.Num() : 0.0, PixelsPerSecond / 1000000.0,
+					GPUTimes.Num() > 0 ? TotalGPUTime / GPUTimes.Num() : 0.0, GPUPixelsPerSecond / 1000000.0);
+			}
+
+			for (UTextureRenderTarget2D* RenderTarget : RenderTargets)
+			{
+				RenderTarget->RemoveFromRoot();
+			}
+		}
+
+		for (const TPair<IConsoleVariable*, FString>& PreviousValue : PreviousValues)
+		{
+			PreviousValue.Key->Set(*PreviousValue.Value, ECVF_SetByCode);
+		}
+	}
+
+	ShaderModule.EndRendering();
+	FlushRenderingCommands();
+
+	TSharedRef<FJsonObject> Report = MakeShared<FJsonObject>();
+	Report->SetStringField(TEXT("EngineVersion"), FEngineVersion::Current().ToString());
+	Report->SetStringField(TEXT("BuildVersion"), FApp::GetBuildVersion());
+	Report->SetStringField(TEXT("Platform"), FPlatformProperties::IniPlatformName());
+	Report->SetStringField(TEXT("RHI"), GDynamicRHI ? GDynamicRHI->GetName() : TEXT("None"));
+	Report->SetBoolField(TEXT("NullRHI"), GUsingNullRHI);
+	Report->SetNumberField(TEXT("Frames"), NumFrames);
+	Report->SetNumberField(TEXT("WarmupFrames"), NumWarmupFrames);
+	Report->SetArrayField(TEXT("Results"), Results);
+
+	FString Json;
+	TSharedRef<TJsonWriter<>> Writer = TJsonWriterFactory<>::Create(&Json);
+	FJsonSerializer::Serialize(Report, Writer);
+
+	if (!FFileHelper::SaveStringToFile(Json, *OutputPath))
+	{
+		UE_LOG(LogShaderPluginBenchmark, Error, TEXT("Failed to write the results to %s."), *OutputPath);
+		return 1;
+	}
+
+	UE_LOG(LogShaderPluginBenchmark, Display, TEXT("Wrote %d results to %s."), Results.Num(), *OutputPath);
+	return 0;
+}
@@ -0,0 +1,36 @@
+// Copyright 2016-2020 Cadic AB. All Rights Reserved.
+// @Author	Fredrik Lindh [Temaran] (temaran@gmail.com) {https://github.com/Temaran}
+///////////////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include "CoreMinimal.h"
+
+#include "Commandlets/Commandlet.h"
+#include "ShaderPluginBenchmarkCommandlet.generated.h"
+
+/*
+ * Drives FShaderDeclarationDemoModule through a number of frames for every combination of render target size,
+ * parameter set and execution mode, and writes the timings to a JSON file so they can be compared between builds.
+ * Runs fine with -nullrhi, in which case only the CPU backend is measured. The frame times are how long it took to submit
+ * each frame. The GPU modes also get GPUTimeMs, from timestamps around every frame, which is what to compare them on.
+ *
+ * Usage: UnrealEditor-Cmd ShaderPluginDemo.uproject -run=ShaderPluginBenchmark -nullrhi [options]
+ *   -Frames=N              Measured frames per combination (default 100)
+ *   -WarmupFrames=N        Frames drawn before measuring, to get allocations and shader compilation out of the way (default 10)
+ *   -Sizes=256,512x256,... Render target sizes, square or WidthxHeight (default 256,512,1024)
+ *   -Instances=N           Instances drawn each frame, each with its own render target (default 1)
+ *   -Modes=CPU,GPU,...     Which execution modes to run (default all that are available)
+ *   -Output=Path           Where to write the results (default Saved/Benchmarks/ShaderPluginBenchmark.json)
+ *   -Encode=PNG|EXR        Also encodes every frame through FShaderPluginFrameEncoder, into a Frames folder next to the results
+ */
+UCLASS()
+class UShaderPluginBenchmarkCommandlet : public UCommandlet
+{
+	GENERATED_BODY()
+
+public:
+	UShaderPluginBenchmarkCommandlet();
+
+	virtual int32 Main(const FString& Params) override;
+};
@@ -0,0 +1,195 @@
+// Copyright 2016-2020 Cadic AB. All Rights Reserved.
+// @Author	Fredrik Lindh [Temaran] (temaran@gmail.com) {https://github.com/Temaran}
+///////////////////////////////////////////////////////////////////////////////////////
+
+#include "ShaderPluginFlipbookBakeCommandlet.h"
+
+#include "ShaderPluginFlipbookBaker.h"
+
+#include "Dom/JsonObject.h"
+#include "Engine/Texture2DArray.h"
+#include "Misc/FileHelper.h"
+#include "Misc/PackageName.h"
+#include "Misc/Paths.h"
+#include "Serialization/JsonSerializer.h"
+#include "Serialization/JsonWriter.h"
+#include "UObject/Package.h"
+#include "UObject/SavePackage.h"
+
+DEFINE_LOG_CATEGORY_STATIC(LogShaderPluginFlipbookBake, Log, All);
+
+namespace
+{
+	// The formats the flipbook can end up in on the platforms we care about, for the memory report.
+	struct FFlipbookFormat
+	{
+		const TCHAR* Name;
+		int32 BlockSizeX;
+		int32 BlockSizeY;
+		int32 BlockBytes;
+	};
+
+	const FFlipbookFormat FlipbookFormats[] =
+	{
+		{ TEXT("BGRA8"), 1, 1, 4 },     // -Compression=None
+		{ TEXT("BC1"), 4, 4, 8 },       // -Compression=BC1 on desktop
+		{ TEXT("BC7"), 4, 4, 16 },      // -Compression=BC7 on desktop
+		{ TEXT("ETC2_RGB"), 4, 4, 8 },  // BC1 on older Android
+		{ TEXT("ASTC_4x4"), 4, 4, 16 }, // The mobile formats depend on the texture's compression quality
+		{ TEXT("ASTC_6x6"), 6, 6, 16 },
+		{ TEXT("ASTC_8x8"), 8, 8, 16 },
+	};
+
+	int64 GetFlipbookSize(const FFlipbookFormat& Format, FIntPoint FrameSize, int32 NumFrames, bool bMips)
+	{
+		// Texture arrays only have mips in X and Y, so every frame gets a full chain of its own.
+		const int32 NumMips = bMips ? FMath::FloorLog2(FrameSize.GetMax()) + 1 : 1;
+		int64 FrameBytes = 0;
+		for (int32 MipIndex = 0; MipIndex < NumMips; MipIndex++)
+		{
+			const int32 MipSizeX = FMath::Max(FrameSize.X >> MipIndex, 1);
+			const int32 MipSizeY = FMath::Max(FrameSize.Y >> MipIndex, 1);
+			FrameBytes += (int64)FMath::DivideAndRoundUp(MipSizeX, Format.BlockSizeX) * FMath::DivideAndRoundUp(MipSizeY, Format.BlockSizeY) * Format.BlockBytes;
+		}
+
+		return FrameBytes * NumFrames;
+	}
+
+#if WITH_EDITOR
+	bool SaveFlipbook(const FString& PackageName, const TArray<TArray<FColor>>& Frames, FIntPoint FrameSize, const FString& Compression, bool bMips)
+	{
+		UPackage* Package = CreatePackage(*PackageName);
+		UTexture2DArray* Texture = NewObject<UTexture2DArray>(Package, *FPackageName::GetShortName(PackageName), RF_Public | RF_Standalone);
+
+		// The source wants all the slices back to back.
+		TArray<FColor> Slices;
+		Slices.Reserve(FrameSize.X * FrameSize.Y * Frames.Num());
+		for (const TArray<FColor>& Frame : Frames)
+		{
+			Slices.Append(Frame);
+		}
+		Texture->Source.Init(FrameSize.X, FrameSize.Y, Frames.Num(), 1, TSF_BGRA8, (const uint8*)Slices.GetData());
+
+		// The frames are already gamma encoded, and the alpha is always 1 so there's no point in spending bits on it.
+		Texture->SRGB = true;
+		Texture->CompressionNoAlpha = true;
+		Texture->MipGenSettings = bMips ? TMGS_FromTextureGroup : TMGS_NoMipmaps;
+		if (Compression.Equals(TEXT("None"), ESearchCase::IgnoreCase))
+		{
+			Texture->CompressionSettings = TC_VectorDisplacementmap;
+		}
+		else if (Compression.Equals(TEXT("BC7"), ESearchCase::IgnoreCase))
+		{
+			Texture->CompressionSettings = TC_BC7;
+		}
+		else
+		{
+			Texture->CompressionSettings = TC_Default;
+		}
+		Texture->PostEditChange();
+		Package->MarkPackageDirty();
+
+		const FString Filename = FPackageName::LongPackageNameToFilename(PackageName, FPackageName::GetAssetPackageExtension());
+		FSavePackageArgs SaveArgs;
+		SaveArgs.TopLevelFlags = RF_Public | RF_Standalone;
+		return UPackage::SavePackage(Package, Texture, *Filename, SaveArgs);
+	}
+#endif
+}
+
+UShaderPluginFlipbookBakeCommandlet::UShaderPluginFlipbookBakeCommandlet()
+{
+	IsClient = false;
+	IsServer = false;
+	IsEditor = true;
+	LogToConsole = true;
+}
+
+int32 UShaderPluginFlipbookBakeCommandlet::Main(const FString& Params)
+{
+	FShaderPluginFlipbookSettings Settings;
+	Settings.Parameters = FShaderUsageExampleParameters(nullptr);
+	Settings.Parameters.StartColor = FColor::Green;
+	Settings.Parameters.EndColor = FColor::Red;
+	Settings.Parameters.ComputeShaderBlend = 1.0f;
+
+	int32 Size = Settings.FrameSize.X;
+	FString Compression = TEXT("BC1");
+	FString PackageName = TEXT("/Game/ShaderPluginDemo/T_ShaderPluginFlipbook");
+	FString ReportPath = FPaths::Combine(FPaths::ProjectSavedDir(), TEXT("Benchmarks"), TEXT("ShaderPluginFlipbookBake.json"));
+	FParse::Value(*Params, TEXT("Frames="), Settings.NumFrames);
+	FParse::Value(*Params, TEXT("Size="), Size);
+	FParse::Value(*Params, TEXT("Start="), Settings.StartTime);
+	FParse::Value(*Params, TEXT("Period="), Settings.LoopPeriod);
+	FParse::Value(*Params, TEXT("Blend="), Settings.Parameters.ComputeShaderBlend);
+	FParse::Value(*Params, TEXT("Compression="), Compression);
+	FParse::Value(*Params, TEXT("Package="), PackageName);
+	FParse::Value(*Params, TEXT("Report="), ReportPath);
+	Settings.FrameSize = FIntPoint(Size, Size);
+	Settings.bSeamlessLoop = !FParse::Param(*Params, TEXT("NoSeamlessLoop"));
+	Settings.bUseGPU = !FParse::Param(*Params, TEXT("CPU"));
+	const bool bMips = !FParse::Param(*Params, TEXT("NoMips"));
+
+	TArray<TArray<FColor>> Frames;
+	FShaderPluginFlipbookStats Stats;
+	if (!FShaderPluginFlipbookBaker::BakeFrames(Settings, Frames, Stats))
+	{
+		return 1;
+	}
+
+	const double FramesPerSecond = Stats.BakeSeconds > 0.0 ? Settings.NumFrames / Stats.BakeSeconds : 0.0;
+	const double PixelsPerSecond = Stats.BakeSeconds > 0.0 ? Stats.NumEvaluatedPixels / Stats.BakeSeconds : 0.0;
+	UE_LOG(LogShaderPluginFlipbookBake, Display, TEXT("Baked %d %dx%d frames on the %s in %.2f seconds: %.1f frames/s, %.1f Mpixels/s."), Settings.NumFrames, Size, Size,
+		Stats.bUsedGPU ? TEXT("GPU") : TEXT("CPU"), Stats.BakeSeconds, FramesPerSecond, PixelsPerSecond / 1000000.0);
+
+	TArray<TSharedPtr<FJsonValue>> Formats;
+	for (const FFlipbookFormat& Format : FlipbookFormats)
+	{
+		const int64 Bytes = GetFlipbookSize(Format, Settings.FrameSize, Settings.NumFrames, bMips);
+		UE_LOG(LogShaderPluginFlipbookBake, Display, TEXT("  %-10s %8.2f MB"), Format.Name, Bytes / (1024.0 * 1024.0));
+
+		TSharedRef<FJsonObject> FormatObject = MakeShared<FJsonObject>();
+		FormatObject->SetStringField(TEXT("Format"), Format.Name);
+		FormatObject->SetNumberField(TEXT("Bytes"), (double)Bytes);
+		Formats.Add(MakeShared<FJsonValueObject>(FormatObject));
+	}
+
+	bool bSaved = false;
+#if WITH_EDITOR
+	bSaved = SaveFlipbook(PackageName, Frames, Settings.FrameSize, Compression, bMips);
+	if (!bSaved)
+	{
+		UE_LOG(LogShaderPluginFlipbookBake, Error, TEXT("Failed to save %s."), *PackageName);
+	}
+#else
+	UE_LOG(LogShaderPluginFlipbookBake, Error, TEXT("Assets can only be saved from the editor, so %s was not written."), *PackageName);
+#endif
+
+	TSharedRef<FJsonObject> Report = MakeShared<FJsonObject>();
+	Report->SetStringField(TEXT("Package"), PackageName);
+	Report->SetStringField(TEXT("Compression"), Compression);
+	Report->SetBoolField(TEXT("UsedGPU"), Stats.bUsedGPU);
+	Report->SetBoolField(TEXT("SeamlessLoop"), Settings.bSeamlessLoop);
+	Report->SetBoolField(TEXT("Mips"), bMips);
+	Report->SetNumberField(TEXT("Frames"), Settings.NumFrames);
+	Report->SetNumberField(TEXT("Width"), Size);
+	Report->SetNumberField(TEXT("Height"), Size);
+	Report->SetNumberField(TEXT("LoopPeriod"), Settings.LoopPeriod);
+	Report->SetNumberField(TEXT("BakeSeconds"), Stats.BakeSeconds);
+	Report->SetNumberField(TEXT("FramesPerSecond"), FramesPerSecond);
+	Report->SetNumberField(TEXT("PixelsPerSecond"), PixelsPerSecond);
+	Report->SetArrayField(TEXT("MemoryByFormat"), Formats);
+
+	FString Json;
+	TSharedRef<TJsonWriter<>> Writer = TJsonWriterFactory<>::Create(&Json);
+	FJsonSerializer::Serialize(Report, Writer);
+
+	if (!FFileHelper::SaveStringToFile(Json, *ReportPath))
+	{
+		UE_LOG(LogShaderPluginFlipbookBake, Error, TEXT("Failed to write the report to %s."), *ReportPath);
+		return 1;
+	}
+
+	UE_LOG(LogShaderPluginFlipbookBake, Display, TEXT("Wrote the report to %s."), *ReportPath);
+	return bSaved ? 0 : 1;
+}
@@ -0,0 +1,39 @@
+// Copyright 2016-2020 Cadic AB. All Rights Reserved.
+// @Author	Fredrik Lindh [Temaran] (temaran@gmail.com) {https://github.com/Temaran}
+///////////////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include "CoreMinimal.h"
+
+#include "Commandlets/Commandlet.h"
+#include "ShaderPluginFlipbookBakeCommandlet.generated.h"
+
+/*
+ * Bakes a loop of the effect into a Texture2DArray asset, one frame per slice, so platforms that can't afford the fractal
+ * can play it back with a single texture fetch per pixel. Sample it with SampleShaderPluginFlipbook from
+ * /TutorialShaders/Private/Flipbook.ush in a Custom material node. Also writes a report with the bake throughput and the
+ * memory the flipbook would take with each compression format.
+ *
+ * Usage: UnrealEditor-Cmd ShaderPluginDemo.uproject -run=ShaderPluginFlipbookBake [options]
+ *   -Frames=N                      Frames in the loop (default 64)
+ *   -Size=N                        Square frame size (default 256)
+ *   -Start=T -Period=T             The SimulationState range the loop covers (default 0 and 20)
+ *   -Blend=B                       ComputeShaderBlend of the baked effect (default 1, only the fractal)
+ *   -NoSeamlessLoop                Don't crossfade the end of the loop into its start
+ *   -CPU                           Bake on the CPU even when there is a GPU
+ *   -Compression=BC1|BC7|None      Compression of the asset (default BC1, which the mobile platforms turn into ETC2 or ASTC)
+ *   -NoMips                        Don't generate mips, for flipbooks that are always seen at their full size
+ *   -Package=/Game/Path/Name       Where to save the asset (default /Game/ShaderPluginDemo/T_ShaderPluginFlipbook)
+ *   -Report=Path                   Where to write the report (default Saved/Benchmarks/ShaderPluginFlipbookBake.json)
+ */
+UCLASS()
+class UShaderPluginFlipbookBakeCommandlet : public UCommandlet
+{
+	GENERATED_BODY()
+
+public:
+	UShaderPluginFlipbookBakeCommandlet();
+
+	virtual int32 Main(const FString& Params) override;
+};
@@ -0,0 +1,191 @@
+// Copyright 2016-2020 Cadic AB. All Rights Reserved.
+// @Author	Fredrik Lindh [Temaran] (temaran@gmail.com) {https://github.com/Temaran}
+///////////////////////////////////////////////////////////////////////////////////////
+
+#include "ShaderPluginMaterialStressCommandlet.h"
+
+#include "ShaderDemoMaterialInstancePool.h"
+
+#include "Components/StaticMeshComponent.h"
+#include "Dom/JsonObject.h"
+#include "Engine/TextureRenderTarget2D.h"
+#include "HAL/PlatformMemory.h"
+#include "Materials/Material.h"
+#include "Materials/MaterialInstanceDynamic.h"
+#include "Misc/FileHelper.h"
+#include "Misc/Paths.h"
+#include "Serialization/JsonSerializer.h"
+#include "Serialization/JsonWriter.h"
+#include "UObject/Package.h"
+#include "UObject/UObjectArray.h"
+
+DEFINE_LOG_CATEGORY_STATIC(LogShaderPluginMaterialStress, Log, All);
+
+namespace
+{
+	const FName TextureParameterName(TEXT("InputTexture"));
+
+	struct FStressResult
+	{
+		const TCHAR* Name = nullptr;
+		double ApplySeconds = 0.0;
+		int32 NumObjectsCreated = 0;
+		int64 UsedMemoryDelta = 0;
+		double GCSeconds = 0.0;
+		int32 NumObjectsCollected = 0;
+	};
+
+	int32 GetNumObjects()
+	{
+		return GUObjectArray.GetObjectArrayNumMinusAvailable();
+	}
+
+	double CollectGarbageTimed(int32& OutNumObjectsCollected)
+	{
+		const int32 NumObjectsBefore = GetNumObjects();
+		const double StartTime = FPlatformTime::Seconds();
+		CollectGarbage(GARBAGE_COLLECTION_KEEPFLAGS, true);
+		const double Seconds = FPlatformTime::Seconds() - StartTime;
+		OutNumObjectsCollected = NumObjectsBefore - GetNumObjects();
+		return Seconds;
+	}
+
+	// Runs the clicks with one way of applying the material, and measures what they cost.
+	FStressResult RunStress(const TCHAR* Name, TArray<UPrimitiveComponent*>& Components, int32 NumClicks, TFunctionRef<void()> Click)
+	{
+		// Start from a clean slate, so what the last run left behind doesn't end up in this one's numbers.
+		for (UPrimitiveComponent* Component : Components)
+		{
+			Component->SetMaterial(0, nullptr);
+		}
+		int32 NumObjectsCollected = 0;
+		CollectGarbageTimed(NumObjectsCollected);
+
+		FStressResult Result;
+		Result.Name = Name;
+
+		const int32 NumObjectsBefore = GetNumObjects();
+		const uint64 UsedMemoryBefore = FPlatformMemory::GetStats().UsedPhysical;
+		const double StartTime = FPlatformTime::Seconds();
+		for (int32 ClickIndex = 0; ClickIndex < NumClicks; ClickIndex++)
+		{
+			Click();
+		}
+		Result.ApplySeconds = FPlatformTime::Seconds() - StartTime;
+		Result.NumObjectsCreated = GetNumObjects() - NumObjectsBefore;
+		Result.UsedMemoryDelta = (int64)FPlatformMemory::GetStats().UsedPhysical - (int64)UsedMemoryBefore;
+
+		// This is the collection the clicks would eventually cause in game, and mostly what spamming fire costs.
+		Result.GCSeconds = CollectGarbageTimed(Result.NumObjectsCollected);
+
+		const int32 NumApplications = FMath::Max(Components.Num() * NumClicks, 1);
+		UE_LOG(LogShaderPluginMaterialStress, Display, TEXT("%-12s apply %8.2f ms (%.3f us per component), %7d objects created, %8.2f MB, GC %8.2f ms collecting %7d objects"),
+			Name, Result.ApplySeconds * 1000.0, Result.ApplySeconds * 1000000.0 / NumApplications, Result.NumObjectsCreated, Result.UsedMemoryDelta / (1024.0 * 1024.0), Result.GCSeconds * 1000.0, Result.NumObjectsCollected);
+
+		return Result;
+	}
+}
+
+UShaderPluginMaterialStressCommandlet::UShaderPluginMaterialStressCommandlet()
+{
+	IsClient = false;
+	IsServer = false;
+	IsEditor = false;
+	LogToConsole = true;
+}
+
+int32 UShaderPluginMaterialStressCommandlet::Main(const FString& Params)
+{
+	int32 NumComponents = 5000;
+	int32 NumClicks = 20;
+	FString MaterialPath = TEXT("/TemaranShaderTutorial/M_ParameterizedSimpleTexture.M_ParameterizedSimpleTexture");
+	FString OutputPath = FPaths::Combine(FPaths::ProjectSavedDir(), TEXT("Benchmarks"), TEXT("ShaderPluginMaterialStress.json"));
+	FParse::Value(*Params, TEXT("Components="), NumComponents);
+	FParse::Value(*Params, TEXT("Clicks="), NumClicks);
+	FParse::Value(*Params, TEXT("Material="), MaterialPath);
+	FParse::Value(*Params, TEXT("Output="), OutputPath);
+	NumComponents = FMath::Max(NumComponents, 1);
+	NumClicks = FMath::Max(NumClicks, 1);
+
+	UMaterialInterface* BaseMaterial = LoadObject<UMaterialInterface>(nullptr, *MaterialPath);
+	if (!BaseMaterial)
+	{
+		UE_LOG(LogShaderPluginMaterialStress, Warning, TEXT("Couldn't load %s, using the default surface material instead."), *MaterialPath);
+		BaseMaterial = UMaterial::GetDefaultMaterial(MD_Surface);
+	}
+
+	// Nothing here is drawn, so neither the components nor the render target need to be registered or have resources.
+	UTextureRenderTarget2D* RenderTarget = NewObject<UTextureRenderTarget2D>(GetTransientPackage());
+	RenderTarget->AddToRoot();
+
+	TArray<UPrimitiveComponent*> Components;
+	Components.Reserve(NumComponents);
+	for (int32 ComponentIndex = 0; ComponentIndex < NumComponents; ComponentIndex++)
+	{
+		UStaticMeshComponent* Component = NewObject<UStaticMeshComponent>(GetTransientPackage());
+		Component->AddToRoot();
+		Components.Add(Component);
+	}
+
+	TArray<FStressResult> Results;
+
+	// What the character did before it had a pool: every hit gives every component a brand new instance.
+	Results.Add(RunStress(TEXT("PerComponent"), Components, NumClicks, [&]()
+	{
+		for (UPrimitiveComponent* Component : Components)
+		{
+			Component->SetMaterial(0, BaseMaterial);
+			UMaterialInstanceDynamic* Instance = Component->CreateAndSetMaterialInstanceDynamic(0);
+			Instance->SetTextureParameterValue(TextureParameterName, RenderTarget);
+		}
+	}));
+
+	{
+		// Rooted like everything else here, since nothing else references the pool while the stress collects garbage.
+		UShaderDemoMaterialInstancePool* Pool = NewObject<UShaderDemoMaterialInstancePool>(GetTransientPackage());
+		Pool->AddToRoot();
+		Results.Add(RunStress(TEXT("Pooled"), Components, NumClicks, [&]()
+		{
+			Pool->ApplyToComponents(Components, 0, BaseMaterial, TextureParameterName, RenderTarget);
+		}));
+		Pool->RemoveFromRoot();
+	}
+
+	for (UPrimitiveComponent* Component : Components)
+	{
+		Component->RemoveFromRoot();
+	}
+	RenderTarget->RemoveFromRoot();
+
+	TArray<TSharedPtr<FJsonValue>> ResultValues;
+	for (const FStressResult& Result : Results)
+	{
+		TSharedRef<FJsonObject> ResultObject = MakeShared<FJsonObject>();
+		ResultObject->SetStringField(TEXT("Mode"), Result.Name);
+		ResultObject->SetNumberField(TEXT("ApplySeconds"), Result.ApplySeconds);
+		ResultObject->SetNumberField(TEXT("ObjectsCreated"), Result.NumObjectsCreated);
+		ResultObject->SetNumberField(TEXT("UsedMemoryDelta"), (double)Result.UsedMemoryDelta);
+		ResultObject->SetNumberField(TEXT("GCSeconds"), Result.GCSeconds);
+		ResultObject->SetNumberField(TEXT("ObjectsCollected"), Result.NumObjectsCollected);
+		ResultValues.Add(MakeShared<FJsonValueObject>(ResultObject));
+	}
+
+	TSharedRef<FJsonObject> Report = MakeShared<FJsonObject>();
+	Report->SetStringField(TEXT("Material"), BaseMaterial->GetPathName());
+	Report->SetNumberField(TEXT("Components"), NumComponents);
+	Report->SetNumberField(TEXT("Clicks"), NumClicks);
+	Report->SetArrayField(TEXT("Results"), ResultValues);
+
+	FString Json;
+	TSharedRef<TJsonWriter<>> Writer = TJsonWriterFactory<>::Create(&Json);
+	FJsonSerializer::Serialize(Report, Writer);
+
+	if (!FFileHelper::SaveStringToFile(Json, *OutputPath))
+	{
+		UE_LOG(LogShaderPluginMaterialStress, Error, TEXT("Failed to write the results to %s."), *OutputPath);
+		return 1;
+	}
+
+	UE_LOG(LogShaderPluginMaterialStress, Display, TEXT("Wrote the results to %s."), *OutputPath);
+	return 0;
+}
@@ -0,0 +1,34 @@
+// Copyright 2016-2020 Cadic AB. All Rights Reserved.
+// @Author	Fredrik Lindh [Temaran] (temaran@gmail.com) {https://github.com/Temaran}
+///////////////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include "CoreMinimal.h"
+
+#include "Commandlets/Commandlet.h"
+#include "ShaderPluginMaterialStressCommandlet.generated.h"
+
+/*
+ * Paints thousands of static mesh components with the render target over and over, the way a player spamming fire across
+ * a level full of props would, and compares giving every component a dynamic material instance of its own on every hit
+ * against sharing them through UShaderDemoMaterialInstancePool. For each, it measures the time spent applying, how many
+ * objects were created, how much memory that took and how long the garbage collection afterwards took.
+ * Runs fine with -nullrhi.
+ *
+ * Usage: UnrealEditor-Cmd ShaderPluginDemo.uproject -run=ShaderPluginMaterialStress -nullrhi [options]
+ *   -Components=N    Components painted by every click (default 5000)
+ *   -Clicks=N        How many times all of them are painted (default 20)
+ *   -Material=Path   The base material (default the plugin's M_ParameterizedSimpleTexture)
+ *   -Output=Path     Where to write the results (default Saved/Benchmarks/ShaderPluginMaterialStress.json)
+ */
+UCLASS()
+class UShaderPluginMaterialStressCommandlet : public UCommandlet
+{
+	GENERATED_BODY()
+
+public:
+	UShaderPluginMaterialStressCommandlet();
+
+	virtual int32 Main(const FString& Params) override;
+};
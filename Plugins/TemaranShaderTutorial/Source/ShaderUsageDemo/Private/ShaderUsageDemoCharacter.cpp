@@ -5,11 +5,13 @@
 #include "ShaderUsageDemoCharacter.h"
 
 #include "ShaderDeclarationDemoModule.h"
+#include "ShaderDemoMaterialInstancePool.h"
 
 #include "Animation/AnimInstance.h"
 #include "Camera/CameraComponent.h"
 #include "Components/CapsuleComponent.h"
 #include "Components/InputComponent.h"
+#include "Engine/TextureRenderTarget2D.h"
 #include "GameFramework/InputSettings.h"
 #include "Kismet/GameplayStatics.h"
 #include "Runtime/Engine/Classes/Materials/MaterialInstanceDynamic.h"
@@ -52,6 +54,9 @@ AShaderUsageDemoCharacter::AShaderUsageDemoCharacter()
 	ComputeShaderSimulationSpeed = 1.0;
 	ComputeShaderBlend = 0.5f;
 	TotalTimeSecs = 0.0f;
+	bGenerateRenderTargetMips = false;
+	bApplyPostChain = false;
+	bBeganRendering = false;
 }
 
 void AShaderUsageDemoCharacter::BeginPlay()
@@ -59,11 +64,49 @@ void AShaderUsageDemoCharacter::BeginPlay()
 	Super::BeginPlay();
 	FP_Gun->AttachToComponent(Mesh1P, FAttachmentTransformRules::SnapToTargetIncludingScale, TEXT("GripPoint"));
 	FShaderDeclarationDemoModule::Get().BeginRendering();
+	bBeganRendering = true;
+
+	// The mips have to exist before they can be filled in, and the shader writes them as UAVs. Both are settings on the asset,
+	// and changing them on a loaded asset would stick for the rest of the editor session, where it could end up saved. So if
+	// the asset doesn't have them, we draw to a transient copy that does. Materials that reference the asset directly
+	// rather than through us keep showing the asset, so turn the settings on there if you rely on those.
+	if (bGenerateRenderTargetMips && RenderTarget && (!RenderTarget->bAutoGenerateMips || !RenderTarget->bCanCreateUAV))
+	{
+		RenderTarget = DuplicateObject<UTextureRenderTarget2D>(RenderTarget, this);
+		RenderTarget->SetFlags(RF_Transient);
+		RenderTarget->bAutoGenerateMips = true;
+		RenderTarget->bCanCreateUAV = true;
+		RenderTarget->UpdateResource();
+	}
+
+	ShaderInstanceHandle = FShaderDeclarationDemoModule::Get().RegisterInstance(FShaderUsageExampleParameters(RenderTarget));
+	FShaderDeclarationDemoModule::Get().SetMipGenerationEnabled(ShaderInstanceHandle, bGenerateRenderTargetMips);
+
+	// None of the stages name their textures, so each reads what the one before it wrote.
+	if (bApplyPostChain)
+	{
+		FShaderDeclarationDemoModule::Get().SetPostChain(ShaderInstanceHandle, FShaderPluginPostChain::Compile(
+		{
+			FShaderPluginPostStage::Bloom(0.7f, 1.5f, 6.0f),
+			FShaderPluginPostStage::PaletteRemap(FLinearColor(0.02f, 0.0f, 0.08f), FLinearColor(0.4f, 0.05f, 0.5f), FLinearColor(1.0f, 0.45f, 0.1f), FLinearColor(1.0f, 0.95f, 0.8f), 0.75f),
+			FShaderPluginPostStage::Sharpen(0.5f),
+		}));
+	}
 }
 
 void AShaderUsageDemoCharacter::BeginDestroy()
 {
-	FShaderDeclarationDemoModule::Get().EndRendering();
+	if (ShaderInstanceHandle.IsValid())
+	{
+		FShaderDeclarationDemoModule::Get().UnregisterInstance(ShaderInstanceHandle);
+	}
+
+	if (bBeganRendering)
+	{
+		FShaderDeclarationDemoModule::Get().EndRendering();
+		bBeganRendering = false;
+	}
+
 	Super::BeginDestroy();
 }
 
@@ -103,7 +146,7 @@ void AShaderUsageDemoCharacter::Tick(float DeltaSeconds)
 
 	// If doing this for realsies, you should avoid doing this every frame unless you have to of course.
 	// We set it every frame here since we're updating the end color and simulation state. Boop.
-	FShaderDeclarationDemoModule::Get().UpdateParameters(DrawParameters);
+	FShaderDeclarationDemoModule::Get().UpdateInstance(ShaderInstanceHandle, DrawParameters);
 }
 
 void AShaderUsageDemoCharacter::OnFire()
@@ -125,13 +168,18 @@ void AShaderUsageDemoCharacter::OnFire()
 			TArray<UStaticMeshComponent*> StaticMeshComponents = TArray<UStaticMeshComponent*>();
 			HitActor->GetComponents<UStaticMeshComponent>(StaticMeshComponents);
 
-			for (int32 i = 0; i < StaticMeshComponents.Num(); i++) 
+			// Every mesh gets the same instance from the pool, so hitting them again doesn't allocate a new one each time.
+			TArray<UPrimitiveComponent*> Components(StaticMeshComponents);
+			if (!MaterialInstancePool)
 			{
-				UStaticMeshComponent* CurrentStaticMeshPtr = StaticMeshComponents[i];
-				CurrentStaticMeshPtr->SetMaterial(0, MaterialToApplyToClickedObject);
-				UMaterialInstanceDynamic* MID =	CurrentStaticMeshPtr->CreateAndSetMaterialInstanceDynamic(0);
-				MID->SetTextureParameterValue("InputTexture", (UTexture*)RenderTarget);
+				MaterialInstancePool = NewObject<UShaderDemoMaterialInstancePool>(this);
 			}
+			TArray<UPrimitiveComponent*> PaintedComponents;
+			MaterialInstancePool->ApplyToComponents(Components, 0, MaterialToApplyToClickedObject, TEXT("InputTexture"), RenderTarget, &PaintedComponents);
+
+			// Now the effect only needs to be drawn while these meshes, or others we've hit, are on screen.
+			// Meshes we hit before already show the instance and are consumers already, so only the new ones are added.
+			FShaderDeclarationDemoModule::Get().AddInstanceConsumers(ShaderInstanceHandle, PaintedComponents);
 		}
 	}
 
@@ -7,9 +7,11 @@
 #include "CoreMinimal.h"
 
 #include "GameFramework/Character.h"
+#include "ShaderDeclarationDemoModule.h"
 #include "ShaderUsageDemoCharacter.generated.h"
 
 class UInputComponent;
+class UShaderDemoMaterialInstancePool;
 
 UCLASS()
 class AShaderUsageDemoCharacter : public ACharacter
@@ -60,6 +62,15 @@ public:
 	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = ShaderDemo)
 	class UTextureRenderTarget2D* RenderTarget;
 
+	// Gives the render target a mip chain and rebuilds it every time the effect is drawn, so the cubes we paint don't alias from afar.
+	// If the asset isn't set up for it (bAutoGenerateMips and bCanCreateUAV), we draw to a transient copy of it that is.
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = ShaderDemo)
+	bool bGenerateRenderTargetMips;
+
+	// Runs the effect through bloom, a palette remap and a sharpen before it reaches the render target.
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = ShaderDemo)
+	bool bApplyPostChain;
+
 public:
 	AShaderUsageDemoCharacter();
 	virtual void BeginPlay() override;
@@ -71,6 +82,15 @@ protected:
 	float EndColorBuildupDirection;
 	float ComputeShaderBlend;
 	float TotalTimeSecs;
+	FShaderUsageExampleHandle ShaderInstanceHandle;
+
+	// BeginDestroy also runs for characters that never played, like the class default object, which must not end
+	// rendering for everyone else.
+	bool bBeganRendering;
+
+	// The material instances we paint hit meshes with, shared between all of them.
+	UPROPERTY(Transient)
+	UShaderDemoMaterialInstancePool* MaterialInstancePool;
 
 	void OnFire();
 	void TurnAtRate(float Rate);